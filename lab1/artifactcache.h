@@ -0,0 +1,143 @@
+#pragma once
+
+// Кэш производных данных изображения на диске: гистограммы, ёмкость, пары
+// пик/ноль, порядок блоков по градиенту, энтропия и корреляция плоскостей.
+// Всё это зависит только от пикселей, поэтому ключ - contentHash64 пикселей
+// (с размерами в seed), а не имя файла: переименование набора кэш не
+// сбрасывает, а изменённое изображение просто получает новый ключ.
+//
+//   <dir>/<ключ, 16 hex>.<kind>:  ArtifactHeader | payload
+//
+// kind включает версию формата ("hs1", "grad4v1"), при смене алгоритма
+// меняется kind, и старые файлы перестают находиться. Запись идёт во
+// временный файл (имя с номером процесса и потока) с переименованием, так
+// что параллельные запуски и потоки видят либо целый файл, либо никакого.
+// Файл, чей размер не сходится с заголовком, считается промахом.
+
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "datapack.h"
+
+#pragma pack(push, 1)
+struct ArtifactHeader {
+    char magic[4];        // "ART1"
+    uint32_t kindHash;    // младшие биты хэша kind, защита от перепутанных файлов
+    uint64_t key;
+    uint64_t size;        // байт payload
+    uint64_t check;       // contentHash64 payload
+};
+#pragma pack(pop)
+
+class ArtifactCache {
+private:
+    std::string dir;
+    bool enabled;
+
+    std::string pathFor(uint64_t key, const std::string& kind) const {
+        char name[17];
+        std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+        return dir + "/" + name + "." + kind;
+    }
+
+    static uint32_t kindHash(const std::string& kind) {
+        return static_cast<uint32_t>(contentHash64(kind.data(), kind.size()));
+    }
+
+    static unsigned long processId() {
+#ifdef _WIN32
+        return static_cast<unsigned long>(GetCurrentProcessId());
+#else
+        return static_cast<unsigned long>(getpid());
+#endif
+    }
+
+public:
+    mutable std::atomic<size_t> hits{0}, misses{0};
+
+    explicit ArtifactCache(const std::string& directory) : dir(directory), enabled(true) {
+        std::error_code ec;
+        std::filesystem::create_directories(dir, ec);
+        if (ec) enabled = false;
+    }
+
+    static uint64_t key(const uint8_t* pixels, int width, int height) {
+        uint64_t seed = (static_cast<uint64_t>(static_cast<uint32_t>(width)) << 32) | static_cast<uint32_t>(height);
+        return contentHash64(pixels, static_cast<size_t>(width) * height, seed);
+    }
+
+    bool load(uint64_t key, const std::string& kind, std::vector<uint8_t>& payload) const {
+        if (!enabled) return false;
+        std::ifstream file(pathFor(key, kind), std::ios::binary);
+        ArtifactHeader header;
+        if (!file || !file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+            std::memcmp(header.magic, "ART1", 4) != 0 || header.key != key || header.kindHash != kindHash(kind)) {
+            misses++;
+            return false;
+        }
+        // Размер из заголовка сверяется с файлом до выделения памяти
+        std::streamoff begin = file.tellg();
+        file.seekg(0, std::ios::end);
+        std::streamoff end = file.tellg();
+        if (begin < 0 || end < begin || header.size != static_cast<uint64_t>(end - begin)) {
+            misses++;
+            return false;
+        }
+        file.seekg(begin);
+        payload.resize(header.size);
+        if (!file.read(reinterpret_cast<char*>(payload.data()), header.size) ||
+            contentHash64(payload.data(), payload.size()) != header.check) {
+            misses++;
+            return false;
+        }
+        hits++;
+        return true;
+    }
+
+    bool store(uint64_t key, const std::string& kind, const void* data, size_t size) const {
+        if (!enabled) return false;
+        ArtifactHeader header;
+        std::memcpy(header.magic, "ART1", 4);
+        header.kindHash = kindHash(kind);
+        header.key = key;
+        header.size = size;
+        header.check = contentHash64(data, size);
+
+        std::string path = pathFor(key, kind);
+        std::string tmp = path + ".tmp" + std::to_string(processId()) + "_" +
+                          std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+        {
+            std::ofstream file(tmp, std::ios::binary);
+            if (!file) return false;
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(static_cast<const char*>(data), size);
+            if (!file) return false;
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmp, path, ec);
+        if (ec) std::filesystem::remove(tmp, ec);
+        return !ec;
+    }
+
+    // Для векторов простых типов (int32_t, double, ...)
+    template <typename T>
+    bool load(uint64_t key, const std::string& kind, std::vector<T>& out) const {
+        std::vector<uint8_t> payload;
+        if (!load(key, kind, payload) || payload.size() % sizeof(T) != 0) return false;
+        out.resize(payload.size() / sizeof(T));
+        if (!payload.empty()) std::memcpy(out.data(), payload.data(), payload.size());
+        return true;
+    }
+
+    template <typename T>
+    bool store(uint64_t key, const std::string& kind, const std::vector<T>& values) const {
+        return store(key, kind, values.data(), values.size() * sizeof(T));
+    }
+};
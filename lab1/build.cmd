@@ -1,2 +1,3 @@
 g++ .\lab1.cpp -o lab1 -fexec-charset=windows-1251
-g++ .\lab1.2.cpp -o lab12 -fexec-charset=windows-1251
\ No newline at end of file
+g++ .\lab1.2.cpp -o lab12 -fexec-charset=windows-1251
+g++ .\datapack.cpp -o datapack -fexec-charset=windows-1251
\ No newline at end of file
@@ -0,0 +1,206 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cmath>
+#include <filesystem>
+#include <algorithm>
+#include <iomanip>
+#include <chrono>
+
+#include "datapack.h"
+
+namespace fs = std::filesystem;
+
+#pragma pack(push, 1)
+struct BMPHeader {
+    uint16_t bfType;
+    uint32_t bfSize;
+    uint16_t bfReserved1;
+    uint16_t bfReserved2;
+    uint32_t bfOffBits;
+    uint32_t biSize;
+    int32_t  biWidth;
+    int32_t  biHeight;
+    uint16_t biPlanes;
+    uint16_t biBitCount;
+    uint32_t biCompression;
+    uint32_t biSizeImage;
+    int32_t  biXPelsPerMeter;
+    int32_t  biYPelsPerMeter;
+    uint32_t biClrUsed;
+    uint32_t biClrImportant;
+};
+#pragma pack(pop)
+
+class GrayBMP {
+private:
+    BMPHeader header;
+    std::vector<uint8_t> palette;
+    std::vector<uint8_t> pixels;
+    int width, height;
+    bool loaded;
+
+    bool readBMP(const std::string& filename) {
+        std::ifstream file(filename, std::ios::binary);
+        if (!file) return false;
+
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (header.bfType != 0x4D42 || header.biBitCount != 8)
+            return false;
+
+        width = header.biWidth;
+        height = std::abs(header.biHeight);
+
+        palette.resize(1024);
+        file.seekg(sizeof(header), std::ios::beg);
+        file.read(reinterpret_cast<char*>(palette.data()), 1024);
+
+        file.seekg(header.bfOffBits, std::ios::beg);
+        int rowSize = (width * 8 + 31) / 32 * 4;
+        int dataSize = rowSize * height;
+        std::vector<uint8_t> rawData(dataSize);
+        file.read(reinterpret_cast<char*>(rawData.data()), dataSize);
+
+        pixels.resize(width * height);
+        for (int y = 0; y < height; ++y) {
+            int srcY = (header.biHeight > 0) ? (height - 1 - y) : y;
+            for (int x = 0; x < width; ++x) {
+                pixels[y * width + x] = rawData[srcY * rowSize + x];
+            }
+        }
+        loaded = true;
+        file.close();
+        return true;
+    }
+
+public:
+    GrayBMP() : loaded(false), width(0), height(0) {}
+
+    bool load(const std::string& filename) { return readBMP(filename); }
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    int getSize() const { return width * height; }
+
+    uint8_t* data() { return pixels.data(); }
+    const uint8_t* data() const { return pixels.data(); }
+};
+
+// Упаковка: все 8-битные BMP папки по имени -> один архив. Место под
+// индекс резервируется по числу файлов, отсчёты пишутся сразу после чтения
+// каждого BMP, а заголовок и индекс дописываются в конце: в памяти только
+// одно изображение, а не весь набор.
+bool packFolder(const std::string& folder, const std::string& outPath) {
+    std::vector<fs::path> files;
+    for (const auto& entry : fs::directory_iterator(folder)) {
+        if (entry.path().extension() == ".bmp") files.push_back(entry.path());
+    }
+    std::sort(files.begin(), files.end());
+
+    std::ofstream out(outPath, std::ios::binary);
+    if (!out) return false;
+
+    auto align = [](uint64_t v) { return (v + PACK_ALIGN - 1) / PACK_ALIGN * PACK_ALIGN; };
+    std::vector<char> zeros(PACK_ALIGN, 0);
+    uint64_t indexEnd = sizeof(PackHeader) + files.size() * sizeof(PackEntry);
+    uint64_t dataOffset = align(indexEnd);
+    std::vector<char> reserved(dataOffset, 0);
+    out.write(reserved.data(), reserved.size());
+
+    std::vector<PackEntry> entries;
+    uint64_t pos = dataOffset;
+    for (const auto& f : files) {
+        GrayBMP img;
+        std::string name = f.filename().string();
+        if (!img.load(f.string()) || name.size() >= sizeof(PackEntry::name)) {
+            std::cerr << "Skipping " << f << "\n";
+            continue;
+        }
+        PackEntry e;
+        std::memset(&e, 0, sizeof(e));
+        std::memcpy(e.name, name.c_str(), name.size());
+        e.width = img.getWidth();
+        e.height = img.getHeight();
+        e.bitDepth = 8;
+        e.size = img.getSize();
+        e.hash = contentHash64(img.data(), e.size);
+        e.offset = align(pos);
+        out.write(zeros.data(), e.offset - pos);
+        out.write(reinterpret_cast<const char*>(img.data()), e.size);
+        pos = e.offset + e.size;
+        entries.push_back(e);
+    }
+
+    PackHeader header;
+    std::memcpy(header.magic, PACK_MAGIC, 8);
+    header.count = static_cast<uint32_t>(entries.size());
+    header.entrySize = sizeof(PackEntry);
+    header.dataOffset = dataOffset;
+    header.fileSize = align(pos);
+    out.write(zeros.data(), header.fileSize - pos);
+
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(PackEntry));
+    out.close();
+
+    std::cout << "Packed " << entries.size() << " images from " << folder << " -> " << outPath
+              << " (" << header.fileSize << " bytes)\n";
+    return static_cast<bool>(out);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cout << "Usage:\n"
+                  << "  datapack pack <folder> <out.pack>\n"
+                  << "  datapack list <file.pack>\n"
+                  << "  datapack verify <file.pack>\n";
+        return 1;
+    }
+    std::string mode = argv[1];
+
+    if (mode == "pack") {
+        if (argc < 4) {
+            std::cerr << "Output file required\n";
+            return 1;
+        }
+        return packFolder(argv[2], argv[3]) ? 0 : 1;
+    }
+
+    ImagePack pack;
+    if (!pack.open(argv[2])) {
+        std::cerr << "Cannot open pack " << argv[2] << "\n";
+        return 1;
+    }
+
+    if (mode == "list") {
+        for (uint32_t i = 0; i < pack.size(); ++i) {
+            const PackEntry& e = pack.entry(i);
+            std::cout << std::left << std::setw(24) << pack.name(i) << std::right
+                      << std::setw(6) << e.width << " x " << std::setw(5) << e.height
+                      << std::setw(12) << e.offset << "  " << std::hex << std::setw(16) << std::setfill('0')
+                      << e.hash << std::dec << std::setfill(' ') << "\n";
+        }
+        return 0;
+    }
+
+    if (mode == "verify") {
+        auto t0 = std::chrono::steady_clock::now();
+        int bad = 0;
+        for (uint32_t i = 0; i < pack.size(); ++i) {
+            if (!pack.verify(i)) {
+                std::cerr << "Hash mismatch: " << pack.name(i) << "\n";
+                bad++;
+            }
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        std::cout << pack.size() - bad << "/" << pack.size() << " images OK ("
+                  << std::chrono::duration<double>(t1 - t0).count() << " s)\n";
+        return bad ? 1 : 0;
+    }
+
+    std::cerr << "Unknown mode " << mode << "\n";
+    return 1;
+}
@@ -0,0 +1,216 @@
+#pragma once
+
+// Архив набора изображений: один файл вместо сотен BMP.
+//
+//   PackHeader | PackEntry[count] | пиксели, каждый блок выровнен на 64 байта
+//
+// Пиксели хранятся построчно сверху вниз без выравнивания строк, 8 бит на
+// отсчёт. Индекс фиксированного размера, поэтому после mmap запись i - это
+// просто entries[i], без разбора и без системных вызовов на файл.
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+const char PACK_MAGIC[8] = {'I', 'M', 'G', 'P', 'A', 'C', 'K', '1'};
+const uint64_t PACK_ALIGN = 64;
+
+#pragma pack(push, 1)
+struct PackHeader {
+    char magic[8];
+    uint32_t count;
+    uint32_t entrySize;
+    uint64_t dataOffset;
+    uint64_t fileSize;
+};
+
+struct PackEntry {
+    char name[64];        // имя файла без пути, с нулём в конце
+    uint32_t width;
+    uint32_t height;
+    uint16_t bitDepth;
+    uint16_t reserved0;
+    uint32_t reserved1;
+    uint64_t offset;      // от начала файла, кратно PACK_ALIGN
+    uint64_t size;
+    uint64_t hash;        // contentHash64 пикселей
+    uint8_t reserved2[24];
+};
+#pragma pack(pop)
+
+static_assert(sizeof(PackEntry) == 128, "PackEntry must stay 128 bytes");
+
+// XXH64 (Collet), seed 0: 64-битный хэш содержимого, 32 байта за итерацию
+inline uint64_t contentHash64(const void* data, size_t len, uint64_t seed = 0) {
+    const uint64_t P1 = 11400714785074694791ull, P2 = 14029467366897019727ull, P3 = 1609587929392839161ull;
+    const uint64_t P4 = 9650029242287828579ull, P5 = 2870177450012600261ull;
+    auto rotl = [](uint64_t x, int r) { return (x << r) | (x >> (64 - r)); };
+    auto read64 = [](const uint8_t* p) { uint64_t v; std::memcpy(&v, p, 8); return v; };
+    auto read32 = [](const uint8_t* p) { uint32_t v; std::memcpy(&v, p, 4); return static_cast<uint64_t>(v); };
+    auto round = [&](uint64_t acc, uint64_t input) { return rotl(acc + input * P2, 31) * P1; };
+    auto merge = [&](uint64_t acc, uint64_t val) { return (acc ^ round(0, val)) * P1 + P4; };
+
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    const uint8_t* end = p + len;
+    uint64_t h;
+
+    if (len >= 32) {
+        uint64_t v1 = seed + P1 + P2, v2 = seed + P2, v3 = seed, v4 = seed - P1;
+        do {
+            v1 = round(v1, read64(p));
+            v2 = round(v2, read64(p + 8));
+            v3 = round(v3, read64(p + 16));
+            v4 = round(v4, read64(p + 24));
+            p += 32;
+        } while (p + 32 <= end);
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = merge(h, v1);
+        h = merge(h, v2);
+        h = merge(h, v3);
+        h = merge(h, v4);
+    } else {
+        h = seed + P5;
+    }
+    h += len;
+
+    for (; p + 8 <= end; p += 8) h = rotl(h ^ round(0, read64(p)), 27) * P1 + P4;
+    if (p + 4 <= end) {
+        h = rotl(h ^ (read32(p) * P1), 23) * P2 + P3;
+        p += 4;
+    }
+    for (; p < end; ++p) h = rotl(h ^ (*p * P5), 11) * P1;
+
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+}
+
+// Только чтение: файл целиком отображается в память, изображения - указатели
+// внутрь отображения, действительные пока жив ImagePack
+class ImagePack {
+private:
+    const uint8_t* base = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+
+    const PackHeader& header() const { return *reinterpret_cast<const PackHeader*>(base); }
+
+public:
+    ImagePack() = default;
+    ImagePack(const ImagePack&) = delete;
+    ImagePack& operator=(const ImagePack&) = delete;
+    ~ImagePack() { close(); }
+
+    bool open(const std::string& path) {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size) || size.QuadPart < static_cast<LONGLONG>(sizeof(PackHeader))) {
+            close();
+            return false;
+        }
+        length = static_cast<size_t>(size.QuadPart);
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping) {
+            close();
+            return false;
+        }
+        base = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(PackHeader))) {
+            close();
+            return false;
+        }
+        length = static_cast<size_t>(st.st_size);
+        void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            close();
+            return false;
+        }
+        madvise(p, length, MADV_SEQUENTIAL);
+        base = static_cast<const uint8_t*>(p);
+#endif
+        if (!base || std::memcmp(header().magic, PACK_MAGIC, 8) != 0 || header().entrySize != sizeof(PackEntry) ||
+            header().fileSize != length ||
+            sizeof(PackHeader) + static_cast<uint64_t>(header().count) * sizeof(PackEntry) > length) {
+            close();
+            return false;
+        }
+        // Запись должна целиком лежать в файле и вмещать width * height
+        // 8-битных отсчётов, иначе читатели выйдут за отображение
+        for (uint32_t i = 0; i < size(); ++i) {
+            const PackEntry& e = entry(i);
+            uint64_t needed = static_cast<uint64_t>(e.width) * e.height;
+            if (e.bitDepth != 8 || needed == 0 || needed > INT32_MAX || e.size < needed || e.offset > length ||
+                e.size > length - e.offset) {
+                close();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (base) UnmapViewOfFile(base);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (base) munmap(const_cast<uint8_t*>(base), length);
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+#endif
+        base = nullptr;
+        length = 0;
+    }
+
+    bool isOpen() const { return base != nullptr; }
+    uint32_t size() const { return base ? header().count : 0; }
+
+    const PackEntry& entry(uint32_t i) const {
+        return reinterpret_cast<const PackEntry*>(base + sizeof(PackHeader))[i];
+    }
+
+    std::string name(uint32_t i) const { return std::string(entry(i).name, strnlen(entry(i).name, sizeof(entry(i).name))); }
+    const uint8_t* pixels(uint32_t i) const { return base + entry(i).offset; }
+
+    bool verify(uint32_t i) const { return contentHash64(pixels(i), entry(i).size) == entry(i).hash; }
+};
+
+// Архив рядом с папкой набора (datapack pack set1 set1.pack): если он есть,
+// программы читают набор из него - одно отображение вместо открытия файла на
+// изображение, порядок - по именам. Повреждённый архив молча папку не подменяет.
+inline bool openSiblingPack(const std::string& folder, ImagePack& pack) {
+    std::string path = folder + ".pack";
+    if (!std::ifstream(path)) return false;
+    if (pack.open(path)) return true;
+    std::cerr << "Cannot open pack " << path << ", reading " << folder << "\n";
+    return false;
+}
@@ -9,6 +9,12 @@
 #include <map>
 #include <iomanip>
 #include <algorithm>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+#include "artifactcache.h"
+#include "trace.h"
 
 namespace fs = std::filesystem;
 
@@ -160,6 +166,7 @@ private:
     std::string datasetType;
 
     bool readBMP(const std::string& file) {
+        TRACE_SCOPE("bmp.read");
         std::ifstream f(file, std::ios::binary);
         if (!f) return false;
 
@@ -196,6 +203,7 @@ private:
     }
 
     bool writeBMP(const std::string& file) {
+        TRACE_SCOPE("bmp.write");
         if (!isLoaded) return false;
 
         std::ofstream f(file, std::ios::binary);
@@ -239,6 +247,34 @@ public:
         return writeBMP(file);
     }
 
+    // Изображение из готовых отсчётов (сверху вниз), со стандартной серой
+    // палитрой - так читаются наборы из архива datapack; file - имя для отчётов
+    bool fromPixels(int w, int h, const uint8_t* src, const std::string& file) {
+        int rowSize = (w * 8 + 31) / 32 * 4;
+        std::memset(&header, 0, sizeof(header));
+        header.bfType = 0x4D42;
+        header.bfOffBits = sizeof(header) + 1024;
+        header.bfSize = header.bfOffBits + rowSize * h;
+        header.biSize = 40;
+        header.biWidth = w;
+        header.biHeight = h;
+        header.biPlanes = 1;
+        header.biBitCount = 8;
+        header.biSizeImage = rowSize * h;
+        header.biClrUsed = 256;
+        palette.resize(1024);
+        for (int i = 0; i < 256; i++) {
+            palette[i * 4 + 0] = palette[i * 4 + 1] = palette[i * 4 + 2] = static_cast<uint8_t>(i);
+            palette[i * 4 + 3] = 0;
+        }
+        width = w;
+        height = h;
+        pixels.assign(src, src + static_cast<size_t>(w) * h);
+        isLoaded = true;
+        filename = file;
+        return true;
+    }
+
     int getWidth() const { return width; }
     int getHeight() const { return height; }
     int getSize() const { return width * height; }
@@ -334,11 +370,113 @@ public:
     }
 };
 
+// Изображения грузятся при первом обращении и держатся в LRU-кэше с
+// ограничением по байтам. Вытесненное изображение остаётся живым, пока на
+// него есть shared_ptr у вызывающего.
+class ImageCache {
+private:
+    typedef std::pair<std::string, std::shared_ptr<GrayBMP>> Item;
+
+    size_t budget;
+    size_t bytes = 0;
+    std::list<Item> order;
+    std::unordered_map<std::string, std::list<Item>::iterator> index;
+
+    static size_t footprint(const GrayBMP& img) { return sizeof(GrayBMP) + 1024 + img.getSize(); }
+
+public:
+    size_t hits = 0, misses = 0;
+
+    explicit ImageCache(size_t budgetBytes) : budget(budgetBytes) {}
+
+    // load(GrayBMP&) читает изображение при промахе
+    template <typename Load>
+    std::shared_ptr<GrayBMP> get(const std::string& path, const std::string& type, Load load) {
+        auto found = index.find(path);
+        if (found != index.end()) {
+            hits++;
+            order.splice(order.begin(), order, found->second);
+            return found->second->second;
+        }
+
+        misses++;
+        auto img = std::make_shared<GrayBMP>();
+        if (!load(*img)) return nullptr;
+        img->setDatasetType(type);
+
+        order.emplace_front(path, img);
+        index[path] = order.begin();
+        bytes += footprint(*img);
+        while (bytes > budget && order.size() > 1) {
+            bytes -= footprint(*order.back().second);
+            index.erase(order.back().first);
+            order.pop_back();
+        }
+        return img;
+    }
+};
+
+// Набор: список файлов составляется сразу (по заголовку, без чтения
+// пикселей), сами изображения - через общий кэш. Если рядом с папкой есть
+// архив <папка>.pack, список и пиксели берутся из него.
+class LazyDataset {
+private:
+    std::vector<std::string> paths;
+    std::string type;
+    ImageCache* cache = nullptr;
+    ImagePack pack;
+    bool packed = false;
+
+    static bool isGrayBMP(const std::string& path) {
+        std::ifstream f(path, std::ios::binary);
+        BMPHeader header;
+        if (!f.read(reinterpret_cast<char*>(&header), sizeof(header))) return false;
+        return header.bfType == 0x4D42 && header.biBitCount == 8;
+    }
+
+public:
+    void open(const std::string& path, const std::string& datasetType, int maxImages, ImageCache& imageCache) {
+        type = datasetType;
+        cache = &imageCache;
+        paths.clear();
+        packed = openSiblingPack(path, pack);
+        if (packed) {
+            for (uint32_t i = 0; i < pack.size() && (int)paths.size() < maxImages; ++i) {
+                paths.push_back((fs::path(path) / pack.name(i)).string());
+            }
+            return;
+        }
+        if (!fs::exists(path)) return;
+
+        for (const auto& entry : fs::directory_iterator(path)) {
+            if ((int)paths.size() >= maxImages) break;
+
+            if (entry.path().extension() == ".bmp" || entry.path().extension() == ".BMP") {
+                if (isGrayBMP(entry.path().string())) paths.push_back(entry.path().string());
+            }
+        }
+    }
+
+    bool empty() const { return paths.empty(); }
+    size_t size() const { return paths.size(); }
+    const std::string& name() const { return type; }
+    std::shared_ptr<GrayBMP> operator[](size_t i) const {
+        const std::string& path = paths[i];
+        if (!packed) return cache->get(path, type, [&](GrayBMP& img) { return img.load(path); });
+        return cache->get(path, type, [&](GrayBMP& img) {
+            const PackEntry& e = pack.entry(static_cast<uint32_t>(i));
+            return img.fromPixels(e.width, e.height, pack.pixels(static_cast<uint32_t>(i)), path);
+        });
+    }
+};
+
 class SteganographyResearcher {
 private:
-    std::vector<GrayBMP> set1;
-    std::vector<GrayBMP> set2;
-    std::vector<GrayBMP> set3;
+    ImageCache cache;
+    ArtifactCache artifacts{"artifact_cache"};
+    LazyDataset set1;
+    LazyDataset set2;
+    LazyDataset set3;
     std::string messageFile;
     
     struct ResearchResult {
@@ -357,14 +495,15 @@ private:
     std::vector<ResearchResult> allResults;
 
 public:
-    SteganographyResearcher(const std::string& msgFile) : messageFile(msgFile) {}
+    SteganographyResearcher(const std::string& msgFile, size_t cacheBytes = 64u << 20)
+        : cache(cacheBytes), messageFile(msgFile) {}
     
     bool loadDatasets(const std::string& pathSet1, const std::string& pathSet2, 
                       const std::string& pathSet3, int maxImages = 100) {
         
-        loadImagesFromPath(pathSet1, set1, "set1", maxImages);
-        loadImagesFromPath(pathSet2, set2, "set2", maxImages);
-        loadImagesFromPath(pathSet3, set3, "set3", maxImages);
+        set1.open(pathSet1, "set1", maxImages, cache);
+        set2.open(pathSet2, "set2", maxImages, cache);
+        set3.open(pathSet3, "set3", maxImages, cache);
         
         return !set1.empty() || !set2.empty() || !set3.empty();
     }
@@ -382,29 +521,15 @@ public:
     }
     
     void embedAndEvaluate() {
-        if (!set1.empty()) {
-            evaluateEmbeddingForImage(set1[0], "set1_sample");
-        }
-        if (!set2.empty()) {
-            evaluateEmbeddingForImage(set2[0], "set2_sample");
-        }
-        if (!set3.empty()) {
-            evaluateEmbeddingForImage(set3[0], "set3_sample");
-        }
+        embedForDataset(set1);
+        embedForDataset(set2);
+        embedForDataset(set3);
     }
     
     void generateHistograms() {
-        for (int i = 0; i < std::min(3, (int)set1.size()); i++) {
-            generateHistogramPair(set1[i], "set1_" + std::to_string(i+1));
-        }
-        
-        for (int i = 0; i < std::min(3, (int)set2.size()); i++) {
-            generateHistogramPair(set2[i], "set2_" + std::to_string(i+1));
-        }
-        
-        for (int i = 0; i < std::min(3, (int)set3.size()); i++) {
-            generateHistogramPair(set3[i], "set3_" + std::to_string(i+1));
-        }
+        histogramsForDataset(set1);
+        histogramsForDataset(set2);
+        histogramsForDataset(set3);
     }
     
     void systematicComparison() {
@@ -414,51 +539,99 @@ public:
         
         printSummaryTable();
     }
+
+    // Все этапы подряд для одного набора, затем для следующего: этапы
+    // обращаются к одним и тем же первым изображениям, и они ещё в кэше
+    void runByDataset(int numRepresentative = 5) {
+        for (LazyDataset* set : {&set1, &set2, &set3}) {
+            visualizeForDataset(*set, set->name(), numRepresentative);
+            evaluateDatasetStructure(*set, set->name());
+            embedForDataset(*set);
+            histogramsForDataset(*set);
+            compareDataset(*set, set->name(), 10);
+        }
+        printSummaryTable();
+        std::cout << "\nКэш изображений: попаданий " << cache.hits << ", загрузок " << cache.misses << "\n";
+    }
     
 private:
-    void loadImagesFromPath(const std::string& path, std::vector<GrayBMP>& images, 
-                           const std::string& type, int maxImages) {
-        if (!fs::exists(path)) return;
-        
-        int count = 0;
-        for (const auto& entry : fs::directory_iterator(path)) {
-            if (count >= maxImages) break;
-            
-            if (entry.path().extension() == ".bmp" || entry.path().extension() == ".BMP") {
-                GrayBMP img;
-                if (img.load(entry.path().string())) {
-                    img.setDatasetType(type);
-                    images.push_back(img);
-                    count++;
-                }
-            }
+    // Энтропия и корреляция соседних пикселей исходного изображения от
+    // сообщения не зависят и берутся из кэша артефактов: "basestats1"
+    std::vector<double> baseStatistics(const GrayBMP& image) {
+        TRACE_SCOPE("stats.base");
+        uint64_t key = ArtifactCache::key(image.getPixelData(), image.getWidth(), image.getHeight());
+        std::vector<double> stats;
+        if (artifacts.load(key, "basestats1", stats) && stats.size() == 2) return stats;
+
+        std::vector<uint8_t> pixels = image.getPixels();
+        stats = {ImageQualityMetrics::calculateEntropy(pixels),
+                 ImageQualityMetrics::calculateAdjacentCorrelation(pixels, image.getWidth(), image.getHeight())};
+        artifacts.store(key, "basestats1", stats);
+        return stats;
+    }
+
+    // То же для битовых плоскостей 1..6: "planestats1", пары (энтропия, корреляция)
+    std::vector<double> planeStatistics(GrayBMP& image) {
+        TRACE_SCOPE("stats.planes");
+        uint64_t key = ArtifactCache::key(image.getPixelData(), image.getWidth(), image.getHeight());
+        std::vector<double> stats;
+        if (artifacts.load(key, "planestats1", stats) && stats.size() == 12) return stats;
+
+        stats.clear();
+        for (int k = 1; k <= 6; k++) {
+            GrayBMP plane = image.extractBitPlane(k);
+            stats.push_back(ImageQualityMetrics::calculateEntropy(plane.getPixels()));
+            stats.push_back(ImageQualityMetrics::calculateAdjacentCorrelation(
+                plane.getPixels(), plane.getWidth(), plane.getHeight()));
         }
+        artifacts.store(key, "planestats1", stats);
+        return stats;
     }
-    
-    void visualizeForDataset(std::vector<GrayBMP>& images, const std::string& name, int count) {
+
+    void embedForDataset(const LazyDataset& images) {
+        TRACE_SCOPE("dataset.embed");
+        if (images.empty()) return;
+        auto image = images[0];
+        if (image) evaluateEmbeddingForImage(*image, images.name() + "_sample");
+    }
+
+    void histogramsForDataset(const LazyDataset& images) {
+        TRACE_SCOPE("dataset.histograms");
+        for (int i = 0; i < std::min(3, (int)images.size()); i++) {
+            auto image = images[i];
+            if (image) generateHistogramPair(*image, images.name() + "_" + std::to_string(i+1));
+        }
+    }
+
+    void visualizeForDataset(const LazyDataset& images, const std::string& name, int count) {
+        TRACE_SCOPE("dataset.visualize");
         int numToProcess = std::min(count, (int)images.size());
         for (int i = 0; i < numToProcess; i++) {
+            auto image = images[i];
+            if (!image) continue;
             for (int k = 1; k <= 8; k++) {
-                GrayBMP plane = images[i].extractBitPlane(k);
+                GrayBMP plane = image->extractBitPlane(k);
                 std::string planeFile = "visual\\plane_" + name + "_img" + std::to_string(i+1) + "_k" + std::to_string(k) + ".bmp";
                 plane.save(planeFile);
             }
         }
     }
     
-    void evaluateDatasetStructure(std::vector<GrayBMP>& images, const std::string& name) {
+    void evaluateDatasetStructure(const LazyDataset& images, const std::string& name) {
+        TRACE_SCOPE("dataset.structure");
         if (images.empty()) return;
         
         std::cout << "\n" << name << ":\n";
         
         for (int i = 0; i < std::min(5, (int)images.size()); i++) {
+            auto image = images[i];
+            if (!image) continue;
             std::cout << "  Изображение " << (i+1) << ":\n";
+            std::vector<double> planeStats = planeStatistics(*image);
             
             for (int k = 1; k <= 6; k++) {
-                GrayBMP plane = images[i].extractBitPlane(k);
-                double entropy = ImageQualityMetrics::calculateEntropy(plane.getPixels());
-                double correlation = ImageQualityMetrics::calculateAdjacentCorrelation(
-                    plane.getPixels(), plane.getWidth(), plane.getHeight());
+                double entropy = planeStats[2 * (k - 1)];
+                double correlation = planeStats[2 * (k - 1) + 1];
                 
                 std::cout << "    Плоскость " << k << ": Энтропия=" << std::fixed << std::setprecision(2) 
                          << entropy << ", Корреляция=" << std::setprecision(3) << correlation << "\n";
@@ -468,6 +641,7 @@ private:
     
     void evaluateEmbeddingForImage(GrayBMP& image, const std::string& baseName) {
         std::vector<uint8_t> originalPixels = image.getPixels();
+        std::vector<double> baseStats = baseStatistics(image);
         
         std::cout << "\n  Исходное изображение: " << fs::path(image.getFilename()).filename().string() << "\n";
         
@@ -498,10 +672,9 @@ private:
                 res.mse = mse;
                 res.psnr = psnr;
                 res.ssim = ssim;
-                res.entropyOriginal = ImageQualityMetrics::calculateEntropy(originalPixels);
+                res.entropyOriginal = baseStats[0];
                 res.entropyModified = ImageQualityMetrics::calculateEntropy(stego.getPixels());
-                res.correlationOriginal = ImageQualityMetrics::calculateAdjacentCorrelation(
-                    originalPixels, image.getWidth(), image.getHeight());
+                res.correlationOriginal = baseStats[1];
                 res.correlationModified = ImageQualityMetrics::calculateAdjacentCorrelation(
                     stego.getPixels(), stego.getWidth(), stego.getHeight());
                 
@@ -522,7 +695,8 @@ private:
         stego.saveHistogram(histStegoFile);
     }
     
-    void compareDataset(const std::vector<GrayBMP>& images, const std::string& name, int count) {
+    void compareDataset(const LazyDataset& images, const std::string& name, int count) {
+        TRACE_SCOPE("dataset.compare");
         if (images.empty()) return;
         
         std::cout << "\n--- Сравнение для набора " << name << " ---\n";
@@ -533,13 +707,15 @@ private:
         
         int numToProcess = std::min(count, (int)images.size());
         for (int i = 0; i < numToProcess; i++) {
-            std::vector<uint8_t> originalPixels = images[i].getPixels();
-            double origEntropy = ImageQualityMetrics::calculateEntropy(originalPixels);
-            double origCorr = ImageQualityMetrics::calculateAdjacentCorrelation(
-                originalPixels, images[i].getWidth(), images[i].getHeight());
+            auto image = images[i];
+            if (!image) continue;
+            std::vector<uint8_t> originalPixels = image->getPixels();
+            std::vector<double> baseStats = baseStatistics(*image);
+            double origEntropy = baseStats[0];
+            double origCorr = baseStats[1];
             
             for (int k = 1; k <= 3; k++) {
-                GrayBMP stego = images[i];
+                GrayBMP stego = *image;
                 std::string outputFile = "compare\\compare_" + name + "_img" + std::to_string(i+1) + "_k" + std::to_string(k) + ".bmp";
                 int bitsWritten = stego.embedMessage(messageFile, k, outputFile);
                 
@@ -627,11 +803,8 @@ int main(int argc, char* argv[]) {
         return -1;
     }
 
-    researcher.visualizeBitPlanes(5);
-    researcher.evaluateStructure();
-    researcher.embedAndEvaluate();
-    researcher.generateHistograms();
-    researcher.systematicComparison();
+    researcher.runByDataset(5);
 
+    TRACE_DUMP();
     return 0;
 }
\ No newline at end of file
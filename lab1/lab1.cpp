@@ -9,6 +9,15 @@
 #include <map>
 #include <iomanip>
 #include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <atomic>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "trace.h"
 
 namespace fs = std::filesystem;
 
@@ -43,6 +52,7 @@ private:
     bool isLoaded;
 
     bool readBMP(const std::string& filename) {
+        TRACE_SCOPE("bmp.read");
         std::ifstream file(filename, std::ios::binary);
         if (!file) return false;
 
@@ -79,6 +89,7 @@ private:
     }
 
     bool writeBMP(const std::string& filename) {
+        TRACE_SCOPE("bmp.write");
         if (!isLoaded) return false;
 
         std::ofstream file(filename, std::ios::binary);
@@ -152,6 +163,57 @@ public:
         return result;
     }
 
+    // Запись сообщения в плоскость k без проверок ёмкости и без сохранения
+    int embedBits(const std::vector<uint8_t>& messageData, int k) {
+        TRACE_SCOPE("plane.embed");
+        int bitPos = k - 1;
+        size_t pixelIdx = 0;
+        int bitsWritten = 0;
+
+        for (size_t byteIdx = 0; byteIdx < messageData.size(); byteIdx++) {
+            for (int b = 0; b < 8; b++) {
+                if (pixelIdx >= pixels.size()) break;
+                
+                int msgBit = (messageData[byteIdx] >> b) & 1;
+                pixels[pixelIdx] = (pixels[pixelIdx] & ~(1 << bitPos)) | (msgBit << bitPos);
+                
+                pixelIdx++;
+                bitsWritten++;
+            }
+        }
+        return bitsWritten;
+    }
+
+    std::vector<uint8_t> extractBits(int k, int messageBits, int& bitsExtracted) const {
+        TRACE_SCOPE("plane.extract");
+        int bitPos = k - 1;
+        std::vector<uint8_t> extractedData;
+
+        if (messageBits < 0) {
+            messageBits = pixels.size();
+        }
+
+        int bytesNeeded = (messageBits + 7) / 8;
+        extractedData.resize(bytesNeeded, 0);
+
+        size_t pixelIdx = 0;
+        bitsExtracted = 0;
+
+        for (int byteIdx = 0; byteIdx < bytesNeeded; byteIdx++) {
+            for (int b = 0; b < 8; b++) {
+                if (pixelIdx >= pixels.size() || bitsExtracted >= messageBits) break;
+                
+                int bit = (pixels[pixelIdx] >> bitPos) & 1;
+                extractedData[byteIdx] |= (bit << b);
+                
+                pixelIdx++;
+                bitsExtracted++;
+            }
+        }
+        extractedData.resize((bitsExtracted + 7) / 8);
+        return extractedData;
+    }
+
     int embedMessage(const std::string& messageFile, int k, const std::string& outputFile) {
         if (!isLoaded || k < 1 || k > 8) return -1;
 
@@ -184,21 +246,7 @@ public:
             return -1;
         }
 
-        int bitPos = k - 1;
-        size_t pixelIdx = 0;
-        int bitsWritten = 0;
-
-        for (size_t byteIdx = 0; byteIdx < messageData.size(); byteIdx++) {
-            for (int b = 0; b < 8; b++) {
-                if (pixelIdx >= pixels.size()) break;
-                
-                int msgBit = (messageData[byteIdx] >> b) & 1;
-                pixels[pixelIdx] = (pixels[pixelIdx] & ~(1 << bitPos)) | (msgBit << bitPos);
-                
-                pixelIdx++;
-                bitsWritten++;
-            }
-        }
+        int bitsWritten = embedBits(messageData, k);
 
         if (!writeBMP(outputFile)) {
             std::cerr << "Не удалось сохранить BMP файл: " << outputFile << std::endl;
@@ -211,30 +259,8 @@ public:
     bool extractMessage(int k, const std::string& outputFile, int messageBits = -1) {
         if (!isLoaded || k < 1 || k > 8) return false;
 
-        int bitPos = k - 1;
-        std::vector<uint8_t> extractedData;
-
-        if (messageBits < 0) {
-            messageBits = pixels.size();
-        }
-
-        int bytesNeeded = (messageBits + 7) / 8;
-        extractedData.resize(bytesNeeded, 0);
-
-        size_t pixelIdx = 0;
         int bitsExtracted = 0;
-
-        for (int byteIdx = 0; byteIdx < bytesNeeded; byteIdx++) {
-            for (int b = 0; b < 8; b++) {
-                if (pixelIdx >= pixels.size() || bitsExtracted >= messageBits) break;
-                
-                int bit = (pixels[pixelIdx] >> bitPos) & 1;
-                extractedData[byteIdx] |= (bit << b);
-                
-                pixelIdx++;
-                bitsExtracted++;
-            }
-        }
+        std::vector<uint8_t> extractedData = extractBits(k, messageBits, bitsExtracted);
 
         std::ofstream outFile(outputFile, std::ios::binary);
         if (!outFile) {
@@ -252,9 +278,292 @@ public:
     }
 };
 
+// Пакетный режим: lab1 <embed|extract|planes|metrics> [опции] файлы...
+// Каждое изображение загружается один раз, файлы обрабатываются параллельно,
+// результат по каждому - одна строка JSON в stdout по мере готовности.
+
+struct BatchInput {
+    std::string path;
+    std::string reference;   // только для metrics
+};
+
+struct BatchOptions {
+    std::string command;
+    std::vector<int> planes;
+    std::string messageFile;
+    int bits = -1;
+    std::string outDir = ".";
+    std::string reference;
+    unsigned threads = 0;
+    std::vector<BatchInput> inputs;
+};
+
+std::string jsonEscape(const std::string& text) {
+    std::string out;
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c < 0x20) {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+class JsonLine {
+private:
+    std::string text;
+    bool failed = false;
+
+    JsonLine& key(const std::string& name, const std::string& value) {
+        text += (text.empty() ? "{\"" : ",\"") + name + "\":" + value;
+        return *this;
+    }
+
+public:
+    JsonLine& add(const std::string& name, const std::string& value) { return key(name, "\"" + jsonEscape(value) + "\""); }
+    JsonLine& add(const std::string& name, const char* value) { return add(name, std::string(value)); }
+    JsonLine& add(const std::string& name, long long value) { return key(name, std::to_string(value)); }
+    JsonLine& add(const std::string& name, int value) { return add(name, static_cast<long long>(value)); }
+    JsonLine& add(const std::string& name, size_t value) { return add(name, static_cast<long long>(value)); }
+    JsonLine& add(const std::string& name, bool value) {
+        if (name == "ok") failed = !value;
+        return key(name, value ? "true" : "false");
+    }
+    JsonLine& add(const std::string& name, double value) {
+        if (!std::isfinite(value)) return key(name, "null");
+        std::ostringstream number;
+        number << std::setprecision(6) << value;
+        return key(name, number.str());
+    }
+
+    std::string str() const { return text.empty() ? "{}" : text + "}"; }
+    bool ok() const { return !failed; }
+};
+
+// Строка манифеста: путь к изображению и, для metrics, путь к эталону;
+// пустые строки и строки с # пропускаются
+bool readManifest(const std::string& filename, std::vector<BatchInput>& inputs) {
+    std::ifstream file(filename);
+    if (!file) return false;
+
+    std::string line;
+    while (std::getline(file, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        std::istringstream fields(line);
+        BatchInput input;
+        if (!(fields >> input.path) || input.path[0] == '#') continue;
+        fields >> input.reference;
+        inputs.push_back(input);
+    }
+    return true;
+}
+
+bool parsePlanes(const std::string& text, std::vector<int>& planes) {
+    std::istringstream list(text);
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        int k = std::atoi(item.c_str());
+        if (k < 1 || k > 8) return false;
+        planes.push_back(k);
+    }
+    return !planes.empty();
+}
+
+void printUsage() {
+    std::cerr << "usage: lab1 embed   -k K -m message [-o dir] [-j threads] [--manifest file] images...\n"
+              << "       lab1 extract -k K [-b bits] [-o dir] [-j threads] [--manifest file] images...\n"
+              << "       lab1 planes  [-k K[,K...]] [-o dir] [-j threads] [--manifest file] images...\n"
+              << "       lab1 metrics [-r reference] [-j threads] [--manifest file] images...\n";
+}
+
+bool parseBatchArgs(int argc, char* argv[], BatchOptions& opts) {
+    opts.command = argv[1];
+    if (opts.command != "embed" && opts.command != "extract" && opts.command != "planes" && opts.command != "metrics") {
+        return false;
+    }
+
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "-k" && hasValue) {
+            if (!parsePlanes(argv[++i], opts.planes)) return false;
+        } else if (arg == "-m" && hasValue) {
+            opts.messageFile = argv[++i];
+        } else if (arg == "-b" && hasValue) {
+            opts.bits = std::atoi(argv[++i]);
+        } else if (arg == "-o" && hasValue) {
+            opts.outDir = argv[++i];
+        } else if (arg == "-r" && hasValue) {
+            opts.reference = argv[++i];
+        } else if (arg == "-j" && hasValue) {
+            opts.threads = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--manifest" && hasValue) {
+            if (!readManifest(argv[++i], opts.inputs)) {
+                std::cerr << "Cannot read manifest " << argv[i] << "\n";
+                return false;
+            }
+        } else if (!arg.empty() && arg[0] == '-') {
+            return false;
+        } else {
+            opts.inputs.push_back({arg, ""});
+        }
+    }
+
+    if (opts.planes.empty()) {
+        if (opts.command == "planes") {
+            for (int k = 1; k <= 8; k++) opts.planes.push_back(k);
+        } else if (opts.command != "metrics") {
+            return false;
+        }
+    }
+    if (opts.command == "embed" && opts.messageFile.empty()) return false;
+    return !opts.inputs.empty();
+}
+
+double shannonEntropy(const GrayBMP& image) {
+    std::vector<long long> hist(256, 0);
+    const uint8_t* p = image.getPixelData();
+    for (int i = 0; i < image.getSize(); i++) hist[p[i]]++;
+
+    double entropy = 0.0;
+    for (long long count : hist) {
+        if (count == 0) continue;
+        double prob = static_cast<double>(count) / image.getSize();
+        entropy -= prob * std::log2(prob);
+    }
+    return entropy;
+}
+
+JsonLine processBatchInput(const BatchOptions& opts, const std::vector<uint8_t>& message,
+                           size_t index, const BatchInput& input) {
+    TRACE_SCOPE("batch.item");
+    JsonLine line;
+    line.add("index", index).add("file", input.path).add("command", opts.command);
+
+    GrayBMP image;
+    if (!image.load(input.path)) {
+        return line.add("ok", false).add("error", "cannot load 8-bit BMP");
+    }
+    std::string stem = fs::path(input.path).stem().string();
+
+    if (opts.command == "embed") {
+        int k = opts.planes[0];
+        if (static_cast<long long>(message.size()) * 8 > image.getSize()) {
+            return line.add("ok", false).add("error", "message too large").add("capacity_bits", image.getSize());
+        }
+        int bits = image.embedBits(message, k);
+        std::string outFile = opts.outDir + "/" + stem + "_k" + std::to_string(k) + ".bmp";
+        if (!image.save(outFile)) {
+            return line.add("ok", false).add("error", "cannot write output").add("output", outFile);
+        }
+        return line.add("ok", true).add("k", k).add("bits", bits).add("output", outFile);
+    }
+
+    if (opts.command == "extract") {
+        int k = opts.planes[0];
+        int bitsExtracted = 0;
+        std::vector<uint8_t> data = image.extractBits(k, opts.bits, bitsExtracted);
+        std::string outFile = opts.outDir + "/" + stem + "_k" + std::to_string(k) + ".txt";
+        std::ofstream out(outFile, std::ios::binary);
+        if (!out || !out.write(reinterpret_cast<const char*>(data.data()), data.size())) {
+            return line.add("ok", false).add("error", "cannot write output").add("output", outFile);
+        }
+        return line.add("ok", true).add("k", k).add("bits", bitsExtracted).add("bytes", data.size())
+            .add("output", outFile);
+    }
+
+    if (opts.command == "planes") {
+        for (int k : opts.planes) {
+            std::string outFile = opts.outDir + "/" + stem + "_plane" + std::to_string(k) + ".bmp";
+            if (!image.extractBitPlane(k).save(outFile)) {
+                return line.add("ok", false).add("error", "cannot write output").add("output", outFile);
+            }
+        }
+        return line.add("ok", true).add("planes", opts.planes.size()).add("output_dir", opts.outDir);
+    }
+
+    line.add("width", image.getWidth()).add("height", image.getHeight())
+        .add("capacity_bits", image.getSize()).add("entropy", shannonEntropy(image));
+
+    std::string referencePath = input.reference.empty() ? opts.reference : input.reference;
+    if (!referencePath.empty()) {
+        GrayBMP reference;
+        if (!reference.load(referencePath) || reference.getWidth() != image.getWidth() ||
+            reference.getHeight() != image.getHeight()) {
+            return line.add("ok", false).add("error", "reference missing or size mismatch")
+                .add("reference", referencePath);
+        }
+        const uint8_t* a = image.getPixelData();
+        const uint8_t* b = reference.getPixelData();
+        double sum = 0.0;
+        long long changed = 0;
+        for (int i = 0; i < image.getSize(); i++) {
+            int d = static_cast<int>(a[i]) - b[i];
+            sum += d * d;
+            changed += d != 0;
+        }
+        double mse = sum / image.getSize();
+        double psnr = mse == 0.0 ? INFINITY : 10.0 * std::log10(255.0 * 255.0 / mse);
+        line.add("reference", referencePath).add("mse", mse).add("psnr", psnr).add("changed_pixels", changed);
+    }
+    return line.add("ok", true);
+}
+
+int runBatch(const BatchOptions& opts) {
+    std::vector<uint8_t> message;
+    if (opts.command == "embed") {
+        std::ifstream msgFile(opts.messageFile, std::ios::binary);
+        message.assign(std::istreambuf_iterator<char>(msgFile), std::istreambuf_iterator<char>());
+        if (!msgFile || message.empty()) {
+            std::cerr << "Cannot read message " << opts.messageFile << "\n";
+            return 2;
+        }
+    }
+    if (opts.command != "metrics") fs::create_directories(opts.outDir);
+
+    unsigned threads = opts.threads ? opts.threads : std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min<unsigned>(threads, static_cast<unsigned>(opts.inputs.size()));
+
+    std::atomic<size_t> next(0);
+    std::atomic<int> failed(0);
+    std::mutex outputMutex;
+    auto worker = [&]() {
+        for (size_t i = next++; i < opts.inputs.size(); i = next++) {
+            JsonLine line = processBatchInput(opts, message, i, opts.inputs[i]);
+            if (!line.ok()) failed++;
+            std::lock_guard<std::mutex> lock(outputMutex);
+            std::cout << line.str() << "\n" << std::flush;
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; t++) pool.emplace_back(worker);
+    worker();
+    for (auto& t : pool) t.join();
+
+    return failed > 0 ? 1 : 0;
+}
+
 int main(int argc, char* argv[]) {
     setlocale(LC_ALL, "");
 
+    if (argc > 1) {
+        BatchOptions opts;
+        if (!parseBatchArgs(argc, argv, opts)) {
+            printUsage();
+            return 2;
+        }
+        int status = runBatch(opts);
+        TRACE_DUMP();
+        return status;
+    }
+
     GrayBMP image;
     std::string command;
     while(true)
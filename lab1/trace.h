@@ -0,0 +1,373 @@
+#pragma once
+
+// Трассировка этапов: TRACE_SCOPE("hs.embed") засекает время до конца блока.
+// Включается флагом компиляции -DSTEGO_TRACE, без него макросы пустые и
+// ничего не стоят.
+//
+// Каждый поток пишет события в свой кольцевой буфер (TRACE_RING_EVENTS
+// последних событий) без блокировок; там же копится сводка по этапам, так
+// что она точная, даже если кольцо переполнилось. TRACE_DUMP() в конце main
+// пишет Chrome trace_event JSON (chrome://tracing, ui.perfetto.dev) в файл
+// из STEGO_TRACE_FILE (по умолчанию trace.json) и печатает таблицу этапов
+// в stderr (stdout остаётся за программой, например JSON lines в lab1).
+// Время в таблице включающее: вложенные этапы входят во время внешних.
+//
+// Имена этапов - строковые литералы, сравниваются по указателю.
+//
+// TRACE_SCOPE_BYTES("hs.embed", n) дополнительно учитывает n байт данных,
+// прошедших через этап. С -DSTEGO_PERF (только Linux, включает STEGO_TRACE)
+// каждый поток открывает группу perf_event_open: такты, инструкции, промахи
+// LLC и ошибки предсказания переходов, и этапы копят их приращения. Рядом со
+// сводкой печатается IPC, промахи на 1000 инструкций и байт за такт: низкий
+// IPC при высоком LLC MPKI - этап упирается в память, высокий IPC - в
+// вычисления. Если счётчики недоступны (perf_event_paranoid, виртуальная
+// машина без PMU), трассировка работает как обычно, а в сводке пишется
+// причина. Счётчики считают только поток самого этапа: этап, ждущий рабочие
+// потоки, их работу не включает. Чтение счётчиков - системный вызов на
+// границе каждого этапа, поэтому STEGO_PERF годится для крупных этапов, а
+// не для внутренних циклов.
+
+#if defined(STEGO_PERF) && !defined(STEGO_TRACE)
+#define STEGO_TRACE
+#endif
+
+#ifdef STEGO_TRACE
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined(STEGO_PERF) && defined(__linux__)
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifndef TRACE_RING_EVENTS
+#define TRACE_RING_EVENTS 65536
+#endif
+
+namespace trace {
+
+inline uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Event {
+    const char* name;
+    uint64_t start;
+    uint64_t duration;
+};
+
+enum Counter { CYCLES, INSTRUCTIONS, LLC_MISSES, BRANCH_MISSES, COUNTERS };
+
+struct Stage {
+    const char* name = nullptr;
+    uint64_t count = 0;
+    uint64_t total = 0;
+    uint64_t min = UINT64_MAX;
+    uint64_t max = 0;
+    uint64_t bytes = 0;
+    uint64_t counters[COUNTERS] = {};
+};
+
+// Счётчики текущего потока. Такты - лидер группы: без них группа не
+// открывается, остальные счётчики необязательны (в ВМ часто нет LLC).
+class PerfGroup {
+private:
+#if defined(STEGO_PERF) && defined(__linux__)
+    int fds[COUNTERS] = {-1, -1, -1, -1};
+    int slot[COUNTERS] = {-1, -1, -1, -1};  // позиция значения в ответе read()
+    int opened = 0;
+
+    static int openCounter(uint32_t type, uint64_t config, int group) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group, 0));
+    }
+#endif
+
+public:
+    bool active = false;
+    bool available[COUNTERS] = {};
+    std::string error;
+
+    PerfGroup() {
+#if defined(STEGO_PERF) && defined(__linux__)
+        const uint64_t configs[COUNTERS] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                            PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+        for (int c = 0; c < COUNTERS; ++c) {
+            int fd = openCounter(PERF_TYPE_HARDWARE, configs[c], c == CYCLES ? -1 : fds[CYCLES]);
+            if (fd < 0) {
+                if (c == CYCLES) {
+                    error = std::strerror(errno);
+                    return;
+                }
+                continue;
+            }
+            fds[c] = fd;
+            slot[c] = opened++;
+            available[c] = true;
+        }
+        active = true;
+#elif defined(STEGO_PERF)
+        error = "perf_event_open is Linux only";
+#endif
+    }
+
+    ~PerfGroup() {
+#if defined(STEGO_PERF) && defined(__linux__)
+        for (int fd : fds)
+            if (fd >= 0) close(fd);
+#endif
+    }
+
+    PerfGroup(const PerfGroup&) = delete;
+    PerfGroup& operator=(const PerfGroup&) = delete;
+
+    // Значения с поправкой на мультиплексирование; при ошибке - нули
+    void read(uint64_t values[COUNTERS]) const {
+        for (int c = 0; c < COUNTERS; ++c) values[c] = 0;
+#if defined(STEGO_PERF) && defined(__linux__)
+        if (!active) return;
+        uint64_t data[3 + COUNTERS];
+        if (::read(fds[CYCLES], data, sizeof(data)) < static_cast<ssize_t>((3 + opened) * sizeof(uint64_t))) return;
+        double scale = data[2] > 0 && data[2] < data[1] ? static_cast<double>(data[1]) / data[2] : 1.0;
+        for (int c = 0; c < COUNTERS; ++c)
+            if (slot[c] >= 0) values[c] = static_cast<uint64_t>(data[3 + slot[c]] * scale);
+#endif
+    }
+};
+
+// Буфер одного потока; после завершения потока остаётся в реестре до дампа
+struct ThreadBuffer {
+    static const int STAGES = 128;
+
+    int tid;
+    uint64_t written = 0;
+    std::vector<Event> ring;
+    Stage stages[STAGES];
+    PerfGroup perf;
+
+    explicit ThreadBuffer(int id) : tid(id), ring(TRACE_RING_EVENTS) {}
+
+    void record(const char* name, uint64_t start, uint64_t duration, uint64_t bytes, const uint64_t* counters) {
+        ring[written % ring.size()] = {name, start, duration};
+        written++;
+
+        // Открытая адресация по указателю имени
+        size_t slot = (reinterpret_cast<uintptr_t>(name) >> 3) % STAGES;
+        for (int probe = 0; probe < STAGES; ++probe, slot = (slot + 1) % STAGES) {
+            Stage& s = stages[slot];
+            if (s.name != name && s.name != nullptr) continue;
+            s.name = name;
+            s.count++;
+            s.total += duration;
+            s.min = std::min(s.min, duration);
+            s.max = std::max(s.max, duration);
+            s.bytes += bytes;
+            for (int c = 0; c < COUNTERS; ++c) s.counters[c] += counters[c];
+            return;
+        }
+    }
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    uint64_t origin = nowNs();
+
+    static Registry& instance() {
+        static Registry registry;
+        return registry;
+    }
+
+    std::shared_ptr<ThreadBuffer> add() {
+        std::lock_guard<std::mutex> lock(mutex);
+        buffers.push_back(std::make_shared<ThreadBuffer>(static_cast<int>(buffers.size()) + 1));
+        return buffers.back();
+    }
+};
+
+inline ThreadBuffer& local() {
+    thread_local std::shared_ptr<ThreadBuffer> buffer = Registry::instance().add();
+    return *buffer;
+}
+
+class Scope {
+private:
+    ThreadBuffer& buffer;
+    const char* name;
+    uint64_t bytes;
+    uint64_t counters[COUNTERS];
+    uint64_t start;
+
+public:
+    explicit Scope(const char* stageName, uint64_t stageBytes = 0)
+        : buffer(local()), name(stageName), bytes(stageBytes) {
+        buffer.perf.read(counters);
+        start = nowNs();
+    }
+
+    ~Scope() {
+        uint64_t duration = nowNs() - start;
+        uint64_t end[COUNTERS];
+        buffer.perf.read(end);
+        for (int c = 0; c < COUNTERS; ++c) end[c] = end[c] >= counters[c] ? end[c] - counters[c] : 0;
+        buffer.record(name, start, duration, bytes, end);
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+};
+
+inline void writeJson(const Registry& registry, const std::string& path) {
+    FILE* out = std::fopen(path.c_str(), "w");
+    if (!out) {
+        std::cerr << "Cannot write trace " << path << "\n";
+        return;
+    }
+    std::fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    for (const auto& buffer : registry.buffers) {
+        std::fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                     first ? "" : ",\n", buffer->tid, ("thread " + std::to_string(buffer->tid)).c_str());
+        first = false;
+        uint64_t size = buffer->ring.size();
+        uint64_t begin = buffer->written > size ? buffer->written - size : 0;
+        for (uint64_t i = begin; i < buffer->written; ++i) {
+            const Event& e = buffer->ring[i % size];
+            uint64_t start = e.start > registry.origin ? e.start - registry.origin : 0;
+            std::fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                         e.name, buffer->tid, start / 1000.0, e.duration / 1000.0);
+        }
+    }
+    std::fprintf(out, "\n]}\n");
+    std::fclose(out);
+}
+
+inline void printCounters(const Registry& registry, const std::vector<Stage>& stages, std::ostream& out) {
+    bool available[COUNTERS] = {};
+    int active = 0;
+    std::string error;
+    for (const auto& buffer : registry.buffers) {
+        if (!buffer->perf.active) {
+            if (error.empty()) error = buffer->perf.error;
+            continue;
+        }
+        active++;
+        for (int c = 0; c < COUNTERS; ++c) available[c] = available[c] || buffer->perf.available[c];
+    }
+    if (!active) {
+        out << "\nHardware counters unavailable: " << (error.empty() ? "no threads traced" : error) << "\n";
+        return;
+    }
+
+    // Значение или n/a, если счётчик не открылся
+    auto cell = [&](bool ok, double value, int width, int precision) {
+        if (ok) out << std::setw(width) << std::setprecision(precision) << value;
+        else out << std::setw(width) << "n/a";
+    };
+    out << "\n===== Hardware counters (" << active << " of " << registry.buffers.size()
+        << " threads, user mode) =====\n";
+    out << std::left << std::setw(28) << "Stage" << std::right << std::setw(12) << "Cycles, M" << std::setw(12)
+        << "Instr, M" << std::setw(8) << "IPC" << std::setw(12) << "LLC MPKI" << std::setw(12) << "Br MPKI"
+        << std::setw(12) << "Bytes/cyc" << "\n";
+    for (const Stage& s : stages) {
+        double cycles = static_cast<double>(s.counters[CYCLES]);
+        double kinstr = s.counters[INSTRUCTIONS] / 1000.0;
+        out << std::left << std::setw(28) << s.name << std::right << std::fixed;
+        cell(true, cycles / 1e6, 12, 2);
+        cell(available[INSTRUCTIONS], s.counters[INSTRUCTIONS] / 1e6, 12, 2);
+        cell(available[INSTRUCTIONS] && cycles > 0, s.counters[INSTRUCTIONS] / cycles, 8, 2);
+        cell(available[LLC_MISSES] && kinstr > 0, s.counters[LLC_MISSES] / kinstr, 12, 3);
+        cell(available[BRANCH_MISSES] && kinstr > 0, s.counters[BRANCH_MISSES] / kinstr, 12, 3);
+        if (s.bytes && cycles > 0) out << std::setw(12) << std::setprecision(3) << s.bytes / cycles;
+        else out << std::setw(12) << "-";
+        out << "\n";
+    }
+}
+
+inline void printSummary(const Registry& registry, std::ostream& out) {
+    std::map<std::string, Stage> merged;
+    uint64_t dropped = 0;
+    for (const auto& buffer : registry.buffers) {
+        if (buffer->written > buffer->ring.size()) dropped += buffer->written - buffer->ring.size();
+        for (const Stage& s : buffer->stages) {
+            if (!s.name) continue;
+            Stage& m = merged[s.name];
+            m.name = s.name;
+            m.count += s.count;
+            m.total += s.total;
+            m.min = std::min(m.min, s.min);
+            m.max = std::max(m.max, s.max);
+            m.bytes += s.bytes;
+            for (int c = 0; c < COUNTERS; ++c) m.counters[c] += s.counters[c];
+        }
+    }
+    std::vector<Stage> stages;
+    for (const auto& item : merged) stages.push_back(item.second);
+    std::sort(stages.begin(), stages.end(), [](const Stage& a, const Stage& b) { return a.total > b.total; });
+
+    double wall = (nowNs() - registry.origin) / 1e6;
+    out << "\n===== Trace summary (wall " << std::fixed << std::setprecision(1) << wall << " ms, "
+        << registry.buffers.size() << " threads) =====\n";
+    out << std::left << std::setw(28) << "Stage" << std::right << std::setw(10) << "Calls" << std::setw(12)
+        << "Total, ms" << std::setw(12) << "Avg, us" << std::setw(12) << "Min, us" << std::setw(12) << "Max, us"
+        << std::setw(9) << "% wall" << "\n";
+    for (const Stage& s : stages) {
+        out << std::left << std::setw(28) << s.name << std::right << std::setw(10) << s.count << std::setprecision(2)
+            << std::setw(12) << s.total / 1e6 << std::setw(12) << s.total / 1e3 / s.count << std::setw(12)
+            << s.min / 1e3 << std::setw(12) << s.max / 1e3 << std::setprecision(1) << std::setw(9)
+            << (wall > 0 ? 100.0 * s.total / 1e6 / wall : 0.0) << "\n";
+    }
+    if (dropped) out << "(" << dropped << " oldest events dropped from the JSON, summary is complete)\n";
+#ifdef STEGO_PERF
+    printCounters(registry, stages, out);
+#endif
+}
+
+// Вызывать, когда рабочие потоки уже остановлены
+inline void dump() {
+    Registry& registry = Registry::instance();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    const char* env = std::getenv("STEGO_TRACE_FILE");
+    std::string path = env && *env ? env : "trace.json";
+    writeJson(registry, path);
+    printSummary(registry, std::cerr);
+    std::cerr << "Trace written to " << path << "\n";
+}
+
+}  // namespace trace
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) trace::Scope TRACE_CONCAT(traceScope_, __LINE__)(name)
+#define TRACE_SCOPE_BYTES(name, bytes) trace::Scope TRACE_CONCAT(traceScope_, __LINE__)(name, bytes)
+#define TRACE_DUMP() trace::dump()
+
+#else
+
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_SCOPE_BYTES(name, bytes) ((void)0)
+#define TRACE_DUMP() ((void)0)
+
+#endif
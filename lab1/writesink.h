@@ -0,0 +1,402 @@
+#pragma once
+
+// Отложенная запись выходных файлов (стего, восстановленные, извлечённые).
+//
+// Вызывающий не пишет файл сам: write() выдаёт буфер нужного размера, в
+// который файл формируется целиком (например, GrayBMP::encode), и ставит его
+// в очередь. На Linux очередь - io_uring через прямые системные вызовы:
+// буферы пула зарегистрированы в ядре (IORING_OP_WRITE_FIXED), заявки
+// отправляются пачками. Если io_uring недоступен (старое ядро, seccomp,
+// Windows), те же буферы отдаются пулу потоков с обычной записью. На этот же
+// путь очередь переходит, если io_uring отказал посреди работы.
+//
+// Буферов в пуле depth штук, поэтому в памяти одновременно не больше depth
+// файлов: write() ждёт, пока освободится буфер. Файл больше slotSize пишется
+// из отдельного буфера в куче, но тоже занимает место в пуле.
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "trace.h"
+
+#ifdef __linux__
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+// linux/fs.h (его тянет io_uring.h) определяет BLOCK_SIZE, а в лабораторных
+// это имя констант в классах встраивания
+#undef BLOCK_SIZE
+#endif
+
+class WriteSink {
+private:
+    struct Request {
+        std::string path;
+        uint8_t* data = nullptr;
+        size_t size = 0;
+        size_t done = 0;
+        std::vector<uint8_t> heap;
+        int fd = -1;
+    };
+
+    size_t slotSize;
+    std::vector<uint8_t> arena;
+    std::vector<Request> requests;
+    std::vector<int> freeSlots;
+    size_t inFlight = 0;      // буферы, выданные write() и ещё не записанные
+    size_t ringPending = 0;   // из них отправлены в io_uring
+    size_t failures = 0;
+
+    std::mutex mutex;
+    std::condition_variable slotFreed;
+
+    // Запасной путь: пул потоков
+    std::deque<int> work;
+    std::condition_variable workReady;
+    std::vector<std::thread> threads;
+    unsigned fallbackThreads;
+    bool stopping = false;
+
+#ifdef __linux__
+    int ring = -1;
+    bool registered = false;
+    unsigned batch;
+    unsigned unsubmitted = 0;
+    bool ringFailed = false;   // новые заявки идут в пул, ring только дорабатывает
+    void* sqRing = MAP_FAILED;
+    void* cqRing = MAP_FAILED;
+    size_t sqRingSize = 0, cqRingSize = 0;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqesSize = 0;
+    unsigned *sqTail = nullptr, *sqMask = nullptr, *sqArray = nullptr;
+    unsigned *cqHead = nullptr, *cqTail = nullptr, *cqMask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+
+    bool setupRing(unsigned depth) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        ring = static_cast<int>(syscall(__NR_io_uring_setup, depth, &params));
+        if (ring < 0) return false;
+
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP) sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+
+        sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED) return false;
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            cqRing = sqRing;
+        } else {
+            cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+            if (cqRing == MAP_FAILED) return false;
+        }
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(
+            mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES));
+        if (sqes == MAP_FAILED) return false;
+
+        uint8_t* sq = static_cast<uint8_t*>(sqRing);
+        uint8_t* cq = static_cast<uint8_t*>(cqRing);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        // На ядрах 5.1-5.5 io_uring есть, а IORING_OP_WRITE и PROBE нет
+        std::vector<uint8_t> probe(sizeof(io_uring_probe) + (IORING_OP_WRITE + 1) * sizeof(io_uring_probe_op), 0);
+        io_uring_probe* ops = reinterpret_cast<io_uring_probe*>(probe.data());
+        if (syscall(__NR_io_uring_register, ring, IORING_REGISTER_PROBE, ops, IORING_OP_WRITE + 1) != 0 ||
+            ops->last_op < IORING_OP_WRITE || !(ops->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED)) {
+            return false;
+        }
+
+        // Регистрация может не пройти из-за RLIMIT_MEMLOCK - тогда обычный WRITE
+        std::vector<iovec> iov(requests.size());
+        for (size_t i = 0; i < iov.size(); ++i) {
+            iov[i].iov_base = arena.data() + i * slotSize;
+            iov[i].iov_len = slotSize;
+        }
+        registered = syscall(__NR_io_uring_register, ring, IORING_REGISTER_BUFFERS, iov.data(),
+                             static_cast<unsigned>(iov.size())) == 0;
+        return true;
+    }
+
+    void teardownRing() {
+        if (sqes != MAP_FAILED) munmap(sqes, sqesSize);
+        if (cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingSize);
+        if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+        if (ring >= 0) ::close(ring);
+        sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+        sqRing = cqRing = MAP_FAILED;
+        ring = -1;
+    }
+
+    // Заявок в работе не больше, чем буферов, а очередь SQ не меньше пула,
+    // так что место в SQ есть всегда
+    void queueWrite(int slot) {
+        Request& r = requests[slot];
+        unsigned tail = *sqTail;
+        unsigned index = tail & *sqMask;
+        io_uring_sqe& sqe = sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        bool fixed = registered && r.heap.empty();
+        sqe.opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        sqe.fd = r.fd;
+        sqe.addr = reinterpret_cast<uint64_t>(r.data + r.done);
+        sqe.len = static_cast<uint32_t>(r.size - r.done);
+        sqe.off = r.done;
+        if (fixed) sqe.buf_index = static_cast<uint16_t>(slot);
+        sqe.user_data = static_cast<uint64_t>(slot);
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        ++unsubmitted;
+    }
+
+    // Отправляет накопленные заявки и разбирает завершения; wait - ждать хотя бы одно
+    void reap(bool wait) {
+        if (unsubmitted > 0 || wait) {
+            unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+            int ret;
+            do {
+                ret = static_cast<int>(syscall(__NR_io_uring_enter, ring, unsubmitted, wait ? 1 : 0, flags, nullptr, 0));
+            } while (ret < 0 && errno == EINTR);
+            if (ret < 0) return abandonRing();
+            unsubmitted -= std::min<unsigned>(unsubmitted, static_cast<unsigned>(ret));
+        }
+
+        unsigned head = *cqHead;
+        while (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+            const io_uring_cqe& cqe = cqes[head & *cqMask];
+            int slot = static_cast<int>(cqe.user_data);
+            Request& r = requests[slot];
+            if (cqe.res > 0) r.done += static_cast<size_t>(cqe.res);
+            ++head;
+
+            if (cqe.res > 0 && r.done < r.size) {
+                queueWrite(slot);
+                continue;
+            }
+            ::close(r.fd);
+            r.fd = -1;
+            --ringPending;
+            if (cqe.res == -EINVAL && r.done == 0) {
+                // Операция не поддерживается: файл целиком перепишет пул
+                ringFailed = true;
+                startFallback();
+                work.push_back(slot);
+                workReady.notify_one();
+                continue;
+            }
+            if (cqe.res <= 0 && r.size > 0) {
+                std::cerr << "Error: Cannot write file " << r.path << std::endl;
+                ++failures;
+            }
+            release(slot);
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        if (ringFailed && ringPending == 0) teardownRing();
+    }
+
+    // io_uring_enter отказал не из-за сигнала: заявки в ring считаются
+    // несостоявшимися, дальше пишет пул потоков
+    void abandonRing() {
+        for (size_t slot = 0; slot < requests.size(); ++slot) {
+            Request& r = requests[slot];
+            if (r.fd < 0) continue;
+            std::cerr << "Error: Cannot write file " << r.path << std::endl;
+            ::close(r.fd);
+            r.fd = -1;
+            ++failures;
+            release(static_cast<int>(slot));
+        }
+        ringPending = 0;
+        unsubmitted = 0;
+        teardownRing();
+        startFallback();
+    }
+#endif
+
+    void startFallback() {
+        if (!threads.empty()) return;
+        for (unsigned t = 0; t < std::max(1u, fallbackThreads); ++t) threads.emplace_back([this]() { workerLoop(); });
+    }
+
+    bool usingRing() const {
+#ifdef __linux__
+        return ring >= 0 && !ringFailed;
+#else
+        return false;
+#endif
+    }
+
+    void release(int slot) {
+        requests[slot].heap.clear();
+        requests[slot].heap.shrink_to_fit();
+        freeSlots.push_back(slot);
+        --inFlight;
+        slotFreed.notify_all();
+    }
+
+    void workerLoop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            workReady.wait(lock, [&]() { return stopping || !work.empty(); });
+            if (work.empty()) return;
+            int slot = work.front();
+            work.pop_front();
+            Request& r = requests[slot];
+            lock.unlock();
+
+            std::ofstream file(r.path, std::ios::binary);
+            bool ok = file && file.write(reinterpret_cast<const char*>(r.data), r.size);
+            file.close();
+
+            lock.lock();
+            if (!ok) {
+                std::cerr << "Error: Cannot write file " << r.path << std::endl;
+                ++failures;
+            }
+            release(slot);
+        }
+    }
+
+    int acquire() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (freeSlots.empty()) {
+#ifdef __linux__
+            if (ringPending > 0) {
+                reap(true);
+                continue;
+            }
+#endif
+            slotFreed.wait(lock);
+        }
+        int slot = freeSlots.back();
+        freeSlots.pop_back();
+        ++inFlight;
+        return slot;
+    }
+
+    bool submit(int slot) {
+        std::lock_guard<std::mutex> lock(mutex);
+#ifdef __linux__
+        if (usingRing()) {
+            Request& r = requests[slot];
+            r.fd = ::open(r.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (r.fd < 0) {
+                std::cerr << "Error: Cannot create file " << r.path << std::endl;
+                ++failures;
+                release(slot);
+                return false;
+            }
+            if (r.size == 0) {
+                ::close(r.fd);
+                r.fd = -1;
+                release(slot);
+                return true;
+            }
+            queueWrite(slot);
+            ++ringPending;
+            slotFreed.notify_all();
+            if (unsubmitted >= batch) reap(false);
+            return true;
+        }
+#endif
+        work.push_back(slot);
+        workReady.notify_one();
+        return true;
+    }
+
+public:
+    explicit WriteSink(unsigned depth = 16, size_t slotBytes = 1 << 20, unsigned fallbackThreads = 2)
+        : slotSize(slotBytes), arena(depth * slotBytes), requests(depth), fallbackThreads(fallbackThreads) {
+        for (int i = static_cast<int>(depth) - 1; i >= 0; --i) freeSlots.push_back(i);
+#ifdef __linux__
+        batch = std::max(1u, depth / 4);
+        if (setupRing(depth)) return;
+        teardownRing();
+#endif
+        startFallback();
+    }
+
+    WriteSink(const WriteSink&) = delete;
+    WriteSink& operator=(const WriteSink&) = delete;
+
+    ~WriteSink() {
+        flush();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        workReady.notify_all();
+        for (auto& t : threads) t.join();
+#ifdef __linux__
+        teardownRing();
+#endif
+    }
+
+    bool usesIoUring() const { return usingRing(); }
+#ifdef __linux__
+    bool usesRegisteredBuffers() const { return usingRing() && registered; }
+#else
+    bool usesRegisteredBuffers() const { return false; }
+#endif
+
+    // fill(uint8_t* dst) записывает ровно size байт файла в dst
+    template <typename Fill>
+    bool write(const std::string& path, size_t size, Fill fill) {
+        TRACE_SCOPE("sink.write");
+        int slot = acquire();
+        Request& r = requests[slot];
+        r.path = path;
+        r.size = size;
+        r.done = 0;
+        if (size <= slotSize) {
+            r.data = arena.data() + slot * slotSize;
+        } else {
+            r.heap.resize(size);
+            r.data = r.heap.data();
+        }
+        fill(r.data);
+        return submit(slot);
+    }
+
+    bool write(const std::string& path, const void* data, size_t size) {
+        return write(path, size, [&](uint8_t* dst) { if (size > 0) std::memcpy(dst, data, size); });
+    }
+
+    // Дожидается записи всего, что поставлено в очередь; false, если с
+    // прошлого flush() хотя бы один файл не записался
+    bool flush() {
+        TRACE_SCOPE("sink.flush");
+        std::unique_lock<std::mutex> lock(mutex);
+        while (inFlight > 0) {
+#ifdef __linux__
+            if (ringPending > 0) {
+                reap(true);
+                continue;
+            }
+#endif
+            slotFreed.wait(lock);
+        }
+        bool ok = failures == 0;
+        failures = 0;
+        return ok;
+    }
+};
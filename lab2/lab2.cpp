@@ -10,6 +10,29 @@
 #include <iomanip>
 #include <cstring>
 #include <bitset>
+#include <array>
+#include <map>
+#include <functional>
+#include <chrono>
+#include <thread>
+#include <atomic>
+
+#ifdef __linux__
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "../lab1/artifactcache.h"
+#include "../lab1/boundedqueue.h"
+#include "../lab1/datapack.h"
+#include "../lab1/writesink.h"
+#include "../lab1/trace.h"
 
 namespace fs = std::filesystem;
 
@@ -39,10 +62,40 @@ private:
     BMPHeader header;
     std::vector<uint8_t> palette;
     std::vector<uint8_t> pixels;
+    // Вид: отсчёты в чужом буфере (отображённый архив, память демона)
+    // вместо pixels, буфер должен жить дольше GrayBMP. Запись в вид только
+    // для чтения через data() сначала копирует отсчёты к себе.
+    uint8_t* external = nullptr;
+    bool externalReadOnly = false;
     int width, height;
     bool loaded;
 
+    static BMPHeader grayHeader(int w, int h) {
+        int rowSize = (w * 8 + 31) / 32 * 4;
+        BMPHeader header;
+        std::memset(&header, 0, sizeof(header));
+        header.bfType = 0x4D42;
+        header.bfOffBits = sizeof(header) + 1024;
+        header.bfSize = header.bfOffBits + rowSize * h;
+        header.biSize = 40;
+        header.biWidth = w;
+        header.biHeight = h;
+        header.biPlanes = 1;
+        header.biBitCount = 8;
+        header.biSizeImage = rowSize * h;
+        header.biClrUsed = 256;
+        return header;
+    }
+
+    static void grayPalette(uint8_t* out) {
+        for (int i = 0; i < 256; ++i) {
+            out[i * 4 + 0] = out[i * 4 + 1] = out[i * 4 + 2] = static_cast<uint8_t>(i);
+            out[i * 4 + 3] = 0;
+        }
+    }
+
     bool readBMP(const std::string& filename) {
+        TRACE_SCOPE("bmp.read");
         std::ifstream file(filename, std::ios::binary);
         if (!file) return false;
 
@@ -52,6 +105,7 @@ private:
 
         width = header.biWidth;
         height = std::abs(header.biHeight);
+        external = nullptr;
 
         palette.resize(1024);
         file.seekg(sizeof(header), std::ios::beg);
@@ -76,28 +130,15 @@ private:
     }
 
     bool writeBMP(const std::string& filename) {
+        TRACE_SCOPE("bmp.write");
         if (!loaded) return false;
 
-        int rowSize = (width * 8 + 31) / 32 * 4;
-        int dataSize = rowSize * height;
-        std::vector<uint8_t> rawData(dataSize, 0);
-
-        for (int y = 0; y < height; ++y) {
-            int dstY = (header.biHeight > 0) ? (height - 1 - y) : y;
-            for (int x = 0; x < width; ++x) {
-                rawData[dstY * rowSize + x] = pixels[y * width + x];
-            }
-        }
-
-        header.bfOffBits = sizeof(header) + 1024;
-        header.bfSize = header.bfOffBits + dataSize;
-        header.biSizeImage = dataSize;
+        std::vector<uint8_t> encoded(encodedSize());
+        encode(encoded.data());
 
         std::ofstream file(filename, std::ios::binary);
         if (!file) return false;
-        file.write(reinterpret_cast<char*>(&header), sizeof(header));
-        file.write(reinterpret_cast<char*>(palette.data()), 1024);
-        file.write(reinterpret_cast<char*>(rawData.data()), dataSize);
+        file.write(reinterpret_cast<char*>(encoded.data()), encoded.size());
         file.close();
         return true;
     }
@@ -108,15 +149,83 @@ public:
     bool load(const std::string& filename) { return readBMP(filename); }
     bool save(const std::string& filename) { return writeBMP(filename); }
 
+    size_t encodedSize() const {
+        int rowSize = (width * 8 + 31) / 32 * 4;
+        return sizeof(BMPHeader) + 1024 + static_cast<size_t>(rowSize) * height;
+    }
+
+    // Файл BMP целиком в out (encodedSize() байт), без промежуточных копий
+    void encode(uint8_t* out) const {
+        int rowSize = (width * 8 + 31) / 32 * 4;
+        int dataSize = rowSize * height;
+
+        BMPHeader h = header;
+        h.bfOffBits = sizeof(h) + 1024;
+        h.bfSize = h.bfOffBits + dataSize;
+        h.biSizeImage = dataSize;
+        std::memcpy(out, &h, sizeof(h));
+        if (palette.empty()) grayPalette(out + sizeof(h));
+        else std::memcpy(out + sizeof(h), palette.data(), 1024);
+
+        const uint8_t* src = data();
+        uint8_t* rawData = out + h.bfOffBits;
+        for (int y = 0; y < height; ++y) {
+            int dstY = (header.biHeight > 0) ? (height - 1 - y) : y;
+            std::memcpy(rawData + dstY * rowSize, src + y * width, width);
+            std::memset(rawData + dstY * rowSize + width, 0, rowSize - width);
+        }
+    }
+
     int getWidth() const { return width; }
     int getHeight() const { return height; }
     int getSize() const { return width * height; }
 
-    uint8_t* data() { return pixels.data(); }
-    const uint8_t* data() const { return pixels.data(); }
+    uint8_t* data() {
+        if (external && externalReadOnly) {
+            pixels.assign(external, external + getSize());
+            external = nullptr;
+        }
+        return external ? external : pixels.data();
+    }
+    const uint8_t* data() const { return external ? external : pixels.data(); }
+
+    std::vector<uint8_t> getPixels() const { return std::vector<uint8_t>(data(), data() + getSize()); }
+    void setPixels(const std::vector<uint8_t>& newPixels) {
+        external = nullptr;
+        pixels = newPixels;
+    }
+
+    // Изображение из готовых отсчётов (сверху вниз), со стандартной серой палитрой
+    bool fromPixels(int w, int h, const uint8_t* src) {
+        header = grayHeader(w, h);
+        palette.resize(1024);
+        grayPalette(palette.data());
+        width = w;
+        height = h;
+        external = nullptr;
+        pixels.assign(src, src + static_cast<size_t>(w) * h);
+        loaded = true;
+        return true;
+    }
 
-    std::vector<uint8_t> getPixels() const { return pixels; }
-    void setPixels(const std::vector<uint8_t>& newPixels) { pixels = newPixels; }
+    // Вид без копирования и без палитры (при сохранении пишется серая)
+    static GrayBMP view(const uint8_t* src, int w, int h) {
+        GrayBMP img;
+        img.header = grayHeader(w, h);
+        img.external = const_cast<uint8_t*>(src);
+        img.externalReadOnly = true;
+        img.width = w;
+        img.height = h;
+        img.loaded = true;
+        return img;
+    }
+
+    // Вид, в который пишут на месте: copyFrom и встраивание меняют dst
+    static GrayBMP mutableView(uint8_t* dst, int w, int h) {
+        GrayBMP img = view(dst, w, h);
+        img.externalReadOnly = false;
+        return img;
+    }
 
     GrayBMP clone() const {
         GrayBMP copy;
@@ -124,17 +233,31 @@ public:
         copy.palette = this->palette;
         copy.width = this->width;
         copy.height = this->height;
-        copy.pixels = this->pixels;
+        copy.pixels = getPixels();
         copy.loaded = this->loaded;
         return copy;
     }
 
-    GrayBMP extractBitPlane(int k) {
+    // Как *this = src.clone(), но записываемый вид того же размера остаётся
+    // видом: отсчёты копируются в его буфер
+    void copyFrom(const GrayBMP& src) {
+        if (external && !externalReadOnly && width == src.width && height == src.height) {
+            header = src.header;
+            palette = src.palette;
+            std::memcpy(external, src.data(), getSize());
+            loaded = src.loaded;
+            return;
+        }
+        *this = src.clone();
+    }
+
+
+    GrayBMP extractBitPlane(int k) const {
         GrayBMP result;
         if (!loaded || k < 1 || k > 8) return result;
 
         result.header = this->header;
-        result.palette = this->palette;
+        result.palette.resize(1024);
         result.width = this->width;
         result.height = this->height;
         result.loaded = true;
@@ -148,9 +271,10 @@ public:
         }
 
         result.pixels.resize(width * height);
+        const uint8_t* src = data();
         int bitPos = k - 1;
-        for (size_t i = 0; i < pixels.size(); i++) {
-            int bit = (pixels[i] >> bitPos) & 1;
+        for (size_t i = 0; i < result.pixels.size(); i++) {
+            int bit = (src[i] >> bitPos) & 1;
             result.pixels[i] = bit ? 255 : 0;
         }
 
@@ -158,9 +282,18 @@ public:
     }
 };
 
+// Извлечённые биты ЦВЗ как изображение 0/255; bits - width * height отсчётов
+bool watermarkImage(const std::vector<uint8_t>& bits, int width, int height, GrayBMP& image) {
+    if (bits.size() != static_cast<size_t>(width * height)) return false;
+    std::vector<uint8_t> pixels(bits.size());
+    for (size_t i = 0; i < bits.size(); ++i) pixels[i] = bits[i] ? 255 : 0;
+    return image.fromPixels(width, height, pixels.data());
+}
+
 class Metrics {
 public:
     static double MSE(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b) {
+        TRACE_SCOPE_BYTES("metrics.mse", 2 * a.size());
         if (a.size() != b.size()) return -1.0;
         double sum = 0.0;
         for (size_t i = 0; i < a.size(); ++i) {
@@ -217,14 +350,21 @@ private:
     static constexpr int BLOCK_SIZE = 2;
     std::mt19937 rng;
     
-    std::vector<int> getBlockOrder(int totalBlocks, const std::string& key) {
+    // Перестановка зависит только от числа блоков и ключа - считаем один раз
+    std::map<std::pair<int, std::string>, std::vector<int>> blockOrders;
+
+    const std::vector<int>& getBlockOrder(int totalBlocks, const std::string& key) {
+        auto cached = blockOrders.find({totalBlocks, key});
+        if (cached != blockOrders.end()) return cached->second;
+        if (blockOrders.size() >= 64) blockOrders.clear();
+
         std::vector<int> indices(totalBlocks);
         for (int i = 0; i < totalBlocks; ++i) indices[i] = i;
         
         std::seed_seq seed(key.begin(), key.end());
         rng.seed(seed);
         std::shuffle(indices.begin(), indices.end(), rng);
-        return indices;
+        return blockOrders[{totalBlocks, key}] = std::move(indices);
     }
     
     uint8_t embedBitInBlock(const std::vector<uint8_t>& block, int bit) {
@@ -257,6 +397,7 @@ public:
     std::string name() const override { return "BlockLSB"; }
 
     bool embed(GrayBMP& container, const Watermark& wm, const std::string& key, GrayBMP& stego) override {
+        TRACE_SCOPE_BYTES("lsb.embed", container.getWidth() * container.getHeight());
         int w = container.getWidth();
         int h = container.getHeight();
         int wmBits = wm.totalBits();
@@ -270,11 +411,11 @@ public:
             return false;
         }
 
-        stego = container.clone();
+        stego.copyFrom(container);
         uint8_t* pixels = stego.data();
         const auto& wmBitsVec = wm.getBits();
         
-        std::vector<int> blockOrder = getBlockOrder(totalBlocks, key);
+        const std::vector<int>& blockOrder = getBlockOrder(totalBlocks, key);
 
         for (int i = 0; i < wmBits; ++i) {
             int blockIdx = blockOrder[i];
@@ -298,6 +439,7 @@ public:
     }
 
     bool extract(const GrayBMP& stego, const std::string& key, int bitsTotal, std::vector<uint8_t>& extractedBits) override {
+        TRACE_SCOPE_BYTES("lsb.extract", stego.getWidth() * stego.getHeight());
         int w = stego.getWidth();
         int h = stego.getHeight();
         
@@ -310,7 +452,7 @@ public:
         const uint8_t* pixels = stego.data();
         extractedBits.resize(bitsTotal);
         
-        std::vector<int> blockOrder = getBlockOrder(totalBlocks, key);
+        const std::vector<int>& blockOrder = getBlockOrder(totalBlocks, key);
 
         for (int i = 0; i < bitsTotal; ++i) {
             int blockIdx = blockOrder[i];
@@ -335,59 +477,8 @@ public:
     bool createWatermarkImage(const std::vector<uint8_t>& bits, 
                               int width, int height, 
                               const std::string& filename) override {
-        
-        if (bits.size() != static_cast<size_t>(width * height)) {
-            return false;
-        }
-        
-        int rowSize = (width * 8 + 31) / 32 * 4;
-        int dataSize = rowSize * height;
-        
-        BMPHeader header;
-        std::memset(&header, 0, sizeof(header));
-        
-        header.bfType = 0x4D42;
-        header.bfOffBits = sizeof(header) + 1024;
-        header.bfSize = header.bfOffBits + dataSize;
-        header.biSize = 40;
-        header.biWidth = width;
-        header.biHeight = height;
-        header.biPlanes = 1;
-        header.biBitCount = 8;
-        header.biSizeImage = dataSize;
-        header.biClrUsed = 256;
-        
-        std::ofstream file(filename, std::ios::binary);
-        if (!file) return false;
-        
-        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
-        
-        for (int i = 0; i < 256; ++i) {
-            uint8_t paletteEntry[4] = {
-                static_cast<uint8_t>(i),
-                static_cast<uint8_t>(i),
-                static_cast<uint8_t>(i),
-                0
-            };
-            file.write(reinterpret_cast<const char*>(paletteEntry), 4);
-        }
-        
-        std::vector<uint8_t> rawData(dataSize, 0);
-        
-        for (int y = 0; y < height; ++y) {
-            for (int x = 0; x < width; ++x) {
-                int pixelIndex = y * width + x;
-                uint8_t value = bits[pixelIndex] ? 255 : 0;
-                
-                int dstY = (header.biHeight > 0) ? (height - 1 - y) : y;
-                rawData[dstY * rowSize + x] = value;
-            }
-        }
-        
-        file.write(reinterpret_cast<const char*>(rawData.data()), dataSize);
-        file.close();
-        
-        return true;
+        GrayBMP image;
+        return watermarkImage(bits, width, height, image) && image.save(filename);
     }
 };
 
@@ -414,6 +505,39 @@ private:
         
         return count > 0 ? totalGradient / count : 0.0;
     }
+
+    ArtifactCache* cache = nullptr;
+
+    // Номера блоков по убыванию среднего градиента. Зависят только от
+    // пикселей, поэтому берутся из кэша артефактов: "grad4v1", int32 на блок
+    std::vector<int32_t> blockOrder(const GrayBMP& img) {
+        TRACE_SCOPE("adaptive.blockorder");
+        uint64_t key = 0;
+        std::vector<int32_t> order;
+        if (cache) {
+            key = ArtifactCache::key(img.data(), img.getWidth(), img.getHeight());
+            if (cache->load(key, "grad4v1", order)) return order;
+        }
+
+        int blocksX = img.getWidth() / BLOCK_SIZE;
+        int blocksY = img.getHeight() / BLOCK_SIZE;
+        std::vector<std::pair<double, int>> blockGradients;
+        for (int by = 0; by < blocksY; ++by) {
+            for (int bx = 0; bx < blocksX; ++bx) {
+                int blockIdx = by * blocksX + bx;
+                double gradient = computeBlockGradient(img, bx * BLOCK_SIZE, by * BLOCK_SIZE);
+                blockGradients.push_back({gradient, blockIdx});
+            }
+        }
+
+        std::sort(blockGradients.begin(), blockGradients.end(),
+                  [](const auto& a, const auto& b) { return a.first > b.first; });
+
+        order.resize(blockGradients.size());
+        for (size_t i = 0; i < blockGradients.size(); ++i) order[i] = blockGradients[i].second;
+        if (cache) cache->store(key, "grad4v1", order);
+        return order;
+    }
     
     uint8_t embedBitInBlock(const std::vector<uint8_t>& block, int bit) {
         int sum = 0;
@@ -444,7 +568,10 @@ private:
 public:
     std::string name() const override { return "BlockAdaptive"; }
 
+    void setCache(ArtifactCache* artifactCache) { cache = artifactCache; }
+
     bool embed(GrayBMP& container, const Watermark& wm, const std::string& key, GrayBMP& stego) override {
+        TRACE_SCOPE_BYTES("adaptive.embed", container.getWidth() * container.getHeight());
         int w = container.getWidth();
         int h = container.getHeight();
         int wmBits = wm.totalBits();
@@ -458,24 +585,14 @@ public:
             return false;
         }
 
-        stego = container.clone();
+        stego.copyFrom(container);
         uint8_t* pixels = stego.data();
         const auto& wmBitsVec = wm.getBits();
         
-        std::vector<std::pair<double, int>> blockGradients;
-        for (int by = 0; by < blocksY; ++by) {
-            for (int bx = 0; bx < blocksX; ++bx) {
-                int blockIdx = by * blocksX + bx;
-                double gradient = computeBlockGradient(container, bx * BLOCK_SIZE, by * BLOCK_SIZE);
-                blockGradients.push_back({gradient, blockIdx});
-            }
-        }
-        
-        std::sort(blockGradients.begin(), blockGradients.end(),
-                  [](const auto& a, const auto& b) { return a.first > b.first; });
+        std::vector<int32_t> order = blockOrder(container);
 
         for (int i = 0; i < wmBits; ++i) {
-            int blockIdx = blockGradients[i].second;
+            int blockIdx = order[i];
             int blockX = (blockIdx % blocksX) * BLOCK_SIZE;
             int blockY = (blockIdx / blocksX) * BLOCK_SIZE;
             
@@ -496,6 +613,7 @@ public:
     }
 
     bool extract(const GrayBMP& stego, const std::string& key, int bitsTotal, std::vector<uint8_t>& extractedBits) override {
+        TRACE_SCOPE_BYTES("adaptive.extract", stego.getWidth() * stego.getHeight());
         int w = stego.getWidth();
         int h = stego.getHeight();
         
@@ -508,20 +626,10 @@ public:
         const uint8_t* pixels = stego.data();
         extractedBits.resize(bitsTotal);
         
-        std::vector<std::pair<double, int>> blockGradients;
-        for (int by = 0; by < blocksY; ++by) {
-            for (int bx = 0; bx < blocksX; ++bx) {
-                int blockIdx = by * blocksX + bx;
-                double gradient = computeBlockGradient(stego, bx * BLOCK_SIZE, by * BLOCK_SIZE);
-                blockGradients.push_back({gradient, blockIdx});
-            }
-        }
-        
-        std::sort(blockGradients.begin(), blockGradients.end(),
-                  [](const auto& a, const auto& b) { return a.first > b.first; });
+        std::vector<int32_t> order = blockOrder(stego);
 
         for (int i = 0; i < bitsTotal; ++i) {
-            int blockIdx = blockGradients[i].second;
+            int blockIdx = order[i];
             int blockX = (blockIdx % blocksX) * BLOCK_SIZE;
             int blockY = (blockIdx / blocksX) * BLOCK_SIZE;
             
@@ -542,67 +650,411 @@ public:
 
     bool createWatermarkImage(const std::vector<uint8_t>& extractedBits, int width, int height, const std::string& filename) override
     {
-        
-        if (extractedBits.size() != static_cast<size_t>(width * height)) {
+        GrayBMP image;
+        if (!watermarkImage(extractedBits, width, height, image)) {
             std::cerr << "Error: size bits" << std::endl;
             return false;
         }
-        
-        int rowSize = (width * 8 + 31) / 32 * 4;
-        int dataSize = rowSize * height;
-        
-        BMPHeader header;
-        std::memset(&header, 0, sizeof(header));
-        
-        header.bfType = 0x4D42;
-        header.bfOffBits = sizeof(header) + 1024;
-        header.bfSize = header.bfOffBits + dataSize;
-        header.biSize = 40;
-        header.biWidth = width;
-        header.biHeight = height;
-        header.biPlanes = 1;
-        header.biBitCount = 8;
-        header.biSizeImage = dataSize;
-        header.biClrUsed = 256;
-        
-        std::ofstream file(filename, std::ios::binary);
-        if (!file) {
+        if (!image.save(filename)) {
             std::cerr << "Error: open file" << filename << std::endl;
             return false;
         }
-        
-        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
-        
-        for (int i = 0; i < 256; ++i) {
-            uint8_t paletteEntry[4] = {
-                static_cast<uint8_t>(i),  
-                static_cast<uint8_t>(i),  
-                static_cast<uint8_t>(i),  
-                0                          
-            };
-            file.write(reinterpret_cast<const char*>(paletteEntry), 4);
+        return true;
+    }
+};
+
+// Целочисленное 8x8 DCT по схеме Loeffler-Ligtenberg-Moschytz, как
+// jfdctint.c / jidctint.c в libjpeg (CONST_BITS = 13, PASS1_BITS = 2).
+// Блоки обрабатываются по LANES штук: элемент k блока l лежит в data[k][l],
+// и каждая операция бабочки - цикл по l, который компилятор векторизует.
+class FixedDCT8 {
+public:
+    static constexpr int LANES = 8;
+    using Lanes = int32_t[LANES];
+
+private:
+    static constexpr int CONST_BITS = 13;
+    static constexpr int PASS1_BITS = 2;
+    static constexpr int32_t FIX_0_298631336 = 2446;
+    static constexpr int32_t FIX_0_390180644 = 3196;
+    static constexpr int32_t FIX_0_541196100 = 4433;
+    static constexpr int32_t FIX_0_765366865 = 6270;
+    static constexpr int32_t FIX_0_899976223 = 7373;
+    static constexpr int32_t FIX_1_175875602 = 9633;
+    static constexpr int32_t FIX_1_501321110 = 12299;
+    static constexpr int32_t FIX_1_847759065 = 15137;
+    static constexpr int32_t FIX_1_961570560 = 16069;
+    static constexpr int32_t FIX_2_053119869 = 16819;
+    static constexpr int32_t FIX_2_562915447 = 20995;
+    static constexpr int32_t FIX_3_072711026 = 25172;
+
+    static int32_t descale(int32_t x, int n) { return (x + (1 << (n - 1))) >> n; }
+
+    // Одномерное прямое преобразование 8 точек v[0..7] (шаг stride в data)
+    static void forward1D(Lanes* data, int start, int stride, bool firstPass) {
+        Lanes* v[8];
+        for (int k = 0; k < 8; ++k) v[k] = &data[start + k * stride];
+        const int shift = firstPass ? CONST_BITS - PASS1_BITS : CONST_BITS + PASS1_BITS;
+
+        for (int l = 0; l < LANES; ++l) {
+            int32_t tmp0 = (*v[0])[l] + (*v[7])[l], tmp7 = (*v[0])[l] - (*v[7])[l];
+            int32_t tmp1 = (*v[1])[l] + (*v[6])[l], tmp6 = (*v[1])[l] - (*v[6])[l];
+            int32_t tmp2 = (*v[2])[l] + (*v[5])[l], tmp5 = (*v[2])[l] - (*v[5])[l];
+            int32_t tmp3 = (*v[3])[l] + (*v[4])[l], tmp4 = (*v[3])[l] - (*v[4])[l];
+
+            int32_t tmp10 = tmp0 + tmp3, tmp13 = tmp0 - tmp3;
+            int32_t tmp11 = tmp1 + tmp2, tmp12 = tmp1 - tmp2;
+
+            int32_t out0, out4;
+            if (firstPass) {
+                out0 = (tmp10 + tmp11) << PASS1_BITS;
+                out4 = (tmp10 - tmp11) << PASS1_BITS;
+            } else {
+                out0 = descale(tmp10 + tmp11, PASS1_BITS);
+                out4 = descale(tmp10 - tmp11, PASS1_BITS);
+            }
+            int32_t z1 = (tmp12 + tmp13) * FIX_0_541196100;
+            int32_t out2 = descale(z1 + tmp13 * FIX_0_765366865, shift);
+            int32_t out6 = descale(z1 - tmp12 * FIX_1_847759065, shift);
+
+            z1 = tmp4 + tmp7;
+            int32_t z2 = tmp5 + tmp6, z3 = tmp4 + tmp6, z4 = tmp5 + tmp7;
+            int32_t z5 = (z3 + z4) * FIX_1_175875602;
+            tmp4 *= FIX_0_298631336;
+            tmp5 *= FIX_2_053119869;
+            tmp6 *= FIX_3_072711026;
+            tmp7 *= FIX_1_501321110;
+            z1 *= -FIX_0_899976223;
+            z2 *= -FIX_2_562915447;
+            z3 = z3 * -FIX_1_961570560 + z5;
+            z4 = z4 * -FIX_0_390180644 + z5;
+
+            (*v[0])[l] = out0;
+            (*v[4])[l] = out4;
+            (*v[2])[l] = out2;
+            (*v[6])[l] = out6;
+            (*v[7])[l] = descale(tmp4 + z1 + z3, shift);
+            (*v[5])[l] = descale(tmp5 + z2 + z4, shift);
+            (*v[3])[l] = descale(tmp6 + z2 + z3, shift);
+            (*v[1])[l] = descale(tmp7 + z1 + z4, shift);
         }
-        
-        std::vector<uint8_t> rawData(dataSize, 0);
-        
-        for (int y = 0; y < height; ++y) {
-            for (int x = 0; x < width; ++x) {
-                int pixelIndex = y * width + x;
-                uint8_t value = extractedBits[pixelIndex] ? 255 : 0;
-                
-                int dstY = (header.biHeight > 0) ? (height - 1 - y) : y;
-                rawData[dstY * rowSize + x] = value;
+    }
+
+    static void inverse1D(Lanes* data, int start, int stride, int shift) {
+        Lanes* v[8];
+        for (int k = 0; k < 8; ++k) v[k] = &data[start + k * stride];
+
+        for (int l = 0; l < LANES; ++l) {
+            int32_t z2 = (*v[2])[l], z3 = (*v[6])[l];
+            int32_t z1 = (z2 + z3) * FIX_0_541196100;
+            int32_t tmp2 = z1 - z3 * FIX_1_847759065;
+            int32_t tmp3 = z1 + z2 * FIX_0_765366865;
+
+            int32_t tmp0 = ((*v[0])[l] + (*v[4])[l]) * (1 << CONST_BITS);
+            int32_t tmp1 = ((*v[0])[l] - (*v[4])[l]) * (1 << CONST_BITS);
+
+            int32_t tmp10 = tmp0 + tmp3, tmp13 = tmp0 - tmp3;
+            int32_t tmp11 = tmp1 + tmp2, tmp12 = tmp1 - tmp2;
+
+            tmp0 = (*v[7])[l];
+            tmp1 = (*v[5])[l];
+            tmp2 = (*v[3])[l];
+            tmp3 = (*v[1])[l];
+            z1 = tmp0 + tmp3;
+            z2 = tmp1 + tmp2;
+            z3 = tmp0 + tmp2;
+            int32_t z4 = tmp1 + tmp3;
+            int32_t z5 = (z3 + z4) * FIX_1_175875602;
+            tmp0 *= FIX_0_298631336;
+            tmp1 *= FIX_2_053119869;
+            tmp2 *= FIX_3_072711026;
+            tmp3 *= FIX_1_501321110;
+            z1 *= -FIX_0_899976223;
+            z2 *= -FIX_2_562915447;
+            z3 = z3 * -FIX_1_961570560 + z5;
+            z4 = z4 * -FIX_0_390180644 + z5;
+            tmp0 += z1 + z3;
+            tmp1 += z2 + z4;
+            tmp2 += z2 + z3;
+            tmp3 += z1 + z4;
+
+            (*v[0])[l] = descale(tmp10 + tmp3, shift);
+            (*v[7])[l] = descale(tmp10 - tmp3, shift);
+            (*v[1])[l] = descale(tmp11 + tmp2, shift);
+            (*v[6])[l] = descale(tmp11 - tmp2, shift);
+            (*v[2])[l] = descale(tmp12 + tmp1, shift);
+            (*v[5])[l] = descale(tmp12 - tmp1, shift);
+            (*v[3])[l] = descale(tmp13 + tmp0, shift);
+            (*v[4])[l] = descale(tmp13 - tmp0, shift);
+        }
+    }
+
+public:
+    // Вход - отсчёты минус 128, выход - 8 * ортонормированные коэффициенты
+    static void forward(Lanes* data) {
+        for (int r = 0; r < 8; ++r) forward1D(data, r * 8, 1, true);
+        for (int c = 0; c < 8; ++c) forward1D(data, c, 8, false);
+    }
+
+    // Обратное к forward: вход в тех же единицах (8 * коэффициент), выход -
+    // отсчёты без сдвига на 128. Лишние 3 бита по сравнению с jidctint
+    // снимают множитель 8.
+    static void inverse(Lanes* data) {
+        for (int c = 0; c < 8; ++c) inverse1D(data, c, 8, CONST_BITS - PASS1_BITS);
+        for (int r = 0; r < 8; ++r) inverse1D(data, r * 8, 1, CONST_BITS + PASS1_BITS + 3 + 3);
+    }
+};
+
+// Встраивание в коэффициенты 8x8 DCT квантованием с модуляцией индекса (QIM):
+// коэффициент сдвигается к ближайшему кратному шага, чётность индекса которого
+// равна биту. Блоки перемешиваются ключом, как в BlockLSBEmbedder; если бит
+// больше, чем блоков, каждый блок несёт несколько среднечастотных
+// коэффициентов. Обратное преобразование применяется только к разности
+// коэффициентов изменённых блоков и прибавляется к пикселям.
+class BlockDCTEmbedder : public Embedder {
+private:
+    static constexpr int BLOCK_SIZE = 8;
+    static constexpr int LANES = FixedDCT8::LANES;
+    static constexpr int SLOTS = 5;
+    static constexpr int slotPos[SLOTS] = {2 * 8 + 1, 1 * 8 + 2, 2 * 8 + 2, 3 * 8 + 1, 1 * 8 + 3};
+
+    std::mt19937 rng;
+    double step;
+
+    // Перестановка зависит только от числа блоков и ключа - считаем один раз
+    std::map<std::pair<int, std::string>, std::vector<int>> blockOrders;
+
+    const std::vector<int>& getBlockOrder(int totalBlocks, const std::string& key) {
+        auto cached = blockOrders.find({totalBlocks, key});
+        if (cached != blockOrders.end()) return cached->second;
+        if (blockOrders.size() >= 64) blockOrders.clear();
+
+        std::vector<int> indices(totalBlocks);
+        for (int i = 0; i < totalBlocks; ++i) indices[i] = i;
+
+        std::seed_seq seed(key.begin(), key.end());
+        rng.seed(seed);
+        std::shuffle(indices.begin(), indices.end(), rng);
+        return blockOrders[{totalBlocks, key}] = std::move(indices);
+    }
+
+    static void loadBlocks(const uint8_t* pixels, int w, int blocksX, const int* blocks, int count,
+                           FixedDCT8::Lanes* data) {
+        for (int l = 0; l < LANES; ++l) {
+            int blockIdx = blocks[std::min(l, count - 1)];
+            int blockX = (blockIdx % blocksX) * BLOCK_SIZE;
+            int blockY = (blockIdx / blocksX) * BLOCK_SIZE;
+            for (int by = 0; by < BLOCK_SIZE; ++by) {
+                for (int bx = 0; bx < BLOCK_SIZE; ++bx) {
+                    data[by * 8 + bx][l] = pixels[(blockY + by) * w + blockX + bx] - 128;
+                }
             }
         }
-        
-        file.write(reinterpret_cast<const char*>(rawData.data()), dataSize);
-        
-        file.close();
-        
+    }
+
+    long quantIndex(int32_t coeff) const { return std::lround(coeff / (8.0 * step)); }
+
+    static int bitsPerBlock(int bits, int totalBlocks) { return (bits + totalBlocks - 1) / totalBlocks; }
+
+public:
+    explicit BlockDCTEmbedder(double qimStep = 24.0) : step(qimStep) {}
+
+    std::string name() const override { return "BlockDCT"; }
+
+    bool embed(GrayBMP& container, const Watermark& wm, const std::string& key, GrayBMP& stego) override {
+        TRACE_SCOPE_BYTES("dct.embed", container.getWidth() * container.getHeight());
+        int w = container.getWidth();
+        int h = container.getHeight();
+        int wmBits = wm.totalBits();
+
+        int blocksX = w / BLOCK_SIZE;
+        int blocksY = h / BLOCK_SIZE;
+        int totalBlocks = blocksX * blocksY;
+
+        if (totalBlocks == 0 || wmBits > totalBlocks * SLOTS) {
+            std::cerr << "Watermark too large! Need " << wmBits << " coefficients, have "
+                      << totalBlocks * SLOTS << "\n";
+            return false;
+        }
+
+        stego.copyFrom(container);
+        uint8_t* pixels = stego.data();
+        const auto& wmBitsVec = wm.getBits();
+
+        const std::vector<int>& blockOrder = getBlockOrder(totalBlocks, key);
+        int perBlock = bitsPerBlock(wmBits, totalBlocks);
+        int usedBlocks = (wmBits + perBlock - 1) / perBlock;
+
+        FixedDCT8::Lanes data[64], delta[64];
+        for (int g = 0; g < usedBlocks; g += LANES) {
+            int count = std::min(LANES, usedBlocks - g);
+            loadBlocks(pixels, w, blocksX, &blockOrder[g], count, data);
+            FixedDCT8::forward(data);
+
+            std::memset(delta, 0, sizeof(delta));
+            bool modified[LANES] = {false};
+            for (int l = 0; l < count; ++l) {
+                for (int s = 0; s < perBlock; ++s) {
+                    int bitIdx = (g + l) * perBlock + s;
+                    if (bitIdx >= wmBits) break;
+                    int32_t coeff = data[slotPos[s]][l];
+                    double q = coeff / (8.0 * step);
+                    long m = std::lround(q);
+                    if ((m & 1) != wmBitsVec[bitIdx]) m += (q > m) ? 1 : -1;
+                    int32_t target = static_cast<int32_t>(std::lround(m * 8.0 * step));
+                    delta[slotPos[s]][l] = target - coeff;
+                    if (target != coeff) modified[l] = true;
+                }
+            }
+
+            FixedDCT8::inverse(delta);
+            for (int l = 0; l < count; ++l) {
+                if (!modified[l]) continue;
+                int blockIdx = blockOrder[g + l];
+                int blockX = (blockIdx % blocksX) * BLOCK_SIZE;
+                int blockY = (blockIdx / blocksX) * BLOCK_SIZE;
+                for (int by = 0; by < BLOCK_SIZE; ++by) {
+                    uint8_t* row = pixels + (blockY + by) * w + blockX;
+                    for (int bx = 0; bx < BLOCK_SIZE; ++bx) {
+                        int v = row[bx] + delta[by * 8 + bx][l];
+                        row[bx] = static_cast<uint8_t>(std::min(255, std::max(0, v)));
+                    }
+                }
+            }
+        }
+
+        return true;
+    }
+
+    bool extract(const GrayBMP& stego, const std::string& key, int bitsTotal, std::vector<uint8_t>& extractedBits) override {
+        TRACE_SCOPE_BYTES("dct.extract", stego.getWidth() * stego.getHeight());
+        int w = stego.getWidth();
+        int h = stego.getHeight();
+
+        int blocksX = w / BLOCK_SIZE;
+        int blocksY = h / BLOCK_SIZE;
+        int totalBlocks = blocksX * blocksY;
+
+        if (totalBlocks == 0 || bitsTotal > totalBlocks * SLOTS) return false;
+
+        const uint8_t* pixels = stego.data();
+        extractedBits.resize(bitsTotal);
+
+        const std::vector<int>& blockOrder = getBlockOrder(totalBlocks, key);
+        int perBlock = bitsPerBlock(bitsTotal, totalBlocks);
+        int usedBlocks = (bitsTotal + perBlock - 1) / perBlock;
+
+        FixedDCT8::Lanes data[64];
+        for (int g = 0; g < usedBlocks; g += LANES) {
+            int count = std::min(LANES, usedBlocks - g);
+            loadBlocks(pixels, w, blocksX, &blockOrder[g], count, data);
+            FixedDCT8::forward(data);
+            for (int l = 0; l < count; ++l) {
+                for (int s = 0; s < perBlock; ++s) {
+                    int bitIdx = (g + l) * perBlock + s;
+                    if (bitIdx >= bitsTotal) break;
+                    extractedBits[bitIdx] = static_cast<uint8_t>(quantIndex(data[slotPos[s]][l]) & 1);
+                }
+            }
+        }
+
+        return true;
+    }
+
+    bool createWatermarkImage(const std::vector<uint8_t>& bits, int width, int height, const std::string& filename) override {
+        GrayBMP image;
+        return watermarkImage(bits, width, height, image) && image.save(filename);
+    }
+};
+
+// Набор изображений: папка с BMP или архив .pack из lab1/datapack. Для
+// архива изображения берутся из отображённого в память файла без открытия
+// отдельных файлов.
+class DatasetSource {
+private:
+    ImagePack pack;
+    bool packed = false;
+    std::vector<fs::path> files;
+
+public:
+    explicit DatasetSource(const std::string& path) {
+        if (fs::path(path).extension() == ".pack") {
+            packed = pack.open(path);
+            if (!packed) std::cerr << "Cannot open pack " << path << "\n";
+            return;
+        }
+        for (const auto& entry : fs::directory_iterator(path)) {
+            if (entry.path().extension() == ".bmp") files.push_back(entry.path());
+        }
+    }
+
+    size_t size() const { return packed ? pack.size() : files.size(); }
+
+    fs::path path(size_t i) const { return packed ? fs::path(pack.name(static_cast<uint32_t>(i))) : files[i]; }
+
+    bool load(size_t i, GrayBMP& img) const {
+        TRACE_SCOPE("load");
+        if (!packed) return img.load(files[i].string());
+        const PackEntry& e = pack.entry(static_cast<uint32_t>(i));
+        img = GrayBMP::view(pack.pixels(static_cast<uint32_t>(i)), e.width, e.height);
         return true;
     }
 };
 
+// Загрузка наперёд для прохода по первым limit изображениям набора: LOADERS
+// потоков читают их в очередь на AHEAD штук, next() отдаёт по порядку
+// индексов. Встраивание остаётся в вызывающем потоке, так что общий
+// встраиватель не нужно делать потокобезопасным.
+class DatasetPrefetcher {
+private:
+    struct Item {
+        size_t index = 0;
+        bool ok = false;
+        GrayBMP image;
+    };
+
+    static const int LOADERS = 2;
+    static const size_t AHEAD = 4;
+
+    BoundedQueue<Item> queue{AHEAD};
+    std::map<size_t, Item> pending;
+    std::atomic<size_t> nextLoad{0};
+    std::vector<std::thread> loaders;
+
+public:
+    DatasetPrefetcher(const DatasetSource& dataset, size_t limit) {
+        for (int t = 0; t < LOADERS; ++t) {
+            loaders.emplace_back([this, &dataset, limit]() {
+                for (size_t i = nextLoad++; i < limit; i = nextLoad++) {
+                    Item item;
+                    item.index = i;
+                    item.ok = dataset.load(i, item.image);
+                    if (!queue.push(std::move(item))) break;
+                }
+            });
+        }
+    }
+
+    ~DatasetPrefetcher() {
+        queue.close();
+        for (auto& th : loaders) th.join();
+    }
+
+    // Изображения запрашиваются по возрастанию i < limit
+    bool next(size_t i, GrayBMP& image) {
+        while (pending.find(i) == pending.end()) {
+            Item item;
+            if (!queue.pop(item)) return false;
+            pending[item.index] = std::move(item);
+        }
+        auto it = pending.find(i);
+        bool ok = it->second.ok;
+        image = std::move(it->second.image);
+        pending.erase(it);
+        return ok;
+    }
+};
+
 bool verifyWatermark(const std::vector<uint8_t>& extracted, const Watermark& wm) {
     const auto& original = wm.getBits();
     if (extracted.size() != original.size()) return false;
@@ -616,8 +1068,302 @@ bool verifyWatermark(const std::vector<uint8_t>& extracted, const Watermark& wm)
     return errors == 0;
 }
 
-void testOnDataset(const std::string& datasetPath, const std::string& datasetName,
+// Искажения для проверки устойчивости ЦВЗ. Все работают на копии GrayBMP
+// того же размера, чтобы извлечение шло по тем же блокам. Внутренние циклы -
+// поэлементные операции над строками.
+class Attacks {
+private:
+    static uint8_t clamp(int v) { return static_cast<uint8_t>(std::min(255, std::max(0, v))); }
+
+    static float sample(const uint8_t* p, int w, int h, float x, float y, float fill) {
+        if (x < 0 || y < 0 || x > w - 1 || y > h - 1) return fill;
+        int x0 = static_cast<int>(x), y0 = static_cast<int>(y);
+        int x1 = std::min(x0 + 1, w - 1), y1 = std::min(y0 + 1, h - 1);
+        float fx = x - x0, fy = y - y0;
+        float top = p[y0 * w + x0] + fx * (p[y0 * w + x1] - p[y0 * w + x0]);
+        float bottom = p[y1 * w + x0] + fx * (p[y1 * w + x1] - p[y1 * w + x0]);
+        return top + fy * (bottom - top);
+    }
+
+    static std::vector<uint8_t> resize(const uint8_t* src, int sw, int sh, int dw, int dh) {
+        std::vector<uint8_t> dst(static_cast<size_t>(dw) * dh);
+        float sx = static_cast<float>(sw) / dw, sy = static_cast<float>(sh) / dh;
+        for (int y = 0; y < dh; ++y) {
+            float fy = std::min((y + 0.5f) * sy - 0.5f, sh - 1.0f);
+            for (int x = 0; x < dw; ++x) {
+                float fx = std::min((x + 0.5f) * sx - 0.5f, sw - 1.0f);
+                dst[y * dw + x] = clamp(static_cast<int>(std::lround(
+                    sample(src, sw, sh, std::max(fx, 0.0f), std::max(fy, 0.0f), 0.0f))));
+            }
+        }
+        return dst;
+    }
+
+    // Стандартная таблица яркости JPEG (ITU T.81, K.1), масштаб качества IJG
+    static std::array<int, 64> quantTable(int quality) {
+        static const int base[64] = {
+            16, 11, 10, 16, 24, 40, 51, 61,   12, 12, 14, 19, 26, 58, 60, 55,
+            14, 13, 16, 24, 40, 57, 69, 56,   14, 17, 22, 29, 51, 87, 80, 62,
+            18, 22, 37, 56, 68, 109, 103, 77, 24, 35, 55, 64, 81, 104, 113, 92,
+            49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99};
+        quality = std::min(100, std::max(1, quality));
+        int scale = (quality < 50) ? 5000 / quality : 200 - quality * 2;
+        std::array<int, 64> table;
+        for (int i = 0; i < 64; ++i) table[i] = std::min(255, std::max(1, (base[i] * scale + 50) / 100));
+        return table;
+    }
+
+public:
+    static GrayBMP gaussianNoise(const GrayBMP& img, double sigma, unsigned seed) {
+        GrayBMP out = img.clone();
+        std::mt19937 gen(seed);
+        std::normal_distribution<float> noise(0.0f, static_cast<float>(sigma));
+        uint8_t* p = out.data();
+        for (int i = 0; i < out.getSize(); ++i) p[i] = clamp(static_cast<int>(std::lround(p[i] + noise(gen))));
+        return out;
+    }
+
+    static GrayBMP saltPepper(const GrayBMP& img, double density, unsigned seed) {
+        GrayBMP out = img.clone();
+        std::mt19937 gen(seed);
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        uint8_t* p = out.data();
+        for (int i = 0; i < out.getSize(); ++i) {
+            double r = uniform(gen);
+            if (r < density / 2) p[i] = 0;
+            else if (r < density) p[i] = 255;
+        }
+        return out;
+    }
+
+    // Медиана 3x3: девять сдвинутых копий строки и сеть из 19 min/max
+    // (Paeth), одинаковая для всех пикселей строки; края повторяются
+    static GrayBMP median3(const GrayBMP& img) {
+        GrayBMP out = img.clone();
+        int w = img.getWidth(), h = img.getHeight();
+        const uint8_t* src = img.data();
+        uint8_t* dst = out.data();
+        std::vector<std::vector<uint8_t>> n(9, std::vector<uint8_t>(w));
+
+        auto sort2 = [w](std::vector<uint8_t>& a, std::vector<uint8_t>& b) {
+            for (int x = 0; x < w; ++x) {
+                uint8_t lo = std::min(a[x], b[x]), hi = std::max(a[x], b[x]);
+                a[x] = lo;
+                b[x] = hi;
+            }
+        };
+
+        for (int y = 0; y < h; ++y) {
+            for (int dy = -1; dy <= 1; ++dy) {
+                const uint8_t* row = src + std::min(h - 1, std::max(0, y + dy)) * w;
+                for (int dx = -1; dx <= 1; ++dx) {
+                    std::vector<uint8_t>& v = n[(dy + 1) * 3 + dx + 1];
+                    for (int x = 0; x < w; ++x) v[x] = row[std::min(w - 1, std::max(0, x + dx))];
+                }
+            }
+            sort2(n[1], n[2]); sort2(n[4], n[5]); sort2(n[7], n[8]);
+            sort2(n[0], n[1]); sort2(n[3], n[4]); sort2(n[6], n[7]);
+            sort2(n[1], n[2]); sort2(n[4], n[5]); sort2(n[7], n[8]);
+            sort2(n[0], n[3]); sort2(n[5], n[8]); sort2(n[4], n[7]);
+            sort2(n[3], n[6]); sort2(n[1], n[4]); sort2(n[2], n[5]);
+            sort2(n[4], n[7]); sort2(n[4], n[2]); sort2(n[6], n[4]);
+            sort2(n[4], n[2]);
+            std::copy(n[4].begin(), n[4].end(), dst + y * w);
+        }
+        return out;
+    }
+
+    // Среднее 3x3: сепарабельные целочисленные суммы, деление с округлением
+    static GrayBMP mean3(const GrayBMP& img) {
+        GrayBMP out = img.clone();
+        int w = img.getWidth(), h = img.getHeight();
+        const uint8_t* src = img.data();
+        uint8_t* dst = out.data();
+        std::vector<uint16_t> colSum(w);
+        for (int y = 0; y < h; ++y) {
+            const uint8_t* r0 = src + std::max(0, y - 1) * w;
+            const uint8_t* r1 = src + y * w;
+            const uint8_t* r2 = src + std::min(h - 1, y + 1) * w;
+            for (int x = 0; x < w; ++x) colSum[x] = r0[x] + r1[x] + r2[x];
+            for (int x = 0; x < w; ++x) {
+                int sum = colSum[std::max(0, x - 1)] + colSum[x] + colSum[std::min(w - 1, x + 1)];
+                dst[y * w + x] = static_cast<uint8_t>((sum + 4) / 9);
+            }
+        }
+        return out;
+    }
+
+    // Масштабирование в factor раз и обратно к исходному размеру (билинейно)
+    static GrayBMP rescale(const GrayBMP& img, double factor) {
+        GrayBMP out = img.clone();
+        int w = img.getWidth(), h = img.getHeight();
+        int sw = std::max(1, static_cast<int>(std::lround(w * factor)));
+        int sh = std::max(1, static_cast<int>(std::lround(h * factor)));
+        std::vector<uint8_t> small = resize(img.data(), w, h, sw, sh);
+        std::vector<uint8_t> back = resize(small.data(), sw, sh, w, h);
+        std::copy(back.begin(), back.end(), out.data());
+        return out;
+    }
+
+    // Обрезка: остаётся центральная часть keep по каждой стороне, остальное - 0
+    static GrayBMP crop(const GrayBMP& img, double keep) {
+        GrayBMP out = img.clone();
+        int w = img.getWidth(), h = img.getHeight();
+        int x0 = static_cast<int>(w * (1.0 - keep) / 2), x1 = w - x0;
+        int y0 = static_cast<int>(h * (1.0 - keep) / 2), y1 = h - y0;
+        uint8_t* p = out.data();
+        for (int y = 0; y < h; ++y) {
+            uint8_t* row = p + y * w;
+            if (y < y0 || y >= y1) {
+                std::fill(row, row + w, 0);
+            } else {
+                std::fill(row, row + x0, 0);
+                std::fill(row + x1, row + w, 0);
+            }
+        }
+        return out;
+    }
+
+    // Поворот вокруг центра с билинейной интерполяцией, углы заполняются 0
+    static GrayBMP rotate(const GrayBMP& img, double degrees) {
+        GrayBMP out = img.clone();
+        int w = img.getWidth(), h = img.getHeight();
+        const uint8_t* src = img.data();
+        uint8_t* dst = out.data();
+        float a = static_cast<float>(degrees * M_PI / 180.0);
+        float c = std::cos(a), s = std::sin(a);
+        float cx = (w - 1) / 2.0f, cy = (h - 1) / 2.0f;
+        for (int y = 0; y < h; ++y) {
+            for (int x = 0; x < w; ++x) {
+                float dx = x - cx, dy = y - cy;
+                float sx = c * dx + s * dy + cx;
+                float sy = -s * dx + c * dy + cy;
+                dst[y * w + x] = clamp(static_cast<int>(std::lround(sample(src, w, h, sx, sy, 0.0f))));
+            }
+        }
+        return out;
+    }
+
+    // Базовый JPEG без энтропийного кодирования (оно без потерь и на
+    // результат не влияет): DCT 8x8, квантование таблицей качества,
+    // деквантование и обратное DCT. Неполные блоки на краях дополняются
+    // повтором крайних пикселей.
+    static GrayBMP jpeg(const GrayBMP& img, int quality) {
+        GrayBMP out = img.clone();
+        int w = img.getWidth(), h = img.getHeight();
+        const uint8_t* src = img.data();
+        uint8_t* dst = out.data();
+        std::array<int, 64> q = quantTable(quality);
+
+        const int LANES = FixedDCT8::LANES;
+        int blocksX = (w + 7) / 8, blocksY = (h + 7) / 8;
+        int total = blocksX * blocksY;
+        FixedDCT8::Lanes data[64];
+
+        for (int g = 0; g < total; g += LANES) {
+            int count = std::min(LANES, total - g);
+            for (int l = 0; l < LANES; ++l) {
+                int b = g + std::min(l, count - 1);
+                int bx = (b % blocksX) * 8, by = (b / blocksX) * 8;
+                for (int y = 0; y < 8; ++y) {
+                    const uint8_t* row = src + std::min(h - 1, by + y) * w;
+                    for (int x = 0; x < 8; ++x) data[y * 8 + x][l] = row[std::min(w - 1, bx + x)] - 128;
+                }
+            }
+            FixedDCT8::forward(data);
+            for (int k = 0; k < 64; ++k) {
+                int32_t div = 8 * q[k];
+                for (int l = 0; l < LANES; ++l) {
+                    int32_t v = data[k][l];
+                    int32_t level = (v >= 0) ? (v + div / 2) / div : -((-v + div / 2) / div);
+                    data[k][l] = level * div;
+                }
+            }
+            FixedDCT8::inverse(data);
+            for (int l = 0; l < count; ++l) {
+                int b = g + l;
+                int bx = (b % blocksX) * 8, by = (b / blocksX) * 8;
+                for (int y = 0; y < 8 && by + y < h; ++y) {
+                    for (int x = 0; x < 8 && bx + x < w; ++x) {
+                        dst[(by + y) * w + bx + x] = clamp(data[y * 8 + x][l] + 128);
+                    }
+                }
+            }
+        }
+        return out;
+    }
+};
+
+double bitErrorRate(const std::vector<uint8_t>& extracted, const Watermark& wm) {
+    const auto& original = wm.getBits();
+    if (extracted.size() != original.size() || original.empty()) return 1.0;
+    int errors = 0;
+    for (size_t i = 0; i < extracted.size(); ++i) {
+        if (extracted[i] != original[i]) errors++;
+    }
+    return static_cast<double>(errors) / original.size();
+}
+
+// Матрица атак по набору: встраивание один раз на изображение, затем все
+// искажения в памяти и средний BER по каждому
+void testRobustnessOnDataset(const std::string& datasetPath, const std::string& datasetName,
+                             Embedder& embedder, const Watermark& wm, const std::string& key) {
+    TRACE_SCOPE("robustness");
+    std::cout << "\n===== Robustness on " << datasetName << " =====\n";
+    std::cout << "Embedder: " << embedder.name() << "\n";
+
+    using Attack = std::pair<std::string, std::function<GrayBMP(const GrayBMP&)>>;
+    const std::vector<Attack> attacks = {
+        {"none",          [](const GrayBMP& s) { return s.clone(); }},
+        {"noise s=2",     [](const GrayBMP& s) { return Attacks::gaussianNoise(s, 2.0, 1); }},
+        {"noise s=5",     [](const GrayBMP& s) { return Attacks::gaussianNoise(s, 5.0, 1); }},
+        {"salt&pepper 1%",[](const GrayBMP& s) { return Attacks::saltPepper(s, 0.01, 1); }},
+        {"median 3x3",    [](const GrayBMP& s) { return Attacks::median3(s); }},
+        {"mean 3x3",      [](const GrayBMP& s) { return Attacks::mean3(s); }},
+        {"rescale 0.75",  [](const GrayBMP& s) { return Attacks::rescale(s, 0.75); }},
+        {"crop 90%",      [](const GrayBMP& s) { return Attacks::crop(s, 0.9); }},
+        {"rotate 1 deg",  [](const GrayBMP& s) { return Attacks::rotate(s, 1.0); }},
+        {"jpeg q90",      [](const GrayBMP& s) { return Attacks::jpeg(s, 90); }},
+        {"jpeg q75",      [](const GrayBMP& s) { return Attacks::jpeg(s, 75); }},
+        {"jpeg q50",      [](const GrayBMP& s) { return Attacks::jpeg(s, 50); }},
+    };
+
+    int n = 30;
+    int count = 0;
+    std::vector<double> berSum(attacks.size(), 0.0), psnrSum(attacks.size(), 0.0);
+
+    DatasetSource dataset(datasetPath);
+    for (size_t i = 0; i < dataset.size(); ++i) {
+        fs::path entryPath = dataset.path(i);
+        if (count >= n) break;
+
+        GrayBMP container, stego;
+        if (!dataset.load(i, container) || container.getSize() < wm.totalBits()) continue;
+        if (!embedder.embed(container, wm, key, stego)) continue;
+        count++;
+
+        for (size_t a = 0; a < attacks.size(); ++a) {
+            TRACE_SCOPE("attack");
+            GrayBMP attacked = attacks[a].second(stego);
+            std::vector<uint8_t> extracted;
+            berSum[a] += embedder.extract(attacked, key, wm.totalBits(), extracted) ? bitErrorRate(extracted, wm) : 1.0;
+            psnrSum[a] += Metrics::PSNR(Metrics::MSE(stego.getPixels(), attacked.getPixels()));
+        }
+    }
+
+    if (count == 0) return;
+    std::cout << std::left << std::setw(18) << "Attack" << std::right << std::setw(10) << "BER, %"
+              << std::setw(12) << "PSNR, dB" << "\n";
+    for (size_t a = 0; a < attacks.size(); ++a) {
+        std::cout << std::left << std::setw(18) << attacks[a].first << std::right << std::fixed
+                  << std::setprecision(2) << std::setw(10) << 100.0 * berSum[a] / count
+                  << std::setw(12) << psnrSum[a] / count << "\n";
+    }
+}
+
+bool testOnDataset(const std::string& datasetPath, const std::string& datasetName,
                    Embedder& embedder, const Watermark& wm, const std::string& key) {
+    TRACE_SCOPE("dataset");
     std::cout << "\n===== Testing on " << datasetName << " =====\n";
     std::cout << "Embedder: " << embedder.name() << "\n";
 
@@ -626,39 +1372,45 @@ void testOnDataset(const std::string& datasetPath, const std::string& datasetNam
     double totalPSNR = 0.0;
     std::vector<double> PSNR_i;
 
-    for (const auto& entry : fs::directory_iterator(datasetPath)) {
-        if (entry.path().extension() != ".bmp") continue;
+    WriteSink sink;
+    DatasetSource dataset(datasetPath);
+    DatasetPrefetcher prefetch(dataset, std::min(dataset.size(), static_cast<size_t>(n)));
+    for (size_t i = 0; i < dataset.size(); ++i) {
+        fs::path entryPath = dataset.path(i);
         if (++count > n) break;
 
         GrayBMP container;
-        if (!container.load(entry.path().string())) {
-            std::cerr << "Failed to load " << entry.path() << "\n";
+        if (!prefetch.next(i, container)) {
+            std::cerr << "Failed to load " << entryPath << "\n";
             continue;
         }
 
         if (container.getSize() < wm.totalBits()) {
-            std::cout << "  Skipping " << entry.path().filename() << " (too small)\n";
+            std::cout << "  Skipping " << entryPath.filename() << " (too small)\n";
             continue;
         }
 
         GrayBMP stego;
         if (!embedder.embed(container, wm, key, stego)) {
-            std::cerr << "Embedding failed for " << entry.path() << "\n";
+            std::cerr << "Embedding failed for " << entryPath << "\n";
             continue;
         }
 
         std::vector<uint8_t> extracted;
         if (!embedder.extract(stego, key, wm.totalBits(), extracted)) {
-            std::cerr << "Extraction failed for " << entry.path() << "\n";
+            std::cerr << "Extraction failed for " << entryPath << "\n";
             continue;
         }
         
-        if (!embedder.createWatermarkImage(extracted, wm.getWidth(), wm.getHeight(), "stego/" + datasetName + "/" + embedder.name() + "/extracted/" + entry.path().stem().string() + ".bmp")) {
-            std::cerr << "Create failed for " << entry.path() << "\n";
+        GrayBMP wmImage;
+        if (!watermarkImage(extracted, wm.getWidth(), wm.getHeight(), wmImage)) {
+            std::cerr << "Create failed for " << entryPath << "\n";
             continue;
         }
+        sink.write("stego/" + datasetName + "/" + embedder.name() + "/extracted/" + entryPath.stem().string() + ".bmp",
+                   wmImage.encodedSize(), [&](uint8_t* dst) { wmImage.encode(dst); });
 
-        std::cout << "\nImage: " << entry.path().filename() << "\n";
+        std::cout << "\nImage: " << entryPath.filename() << "\n";
         bool ok = verifyWatermark(extracted, wm);
 
         double mse = Metrics::MSE(container.getPixels(), stego.getPixels());
@@ -667,9 +1419,11 @@ void testOnDataset(const std::string& datasetPath, const std::string& datasetNam
         totalPSNR += psnr;
         std::cout << "  PSNR = " << std::fixed << std::setprecision(2) << psnr << " dB\n";
 
-        std::string outName = "stego/" + datasetName + "/" + embedder.name() + "/" + entry.path().stem().string() + ".bmp";
-        stego.save(outName);
+        std::string outName = "stego/" + datasetName + "/" + embedder.name() + "/" + entryPath.stem().string() + ".bmp";
+        sink.write(outName, stego.encodedSize(), [&](uint8_t* dst) { stego.encode(dst); });
     }
+    bool written = sink.flush();
+    if (!written) std::cerr << "Some output files for " << datasetName << " were not written\n";
 
     if (count > 0) {
         std::cout << "\nAverage PSNR for " << datasetName << ": "
@@ -693,9 +1447,421 @@ void testOnDataset(const std::string& datasetPath, const std::string& datasetNam
 
         std::cout << "\nConfidence interval = [" << _x - t * (S / sqrt(n)) << ", " << _x + t * (S / sqrt(n)) << "]\n"; 
     }
+    return written;
+}
+
+// Локальный сервер встраивания: lab2 serve <socket>. Держит загруженные
+// водяные знаки и перестановки блоков (getBlockOrder) между запросами, так
+// что запрос стоит только обработки пикселей. Изображение передаётся через
+// memfd (SCM_RIGHTS) с печатью F_SEAL_SHRINK: [0, w*h) - контейнер или стего,
+// [w*h, 2*w*h) - ответ (стего для embed, по байту на бит для extract). Запросы обрабатываются
+// по очереди: встраиватели не потокобезопасны.
+#ifdef __linux__
+
+const uint32_t DAEMON_MAGIC = 0x3242414C;  // "LAB2"
+
+enum DaemonOp : uint32_t { OP_EMBED = 1, OP_EXTRACT = 2, OP_STATS = 3, OP_SHUTDOWN = 4 };
+
+struct DaemonRequest {
+    uint32_t magic;
+    uint32_t op;
+    char method[32];
+    char key[128];
+    char watermark[512];
+    int32_t width;
+    int32_t height;
+    int32_t bits;          // extract без файла водяного знака
+};
+
+struct DaemonReply {
+    uint32_t magic;
+    int32_t status;        // 0 - успех
+    int32_t bits;
+    double micros;         // время обработки на сервере
+    char message[160];
+};
+
+bool sendWithFd(int sock, const void* data, size_t size, int fd) {
+    iovec iov{const_cast<void*>(data), size};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+    if (fd >= 0) {
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+    return sendmsg(sock, &msg, MSG_NOSIGNAL) == static_cast<ssize_t>(size);
+}
+
+// Возвращает false на конце потока; fd = -1, если дескриптор не пришёл
+bool recvWithFd(int sock, void* data, size_t size, int& fd) {
+    fd = -1;
+    iovec iov{data, size};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t got = recvmsg(sock, &msg, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) std::memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    }
+    if (got != static_cast<ssize_t>(size)) {
+        if (fd >= 0) close(fd);
+        fd = -1;
+        return false;
+    }
+    return true;
+}
+
+class EmbeddingDaemon {
+private:
+    BlockLSBEmbedder lsb;
+    BlockAdaptiveEmbedder adaptive;
+    BlockDCTEmbedder dct;
+    // Кэша артефактов на диске нет: изображение в каждом запросе новое
+
+    // Отображение буфера клиента держится, пока клиент шлёт тот же memfd
+    // (тот же inode): повторные запросы обходятся без mmap/munmap
+    struct Connection {
+        int sock = -1;
+        uint8_t* map = nullptr;
+        size_t mapSize = 0;
+        dev_t dev = 0;
+        ino_t ino = 0;
+
+        void unmap() {
+            if (map) munmap(map, mapSize);
+            map = nullptr;
+            mapSize = 0;
+        }
+    };
+
+    struct CachedWatermark {
+        fs::file_time_type mtime;
+        Watermark wm;
+    };
+    std::map<std::string, CachedWatermark> watermarks;
+    size_t requests = 0, watermarkLoads = 0;
+    bool running = true;
+
+    Embedder* find(const std::string& method) {
+        for (Embedder* e : std::initializer_list<Embedder*>{&lsb, &adaptive, &dct}) {
+            if (e->name() == method) return e;
+        }
+        return nullptr;
+    }
+
+    // Файл перечитывается, только если изменился с прошлой загрузки
+    const Watermark* watermark(const std::string& path) {
+        std::error_code ec;
+        auto mtime = fs::last_write_time(path, ec);
+        if (ec) return nullptr;
+        auto found = watermarks.find(path);
+        if (found != watermarks.end() && found->second.mtime == mtime) return &found->second.wm;
+
+        CachedWatermark entry{mtime, Watermark()};
+        if (!entry.wm.loadFromBMP(path)) return nullptr;
+        watermarkLoads++;
+        return &(watermarks[path] = std::move(entry)).wm;
+    }
+
+    void fail(DaemonReply& reply, const std::string& text) {
+        reply.status = 1;
+        std::snprintf(reply.message, sizeof(reply.message), "%s", text.c_str());
+    }
+
+    // Буфер обязан быть запечатан от уменьшения (F_SEAL_SHRINK): иначе клиент,
+    // укоротивший memfd, уронил бы демон по SIGBUS вместе с остальными клиентами
+    uint8_t* mapBuffer(Connection& conn, int fd, size_t size) {
+        int seals = fcntl(fd, F_GET_SEALS);
+        if (seals < 0 || !(seals & F_SEAL_SHRINK)) return nullptr;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < size) return nullptr;
+        if (conn.map && conn.dev == st.st_dev && conn.ino == st.st_ino && conn.mapSize == size) return conn.map;
+        conn.unmap();
+        void* map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) return nullptr;
+        conn.map = static_cast<uint8_t*>(map);
+        conn.mapSize = size;
+        conn.dev = st.st_dev;
+        conn.ino = st.st_ino;
+        return conn.map;
+    }
+
+    // Изображение читается прямо из первой половины буфера, стего
+    // встраивается прямо во вторую: одна копия вход -> выход на запрос
+    void handle(const DaemonRequest& req, int fd, Connection& conn, DaemonReply& reply) {
+        TRACE_SCOPE("daemon.request");
+        requests++;
+        if (req.op == OP_STATS) {
+            std::snprintf(reply.message, sizeof(reply.message), "requests=%zu watermarks=%zu loads=%zu",
+                          requests, watermarks.size(), watermarkLoads);
+            return;
+        }
+        if (req.op == OP_SHUTDOWN) {
+            running = false;
+            std::snprintf(reply.message, sizeof(reply.message), "stopping");
+            return;
+        }
+
+        Embedder* embedder = find(std::string(req.method, strnlen(req.method, sizeof(req.method))));
+        if (!embedder) return fail(reply, "unknown method");
+        std::string key(req.key, strnlen(req.key, sizeof(req.key)));
+        std::string wmPath(req.watermark, strnlen(req.watermark, sizeof(req.watermark)));
+
+        if (fd < 0 || req.width <= 0 || req.height <= 0) return fail(reply, "bad image buffer");
+        size_t pixels = static_cast<size_t>(req.width) * req.height;
+        uint8_t* input = mapBuffer(conn, fd, 2 * pixels);
+        if (!input) return fail(reply, "bad image buffer (need a memfd sealed with F_SEAL_SHRINK)");
+        uint8_t* output = input + pixels;
+
+        GrayBMP image = GrayBMP::view(input, req.width, req.height);
+        if (req.op == OP_EMBED) {
+            const Watermark* wm = watermark(wmPath);
+            GrayBMP stego = GrayBMP::mutableView(output, req.width, req.height);
+            if (!wm) {
+                fail(reply, "cannot load watermark");
+            } else if (!embedder->embed(image, *wm, key, stego)) {
+                fail(reply, "embedding failed");
+            } else {
+                reply.bits = wm->totalBits();
+            }
+        } else if (req.op == OP_EXTRACT) {
+            const Watermark* wm = wmPath.empty() ? nullptr : watermark(wmPath);
+            int bits = wm ? wm->totalBits() : req.bits;
+            std::vector<uint8_t> extracted;
+            if (bits <= 0 || static_cast<size_t>(bits) > pixels) {
+                fail(reply, "bad bit count");
+            } else if (!embedder->extract(image, key, bits, extracted)) {
+                fail(reply, "extraction failed");
+            } else {
+                std::memcpy(output, extracted.data(), extracted.size());
+                reply.bits = bits;
+            }
+        } else {
+            fail(reply, "unknown op");
+        }
+    }
+
+    // Один запрос с соединения; false - соединение надо закрыть
+    bool serveRequest(Connection& conn) {
+        DaemonRequest req;
+        int fd;
+        if (!recvWithFd(conn.sock, &req, sizeof(req), fd)) return false;
+        DaemonReply reply{};
+        reply.magic = DAEMON_MAGIC;
+        auto start = std::chrono::steady_clock::now();
+        if (req.magic != DAEMON_MAGIC) {
+            fail(reply, "bad magic");
+        } else {
+            handle(req, fd, conn, reply);
+        }
+        reply.micros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        if (fd >= 0) close(fd);
+        return sendWithFd(conn.sock, &reply, sizeof(reply), -1);
+    }
+
+public:
+    // Соединения опрашиваются poll, запросы выполняются по одному. Тайм-аут
+    // на приём и отправку не даёт клиенту, оборвавшему запрос на середине
+    // или не читающему ответ, задержать остальных дольше IO_TIMEOUT_SEC.
+    static constexpr int IO_TIMEOUT_SEC = 5;
+
+    int serve(const std::string& path) {
+        int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (listener < 0 || path.size() >= sizeof(addr.sun_path)) {
+            std::cerr << "Cannot create socket " << path << "\n";
+            return 1;
+        }
+        std::strcpy(addr.sun_path, path.c_str());
+        unlink(path.c_str());
+        if (bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listener, 16) != 0) {
+            std::cerr << "Cannot listen on " << path << ": " << std::strerror(errno) << "\n";
+            close(listener);
+            return 1;
+        }
+        std::cout << "Listening on " << path << "\n" << std::flush;
+
+        std::vector<Connection> connections;
+        std::vector<pollfd> polled;
+        while (running) {
+            polled.assign(1, pollfd{listener, POLLIN, 0});
+            for (const Connection& conn : connections) polled.push_back(pollfd{conn.sock, POLLIN, 0});
+            if (poll(polled.data(), polled.size(), -1) < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+
+            for (size_t i = connections.size(); i-- > 0 && running;) {
+                if (!polled[i + 1].revents) continue;
+                if (!(polled[i + 1].revents & POLLIN) || !serveRequest(connections[i])) {
+                    connections[i].unmap();
+                    close(connections[i].sock);
+                    connections.erase(connections.begin() + i);
+                }
+            }
+
+            if (running && (polled[0].revents & POLLIN)) {
+                int sock = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+                if (sock >= 0) {
+                    timeval timeout{IO_TIMEOUT_SEC, 0};
+                    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+                    Connection conn;
+                    conn.sock = sock;
+                    connections.push_back(conn);
+                }
+            }
+        }
+        for (Connection& conn : connections) {
+            conn.unmap();
+            close(conn.sock);
+        }
+        close(listener);
+        unlink(path.c_str());
+        return 0;
+    }
+};
+
+// lab2 client <socket> embed   <method> <key> <watermark.bmp> <in.bmp> <out.bmp> [repeat]
+// lab2 client <socket> extract <method> <key> <watermark.bmp|bits> <in.bmp> <out.bmp> [repeat]
+// lab2 client <socket> stats | shutdown
+int runClient(int argc, char* argv[]) {
+    if (argc < 4) return 2;
+    std::string op = argv[3];
+    DaemonRequest req{};
+    req.magic = DAEMON_MAGIC;
+
+    bool imageOp = op == "embed" || op == "extract";
+    if (imageOp && argc < 9) return 2;
+    req.op = op == "embed" ? OP_EMBED : op == "extract" ? OP_EXTRACT : op == "stats" ? OP_STATS : OP_SHUTDOWN;
+    if (!imageOp && op != "stats" && op != "shutdown") return 2;
+
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, argv[2], sizeof(addr.sun_path) - 1);
+    if (sock < 0 || connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        std::cerr << "Cannot connect to " << argv[2] << "\n";
+        return 1;
+    }
+
+    GrayBMP image;
+    int fd = -1;
+    size_t pixels = 0;
+    int repeat = 1;
+    if (imageOp) {
+        std::snprintf(req.method, sizeof(req.method), "%s", argv[4]);
+        std::snprintf(req.key, sizeof(req.key), "%s", argv[5]);
+        std::string wmArg = argv[6];
+        if (op == "extract" && !wmArg.empty() && std::all_of(wmArg.begin(), wmArg.end(), ::isdigit)) {
+            req.bits = std::atoi(wmArg.c_str());
+        } else {
+            std::snprintf(req.watermark, sizeof(req.watermark), "%s", fs::absolute(wmArg).string().c_str());
+        }
+        if (!image.load(argv[7])) {
+            std::cerr << "Cannot load " << argv[7] << "\n";
+            return 1;
+        }
+        if (argc > 9) repeat = std::max(1, std::atoi(argv[9]));
+        req.width = image.getWidth();
+        req.height = image.getHeight();
+        pixels = static_cast<size_t>(image.getSize());
+
+        fd = memfd_create("lab2-image", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (fd < 0 || ftruncate(fd, 2 * pixels) != 0 || fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK) != 0 ||
+            pwrite(fd, image.data(), pixels, 0) != static_cast<ssize_t>(pixels)) {
+            std::cerr << "Cannot create shared buffer\n";
+            return 1;
+        }
+    }
+
+    DaemonReply reply{};
+    double total = 0.0, server = 0.0;
+    for (int r = 0; r < repeat; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        int none;
+        if (!sendWithFd(sock, &req, sizeof(req), fd) || !recvWithFd(sock, &reply, sizeof(reply), none)) {
+            std::cerr << "Daemon closed the connection\n";
+            return 1;
+        }
+        total += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        server += reply.micros;
+    }
+    close(sock);
+
+    if (reply.status != 0) {
+        std::cerr << "Error: " << reply.message << "\n";
+        return 1;
+    }
+    if (!imageOp) {
+        std::cout << reply.message << "\n";
+        return 0;
+    }
+
+    std::vector<uint8_t> result(pixels);
+    if (pread(fd, result.data(), pixels, pixels) != static_cast<ssize_t>(pixels)) return 1;
+    close(fd);
+
+    bool saved;
+    if (req.op == OP_EMBED) {
+        std::memcpy(image.data(), result.data(), pixels);
+        saved = image.save(argv[8]);
+    } else {
+        int w = req.bits > 0 ? reply.bits : 0, h = 1;
+        Watermark wm;
+        if (req.bits == 0 && wm.loadFromBMP(req.watermark)) {
+            w = wm.getWidth();
+            h = wm.getHeight();
+        }
+        for (int i = 0; i < reply.bits; ++i) result[i] = result[i] ? 255 : 0;
+        GrayBMP wmImage;
+        saved = wmImage.fromPixels(w, h, result.data()) && wmImage.save(argv[8]);
+    }
+    if (!saved) {
+        std::cerr << "Cannot write " << argv[8] << "\n";
+        return 1;
+    }
+    std::cout << op << " " << reply.bits << " bits, " << std::fixed << std::setprecision(1)
+              << total / repeat << " us per request (" << server / repeat << " us in daemon)\n";
+    return 0;
 }
 
-int main() {
+#endif
+
+int main(int argc, char* argv[]) {
+    if (argc > 1) {
+        std::string mode = argv[1];
+#ifdef __linux__
+        if (mode == "serve" && argc == 3) {
+            EmbeddingDaemon daemon;
+            int status = daemon.serve(argv[2]);
+            TRACE_DUMP();
+            return status;
+        }
+        if (mode == "client") {
+            int status = runClient(argc, argv);
+            if (status == 2) {
+                std::cerr << "usage: lab2 client <socket> embed|extract <method> <key> <watermark.bmp|bits> <in.bmp> <out.bmp> [repeat]\n"
+                          << "       lab2 client <socket> stats|shutdown\n";
+            }
+            return status;
+        }
+#endif
+        std::cerr << "usage: lab2 [serve <socket> | client <socket> ...]\n";
+        return 2;
+    }
+
     fs::create_directories("stego");
     fs::create_directories("stego/BOSS");
     fs::create_directories("stego/Medical");
@@ -712,12 +1878,20 @@ int main() {
     fs::create_directories("stego/Flowers/BlockAdaptive/extracted");
     fs::create_directories("stego/Flowers/BlockLSB");
     fs::create_directories("stego/Flowers/BlockLSB/extracted");
+    fs::create_directories("stego/BOSS/BlockDCT/extracted");
+    fs::create_directories("stego/Medical/BlockDCT/extracted");
+    fs::create_directories("stego/Flowers/BlockDCT/extracted");
 
 
     std::string bossPath   = "../lab1/set1";
     std::string medicalPath = "../lab1/set2";
     std::string otherPath  = "../lab1/set3";
 
+    // Упакованные наборы (datapack pack ../lab1/set1 ../lab1/set1.pack) быстрее папок
+    for (std::string* path : {&bossPath, &medicalPath, &otherPath}) {
+        if (fs::exists(*path + ".pack")) *path += ".pack";
+    }
+
     Watermark wm;
     if (!wm.loadFromBMP("./watermark4.bmp")) {
         std::cerr << "Please provide a logo.bmp (binary image) as watermark.\n";
@@ -730,15 +1904,22 @@ int main() {
 
     BlockLSBEmbedder blockLsbEmbedder;
     BlockAdaptiveEmbedder blockAdaptiveEmbedder;
+    BlockDCTEmbedder blockDctEmbedder;
+
+    ArtifactCache artifacts("artifact_cache");
+    blockAdaptiveEmbedder.setCache(&artifacts);
 
     // testOnDataset(bossPath, "BOSS", blockLsbEmbedder, wm, secretKey);
-    testOnDataset(bossPath, "BOSS", blockAdaptiveEmbedder, wm, secretKey);
+    bool ok = testOnDataset(bossPath, "BOSS", blockAdaptiveEmbedder, wm, secretKey);
+    ok &= testOnDataset(bossPath, "BOSS", blockDctEmbedder, wm, secretKey);
+    testRobustnessOnDataset(bossPath, "BOSS", blockAdaptiveEmbedder, wm, secretKey);
+    testRobustnessOnDataset(bossPath, "BOSS", blockDctEmbedder, wm, secretKey);
 
     // testOnDataset(medicalPath, "Medical", blockLsbEmbedder, wm, secretKey);
-    testOnDataset(medicalPath, "Medical", blockAdaptiveEmbedder, wm, secretKey);
+    ok &= testOnDataset(medicalPath, "Medical", blockAdaptiveEmbedder, wm, secretKey);
 
     // testOnDataset(otherPath, "Flowers", blockLsbEmbedder, wm, secretKey);
-    testOnDataset(otherPath, "Flowers", blockAdaptiveEmbedder, wm, secretKey);
+    ok &= testOnDataset(otherPath, "Flowers", blockAdaptiveEmbedder, wm, secretKey);
 
     //  GrayBMP image;
     // if (!image.load("stego/BOSS/BlockAdaptive/1.bmp"))
@@ -760,5 +1941,6 @@ int main() {
     // plane = image.extractBitPlane(8);
     // plane.save("adapt2_plane_8.bmp");
 
-    return 0;
+    TRACE_DUMP();
+    return ok ? 0 : 1;
 }
\ No newline at end of file
@@ -10,7 +10,14 @@
 #include <sstream>
 #include <algorithm>
 #include <cmath>
+#include <climits>
 #include <numeric>
+#include <thread>
+#include <atomic>
+
+#include "../lab1/artifactcache.h"
+#include "../lab1/boundedqueue.h"
+#include "../lab1/trace.h"
 
 namespace fs = std::filesystem;
 
@@ -44,6 +51,7 @@ private:
     bool loaded;
 
     bool readBMP(const std::string& filename) {
+        TRACE_SCOPE("bmp.read");
         std::ifstream file(filename, std::ios::binary);
         if (!file) return false;
 
@@ -77,6 +85,7 @@ private:
     }
 
     bool writeBMP(const std::string& filename) {
+        TRACE_SCOPE("bmp.write");
         if (!loaded) return false;
 
         int rowSize = (width * 8 + 31) / 32 * 4;
@@ -109,6 +118,33 @@ public:
     bool load(const std::string& filename) { return readBMP(filename); }
     bool save(const std::string& filename) { return writeBMP(filename); }
 
+    // Изображение из готовых отсчётов (сверху вниз), со стандартной серой
+    // палитрой - так читаются наборы из архива lab1/datapack
+    bool fromPixels(int w, int h, const uint8_t* src) {
+        int rowSize = (w * 8 + 31) / 32 * 4;
+        std::memset(&header, 0, sizeof(header));
+        header.bfType = 0x4D42;
+        header.bfOffBits = sizeof(header) + 1024;
+        header.bfSize = header.bfOffBits + rowSize * h;
+        header.biSize = 40;
+        header.biWidth = w;
+        header.biHeight = h;
+        header.biPlanes = 1;
+        header.biBitCount = 8;
+        header.biSizeImage = rowSize * h;
+        header.biClrUsed = 256;
+        palette.resize(1024);
+        for (int i = 0; i < 256; ++i) {
+            palette[i * 4 + 0] = palette[i * 4 + 1] = palette[i * 4 + 2] = static_cast<uint8_t>(i);
+            palette[i * 4 + 3] = 0;
+        }
+        width = w;
+        height = h;
+        pixels.assign(src, src + static_cast<size_t>(w) * h);
+        loaded = true;
+        return true;
+    }
+
     int getWidth() const { return width; }
     int getHeight() const { return height; }
     int getSize() const { return width * height; }
@@ -120,6 +156,7 @@ public:
     void setPixels(const std::vector<uint8_t>& newPixels) { pixels = newPixels; }
 
     bool isIdentical(const GrayBMP& other) const {
+        TRACE_SCOPE("verify.restore");
         if (width != other.width || height != other.height) return false;
         return pixels == other.pixels;
     }
@@ -139,6 +176,7 @@ public:
 class Metrics {
 public:
     static double computePSNR(const GrayBMP& original, const GrayBMP& stego) {
+        TRACE_SCOPE_BYTES("metrics.psnr", 2 * original.getWidth() * original.getHeight());
         double mse = 0;
         int size = original.getWidth() * original.getHeight();
         const uint8_t* origPixels = original.data();
@@ -166,6 +204,7 @@ private:
     std::vector<PeakZeroPair> pairs;
     
     std::map<int, int> computeHistogram(const GrayBMP& image) {
+        TRACE_SCOPE_BYTES("hs.histogram", image.getWidth() * image.getHeight());
         std::map<int, int> hist;
         const uint8_t* pixels = image.data();
         int size = image.getWidth() * image.getHeight();
@@ -179,6 +218,7 @@ private:
     
     std::vector<PeakZeroPair> findPeakZeroPairs(const std::map<int, int>& hist, 
                                                  int requiredCapacity) {
+        TRACE_SCOPE("hs.pairsearch");
         std::vector<PeakZeroPair> pairs;
         
         std::vector<int> zeroPoints;
@@ -215,6 +255,52 @@ private:
         
         return pairs;
     }
+
+    ArtifactCache* cache = nullptr;
+    uint64_t lastKey = 0;
+    std::vector<PeakZeroPair> lastPairs;
+
+    // Все пары пик/ноль изображения (по отрезкам между нулями гистограммы) от
+    // данных не зависят: считаются один раз и берутся из кэша артефактов.
+    // Формат "hspairs1": тройки peak, zero, peakCount
+    std::vector<PeakZeroPair> allPeakZeroPairs(const GrayBMP& image) {
+        TRACE_SCOPE("hs.pairs");
+        if (!cache) return findPeakZeroPairs(computeHistogram(image), INT_MAX);
+
+        uint64_t key = ArtifactCache::key(image.data(), image.getWidth(), image.getHeight());
+        if (key == lastKey && key != 0) return lastPairs;
+
+        std::vector<int32_t> packed;
+        lastPairs.clear();
+        if (cache->load(key, "hspairs1", packed) && packed.size() % 3 == 0) {
+            for (size_t i = 0; i < packed.size(); i += 3) {
+                lastPairs.push_back({packed[i], packed[i + 1], packed[i + 2]});
+            }
+        } else {
+            lastPairs = findPeakZeroPairs(computeHistogram(image), INT_MAX);
+            packed.clear();
+            for (const auto& pair : lastPairs) {
+                packed.push_back(pair.peak);
+                packed.push_back(pair.zero);
+                packed.push_back(pair.peakCount);
+            }
+            cache->store(key, "hspairs1", packed);
+        }
+        lastKey = key;
+        return lastPairs;
+    }
+
+    // Начало списка пар, набирающее requiredCapacity - как findPeakZeroPairs
+    static std::vector<PeakZeroPair> takePairs(const std::vector<PeakZeroPair>& allPairs, int requiredCapacity) {
+        std::vector<PeakZeroPair> result;
+        int totalCapacity = 0;
+        for (const auto& pair : allPairs) {
+            if (totalCapacity >= requiredCapacity) break;
+            result.push_back(pair);
+            totalCapacity += pair.peakCount;
+        }
+        return result;
+    }
 public:
     std::vector<uint8_t> readDataFromFile(const std::string& filename) {
         std::vector<uint8_t> data;
@@ -249,13 +335,13 @@ public:
     };
     
     EmbeddingResult embedAndExtract(GrayBMP& container, const std::vector<uint8_t>& data) {
+        TRACE_SCOPE_BYTES("hs.embedextract", container.getWidth() * container.getHeight());
         EmbeddingResult result;
         result.success = false;
         result.embeddedBits = 0;
         result.psnr = 0;
         
         int requiredCapacity = data.size() * 8;
-        auto hist = computeHistogram(container);
         
         int totalPixels = container.getWidth() * container.getHeight();
         result.capacity = totalPixels;
@@ -264,7 +350,7 @@ public:
             return result;
         }
         
-        pairs = findPeakZeroPairs(hist, requiredCapacity);
+        pairs = takePairs(allPeakZeroPairs(container), requiredCapacity);
         
         if (pairs.empty()) {
             return result;
@@ -297,18 +383,22 @@ public:
             int zero = pair.zero;
             bool shiftRight = (zero > peak);
             
-            for (int i = 0; i < size; i++) {
-                if (shiftRight) {
-                    if (pixels[i] > peak && pixels[i] < zero) {
-                        pixels[i]++;
-                    }
-                } else {
-                    if (pixels[i] < peak && pixels[i] > zero) {
-                        pixels[i]--;
+            {
+                TRACE_SCOPE("hs.shift");
+                for (int i = 0; i < size; i++) {
+                    if (shiftRight) {
+                        if (pixels[i] > peak && pixels[i] < zero) {
+                            pixels[i]++;
+                        }
+                    } else {
+                        if (pixels[i] < peak && pixels[i] > zero) {
+                            pixels[i]--;
+                        }
                     }
                 }
             }
             
+            TRACE_SCOPE("hs.modulate");
             for (int i = 0; i < size && bitIndex < totalBits; i++) {
                 if (pixels[i] == peak) {
                     uint8_t bit = (data[bitIndex / 8] >> (7 - (bitIndex % 8))) & 1;
@@ -350,26 +440,30 @@ public:
             
             std::vector<int> extractedBits;
             
-            for (int i = 0; i < size; i++) {
-                if (shiftRight) {
-                    if (restoredPixels[i] == peak + 1) {
-                        extractedBits.push_back(1);
-                        restoredPixels[i] = peak;
-                    } else if (restoredPixels[i] == peak) {
-                        extractedBits.push_back(0);
-                    }
-                } else {
-                    if (restoredPixels[i] == peak - 1) {
-                        extractedBits.push_back(1);
-                        restoredPixels[i] = peak;
-                    } else if (restoredPixels[i] == peak) {
-                        extractedBits.push_back(0);
+            {
+                TRACE_SCOPE("hs.demodulate");
+                for (int i = 0; i < size; i++) {
+                    if (shiftRight) {
+                        if (restoredPixels[i] == peak + 1) {
+                            extractedBits.push_back(1);
+                            restoredPixels[i] = peak;
+                        } else if (restoredPixels[i] == peak) {
+                            extractedBits.push_back(0);
+                        }
+                    } else {
+                        if (restoredPixels[i] == peak - 1) {
+                            extractedBits.push_back(1);
+                            restoredPixels[i] = peak;
+                        } else if (restoredPixels[i] == peak) {
+                            extractedBits.push_back(0);
+                        }
                     }
                 }
+                
+                bits.insert(bits.begin(), extractedBits.begin(), extractedBits.end());
             }
             
-            bits.insert(bits.begin(), extractedBits.begin(), extractedBits.end());
-            
+            TRACE_SCOPE("hs.unshift");
             for (int i = 0; i < size; i++) {
                 if (shiftRight) {
                     if (restoredPixels[i] > peak && restoredPixels[i] <= zero) {
@@ -404,31 +498,14 @@ public:
         return result;
     }
     
+    void setCache(ArtifactCache* artifactCache) { cache = artifactCache; }
+
     int estimateMaxCapacity(const GrayBMP& container) {
-        auto hist = computeHistogram(container);
+        TRACE_SCOPE("hs.capacity");
         int totalCapacity = 0;
-        
-        std::vector<int> zeroPoints;
-        for (int i = 0; i < 256; i++) {
-            if (hist.at(i) == 0) {
-                zeroPoints.push_back(i);
-            }
+        for (const auto& pair : allPeakZeroPairs(container)) {
+            totalCapacity += pair.peakCount;
         }
-        
-        int lastZero = -1;
-        for (int zero : zeroPoints) {
-            if (lastZero + 1 < zero) {
-                int maxCount = 0;
-                for (int i = lastZero + 1; i < zero; i++) {
-                    if (hist.at(i) > maxCount) {
-                        maxCount = hist.at(i);
-                    }
-                }
-                totalCapacity += maxCount;
-            }
-            lastZero = zero;
-        }
-        
         return totalCapacity;
     }
 };
@@ -447,8 +524,84 @@ struct DatasetStatistics {
     std::vector<int> failuresAtCapacity;
 };
 
+// Результат одного объёма данных для изображения
+struct CapacityTrial {
+    enum Outcome { OK, RESTORE_FAILED, EMBED_FAILED };
+    int capacity;
+    Outcome outcome;
+    double psnr;
+};
+
+struct LoadedImage {
+    size_t index = 0;
+    std::string filename;
+    GrayBMP image;
+    bool ok = false;
+};
+
+// Всё, что analyzeDataset узнаёт об одном изображении; статистика набора
+// собирается из этих записей в исходном порядке
+struct ImageAnalysis {
+    size_t index = 0;
+    std::string filename;
+    bool loaded = false;
+    int width = 0;
+    int height = 0;
+    int maxCapacity = 0;
+    std::vector<CapacityTrial> trials;
+};
+
 class ResearchAnalyzer {
 private:
+    ArtifactCache artifacts{"artifact_cache"};
+
+    static ImageAnalysis analyzeImage(HistogramShiftingEmbedder& embedder, LoadedImage& item,
+                                      const std::vector<uint8_t>& baseData) {
+        ImageAnalysis analysis;
+        analysis.index = item.index;
+        analysis.filename = item.filename;
+        analysis.loaded = item.ok;
+        if (!item.ok) return analysis;
+
+        GrayBMP& container = item.image;
+        analysis.width = container.getWidth();
+        analysis.height = container.getHeight();
+
+        // Оценка максимальной емкости
+        int maxCapacity = embedder.estimateMaxCapacity(container);
+        analysis.maxCapacity = maxCapacity;
+
+        // Тестируем с разными объемами данных
+        std::vector<int> testCapacities = {
+            maxCapacity / 4,
+            maxCapacity / 2,
+            maxCapacity * 3 / 4,
+            maxCapacity
+        };
+
+        for (int testCap : testCapacities) {
+            if (testCap <= 0) continue;
+
+            // Берем часть данных
+            int dataBytes = testCap / 8;
+            if (dataBytes == 0) dataBytes = 1;
+
+            std::vector<uint8_t> testData(baseData.begin(),
+                                           baseData.begin() + std::min((int)baseData.size(), dataBytes));
+
+            auto result = embedder.embedAndExtract(container, testData);
+
+            CapacityTrial trial{testCap, CapacityTrial::EMBED_FAILED, result.psnr};
+            if (result.success) {
+                bool restoredCorrectly = container.isIdentical(result.restored);
+                bool dataCorrect = (testData == result.extractedData);
+                trial.outcome = (restoredCorrectly && dataCorrect) ? CapacityTrial::OK : CapacityTrial::RESTORE_FAILED;
+            }
+            analysis.trials.push_back(trial);
+        }
+        return analysis;
+    }
+
     double computeMean(const std::vector<double>& values) {
         if (values.empty()) return 0;
         double sum = std::accumulate(values.begin(), values.end(), 0.0);
@@ -476,12 +629,13 @@ private:
 public:
     DatasetStatistics analyzeDataset(const std::string& datasetPath, const std::string& datasetName, 
                         const std::string& dataFilePath, const std::string& outputDir) {
-        
+        TRACE_SCOPE("dataset");
         std::cout << "\n========== RESEARCH ANALYSIS: " << datasetName << " ==========\n";
         
         fs::create_directories(outputDir + "/research/" + datasetName);
         
         HistogramShiftingEmbedder embedder;
+        embedder.setCache(&artifacts);
         
         // Читаем данные из файла для разных объемов
         std::vector<uint8_t> baseData = embedder.readDataFromFile(dataFilePath);
@@ -501,87 +655,79 @@ public:
         detailsFile << "Image,Width,Height,PSNR,Restored,Capacity,BitsEmbedded,Success\n";
         
         std::vector<int> capacities;
-        int imageCount = 0;
-        
-        for (const auto& entry : fs::directory_iterator(datasetPath)) {
-            if (entry.path().extension() != ".bmp") continue;
-            if (++imageCount > 30) break;
-            
-            stats.totalImages++;
-            std::string filename = entry.path().stem().string();
-            std::cout << "\n[" << imageCount << "] Analyzing: " << filename << ".bmp\n";
-            
-            GrayBMP container;
-            if (!container.load(entry.path().string())) {
-                std::cout << "  Failed to load\n";
-                detailsFile << filename << ",ERROR,ERROR,ERROR,ERROR,ERROR,ERROR,LOAD_FAILED\n";
-                continue;
+
+        ImagePack pack;
+        bool packed = openSiblingPack(datasetPath, pack);
+        std::vector<fs::path> files;
+        if (packed) {
+            for (uint32_t i = 0; i < pack.size() && files.size() < 30; ++i) files.push_back(pack.name(i));
+        } else {
+            for (const auto& entry : fs::directory_iterator(datasetPath)) {
+                if (entry.path().extension() != ".bmp") continue;
+                if (files.size() == 30) break;
+                files.push_back(entry.path());
             }
-            
-            // Оценка максимальной емкости
-            int maxCapacity = embedder.estimateMaxCapacity(container);
-            capacities.push_back(maxCapacity);
-            stats.maxCapacity = std::max(stats.maxCapacity, (double)maxCapacity);
-            
-            std::cout << "  Max capacity: " << maxCapacity << " bits\n";
-            
-            // Тестируем с разными объемами данных
-            std::vector<int> testCapacities = {
-                maxCapacity / 4,
-                maxCapacity / 2,
-                maxCapacity * 3 / 4,
-                maxCapacity
-            };
-            
-            bool allSuccessful = true;
-            
-            for (int testCap : testCapacities) {
-                if (testCap <= 0) continue;
-                
-                // Берем часть данных
-                int dataBytes = testCap / 8;
-                if (dataBytes == 0) dataBytes = 1;
-                
-                std::vector<uint8_t> testData(baseData.begin(), 
-                                               baseData.begin() + std::min((int)baseData.size(), dataBytes));
-                
-                auto result = embedder.embedAndExtract(container, testData);
-                
-                if (result.success) {
-                    bool restoredCorrectly = container.isIdentical(result.restored);
-                    bool dataCorrect = (testData == result.extractedData);
-                    
-                    if (restoredCorrectly && dataCorrect) {
-                        if (testCap == maxCapacity) {
-                            stats.successfulRestorations++;
-                        }
-                        std::cout << "  Cap " << testCap << " bits: ✓ PSNR=" 
-                                  << std::fixed << std::setprecision(2) << result.psnr << " dB\n";
-                        
-                        if (testCap == maxCapacity / 2) {
-                            stats.psnrValues.push_back(result.psnr);
-                        }
+        }
+
+        // Загрузка и анализ идут в разных потоках через очереди
+        // фиксированной ёмкости; статистика и вывод - в исходном порядке
+        const size_t PREFETCH = 4;
+        const int LOADERS = 2;
+        const int WORKERS = std::max(1u, std::thread::hardware_concurrency());
+
+        BoundedQueue<LoadedImage> loadQueue(PREFETCH);
+        BoundedQueue<ImageAnalysis> resultQueue(PREFETCH + WORKERS);
+        std::atomic<size_t> nextFile(0);
+
+        std::vector<std::thread> loaders;
+        for (int t = 0; t < LOADERS; ++t) {
+            loaders.emplace_back([&]() {
+                for (size_t i = nextFile++; i < files.size(); i = nextFile++) {
+                    LoadedImage item;
+                    item.index = i;
+                    item.filename = files[i].stem().string();
+                    if (packed) {
+                        const PackEntry& e = pack.entry(static_cast<uint32_t>(i));
+                        item.ok = item.image.fromPixels(e.width, e.height, pack.pixels(static_cast<uint32_t>(i)));
                     } else {
-                        allSuccessful = false;
-                        stats.failuresAtCapacity.push_back(testCap);
-                        std::cout << "  Cap " << testCap << " bits: ✗ Restoration failed\n";
+                        item.ok = item.image.load(files[i].string());
                     }
-                } else {
-                    allSuccessful = false;
-                    stats.failuresAtCapacity.push_back(testCap);
-                    std::cout << "  Cap " << testCap << " bits: ✗ Embedding failed\n";
+                    if (!loadQueue.push(std::move(item))) break;
+                }
+            });
+        }
+
+        std::vector<std::thread> workers;
+        for (int t = 0; t < WORKERS; ++t) {
+            workers.emplace_back([&]() {
+                HistogramShiftingEmbedder worker;
+                worker.setCache(&artifacts);
+                LoadedImage item;
+                while (loadQueue.pop(item)) {
+                    resultQueue.push(analyzeImage(worker, item, baseData));
                 }
+            });
+        }
+
+        std::thread coordinator([&]() {
+            for (auto& th : loaders) th.join();
+            loadQueue.close();
+            for (auto& th : workers) th.join();
+            resultQueue.close();
+        });
+
+        std::map<size_t, ImageAnalysis> pending;
+        size_t nextResult = 0;
+        ImageAnalysis analysis;
+        while (resultQueue.pop(analysis)) {
+            pending[analysis.index] = std::move(analysis);
+            for (auto it = pending.find(nextResult); it != pending.end(); it = pending.find(nextResult)) {
+                addImage(stats, capacities, detailsFile, it->second);
+                pending.erase(it);
+                nextResult++;
             }
-            
-            detailsFile << filename << ","
-                       << container.getWidth() << ","
-                       << container.getHeight() << ","
-                       << std::fixed << std::setprecision(2) << (stats.psnrValues.empty() ? 0 : stats.psnrValues.back()) << ","
-                       << (allSuccessful ? "YES" : "NO") << ","
-                       << maxCapacity << ","
-                       << (allSuccessful ? std::to_string(maxCapacity) : "FAIL") << ","
-                       << (allSuccessful ? "SUCCESS" : "FAIL") << "\n";
         }
+        coordinator.join();
         
         // Вычисление статистики
         if (!stats.psnrValues.empty()) {
@@ -602,10 +748,62 @@ public:
         
         // Выводим на экран
         printStatistics(stats);
+        std::cout << "Artifact cache: " << artifacts.hits << " hits, " << artifacts.misses << " misses\n";
 
         return stats;
     }
     
+    // Учёт одного изображения: вывод, строка details.csv и статистика
+    void addImage(DatasetStatistics& stats, std::vector<int>& capacities, std::ofstream& detailsFile,
+                  const ImageAnalysis& analysis) {
+        stats.totalImages++;
+        std::cout << "\n[" << analysis.index + 1 << "] Analyzing: " << analysis.filename << ".bmp\n";
+
+        if (!analysis.loaded) {
+            std::cout << "  Failed to load\n";
+            detailsFile << analysis.filename << ",ERROR,ERROR,ERROR,ERROR,ERROR,ERROR,LOAD_FAILED\n";
+            return;
+        }
+
+        int maxCapacity = analysis.maxCapacity;
+        capacities.push_back(maxCapacity);
+        stats.maxCapacity = std::max(stats.maxCapacity, (double)maxCapacity);
+
+        std::cout << "  Max capacity: " << maxCapacity << " bits\n";
+
+        bool allSuccessful = true;
+
+        for (const CapacityTrial& trial : analysis.trials) {
+            int testCap = trial.capacity;
+            if (trial.outcome == CapacityTrial::OK) {
+                if (testCap == maxCapacity) {
+                    stats.successfulRestorations++;
+                }
+                std::cout << "  Cap " << testCap << " bits: ✓ PSNR="
+                          << std::fixed << std::setprecision(2) << trial.psnr << " dB\n";
+
+                if (testCap == maxCapacity / 2) {
+                    stats.psnrValues.push_back(trial.psnr);
+                }
+            } else {
+                allSuccessful = false;
+                stats.failuresAtCapacity.push_back(testCap);
+                std::cout << "  Cap " << testCap << " bits: ✗ "
+                          << (trial.outcome == CapacityTrial::RESTORE_FAILED ? "Restoration" : "Embedding")
+                          << " failed\n";
+            }
+        }
+
+        detailsFile << analysis.filename << ","
+                   << analysis.width << ","
+                   << analysis.height << ","
+                   << std::fixed << std::setprecision(2) << (stats.psnrValues.empty() ? 0 : stats.psnrValues.back()) << ","
+                   << (allSuccessful ? "YES" : "NO") << ","
+                   << maxCapacity << ","
+                   << (allSuccessful ? std::to_string(maxCapacity) : "FAIL") << ","
+                   << (allSuccessful ? "SUCCESS" : "FAIL") << "\n";
+    }
+
     void saveStatistics(const DatasetStatistics& stats, const std::string& filename) {
         std::ofstream file(filename);
         
@@ -776,5 +974,6 @@ int main() {
     std::cout << "Results saved in: " << outputDir << "/research/\n";
     std::cout << "========================================\n";
     
+    TRACE_DUMP();
     return 0;
 }
\ No newline at end of file
@@ -1,10 +1,18 @@
-import os, json, struct, math, csv, time, tkinter as tk
+import os, sys, json, struct, math, csv, time, tkinter as tk
+from concurrent.futures import ThreadPoolExecutor
 from tkinter import filedialog, messagebox
 
 import numpy as np
 import cv2
 from PIL import Image, ImageTk
 
+# Нативные циклы из lab4.1/stegonative.cpp; без него работает код ниже на Python
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "lab4.1"))
+try:
+    import stegonative as native
+except ImportError:
+    native = None
+
 
 # ===================== БИТЫ =====================
 def bytes_to_bits(data: bytes) -> list[int]:
@@ -34,6 +42,8 @@ def bits_to_u32(bits32: list[int]) -> int:
 
 # ===================== PSNR =====================
 def psnr(original_u8: np.ndarray, stego_u8: np.ndarray) -> float:
+    if native is not None:
+        return native.psnr(np.ascontiguousarray(original_u8), np.ascontiguousarray(stego_u8))
     a = original_u8.astype(np.float64)
     b = stego_u8.astype(np.float64)
     mse = np.mean((a - b) ** 2)
@@ -96,6 +106,8 @@ def predict_from_A(img_u8: np.ndarray, i: int, j: int) -> int:
 
 def estimate_capacity_bits(img_u8: np.ndarray) -> int:
     # ёмкость = кол-во B-пикселей, где residual==0 и pred!=255 (там реально можно кодировать 0/1)
+    if native is not None and img_u8.dtype == np.uint8:
+        return native.rdh_capacity(np.ascontiguousarray(img_u8))
     h, w = img_u8.shape
     cap = 0
     for i in range(h):
@@ -118,6 +130,27 @@ def embed_variant2(img_u8: np.ndarray, payload_bytes: bytes) -> tuple[np.ndarray
     bits = u32_to_bits(len(payload_bytes)) + bytes_to_bits(payload_bytes)
     need = len(bits)
 
+    if native is not None:
+        stego = np.empty_like(img_u8)
+        k, no_shift = native.rdh_embed(np.ascontiguousarray(img_u8), stego, np.array(bits, dtype=np.uint8))
+    else:
+        stego, no_shift, k = _embed_loop(img_u8, bits)
+
+    if k < need:
+        raise RuntimeError(f"Не хватает ёмкости: встроено {k} бит из {need}")
+
+    meta = {
+        "algo": "variant2_checkerboard_predict_A + histogram_shift",
+        "shape": [int(h), int(w)],
+        "bits": int(need),
+        "payload_len_bytes": int(len(payload_bytes)),
+        "no_shift": no_shift
+    }
+    return stego, meta
+
+def _embed_loop(img_u8: np.ndarray, bits: list[int]) -> tuple[np.ndarray, list, int]:
+    h, w = img_u8.shape
+    need = len(bits)
     stego = img_u8.copy().astype(np.int16)
     no_shift = []  # координаты B, где r>=1, но x==255 и x+1 сделать нельзя
     k = 0
@@ -163,17 +196,7 @@ def embed_variant2(img_u8: np.ndarray, payload_bytes: bytes) -> tuple[np.ndarray
         if k >= need:
             break
 
-    if k < need:
-        raise RuntimeError(f"Не хватает ёмкости: встроено {k} бит из {need}")
-
-    meta = {
-        "algo": "variant2_checkerboard_predict_A + histogram_shift",
-        "shape": [int(h), int(w)],
-        "bits": int(need),
-        "payload_len_bytes": int(len(payload_bytes)),
-        "no_shift": no_shift
-    }
-    return stego.astype(np.uint8), meta
+    return stego.astype(np.uint8), no_shift, k
 
 def extract_variant2(stego_u8: np.ndarray, meta: dict) -> tuple[bytes, np.ndarray]:
     if stego_u8.ndim != 2 or stego_u8.dtype != np.uint8:
@@ -184,7 +207,30 @@ def extract_variant2(stego_u8: np.ndarray, meta: dict) -> tuple[bytes, np.ndarra
         raise RuntimeError("meta.shape не совпадает с изображением")
 
     need = int(meta["bits"])
-    no_shift = set(map(tuple, meta.get("no_shift", [])))
+
+    if native is not None:
+        mask = np.zeros_like(stego_u8)
+        for i, j in meta.get("no_shift", []):
+            mask[i, j] = 1
+        rec = np.empty_like(stego_u8)
+        out_bits = list(native.rdh_extract(np.ascontiguousarray(stego_u8), rec, need, mask))
+    else:
+        out_bits, rec = _extract_loop(stego_u8, need, meta.get("no_shift", []))
+
+    if len(out_bits) < 32:
+        raise RuntimeError("Не удалось извлечь заголовок (32 бита)")
+
+    payload_len = bits_to_u32(out_bits[:32])
+    payload_bits = out_bits[32:32 + payload_len * 8]
+    if len(payload_bits) < payload_len * 8:
+        raise RuntimeError("Извлечённых бит меньше, чем нужно по заголовку")
+
+    payload = bits_to_bytes(payload_bits)
+    return payload, rec
+
+def _extract_loop(stego_u8: np.ndarray, need: int, no_shift_list: list) -> tuple[list[int], np.ndarray]:
+    h, w = stego_u8.shape
+    no_shift = set(map(tuple, no_shift_list))
 
     rec = stego_u8.copy().astype(np.int16)
     out_bits = []
@@ -215,16 +261,7 @@ def extract_variant2(stego_u8: np.ndarray, meta: dict) -> tuple[bytes, np.ndarra
                 raise RuntimeError(f"Переполнение при восстановлении ({i},{j}) -> {new_x}")
             rec[i, j] = new_x
 
-    if len(out_bits) < 32:
-        raise RuntimeError("Не удалось извлечь заголовок (32 бита)")
-
-    payload_len = bits_to_u32(out_bits[:32])
-    payload_bits = out_bits[32:32 + payload_len * 8]
-    if len(payload_bits) < payload_len * 8:
-        raise RuntimeError("Извлечённых бит меньше, чем нужно по заголовку")
-
-    payload = bits_to_bytes(payload_bits)
-    return payload, rec.astype(np.uint8)
+    return out_bits, rec.astype(np.uint8)
 
 
 # ===================== PAYLOAD ДЛЯ >= 50% ЁМКОСТИ =====================
@@ -262,6 +299,57 @@ def list_images(folder: str) -> list[str]:
     out.sort()
     return out
 
+def research_image(idx: int, p: str) -> dict:
+    name = os.path.basename(p)
+    t0 = time.time()
+    try:
+        orig = to_gray(p)
+        h, w = orig.shape
+        cap_bits = estimate_capacity_bits(orig)
+
+        payload = make_payload_for_half_capacity(cap_bits, seed=idx * 1000 + 7)
+        total_bits = 32 + len(payload) * 8
+        bpp = total_bits / (h * w)
+
+        stego, meta = embed_variant2(orig, payload)
+        val_psnr = psnr(orig, stego)
+
+        extracted, recovered = extract_variant2(stego, meta)
+
+        restore_ok = bool(np.array_equal(orig, recovered))
+        extract_ok = bool(extracted == payload)
+
+        return {
+            "image": name,
+            "h": h,
+            "w": w,
+            "capacity_bits_est": cap_bits,
+            "embedded_bits": total_bits,
+            "embedded_bytes": len(payload),
+            "bpp": bpp,
+            "psnr": val_psnr,
+            "restore_ok": int(restore_ok),
+            "extract_ok": int(extract_ok),
+            "time_sec": time.time() - t0,
+            "error": ""
+        }
+
+    except Exception as e:
+        return {
+            "image": name,
+            "h": "",
+            "w": "",
+            "capacity_bits_est": "",
+            "embedded_bits": "",
+            "embedded_bytes": "",
+            "bpp": "",
+            "psnr": "",
+            "restore_ok": 0,
+            "extract_ok": 0,
+            "time_sec": time.time() - t0,
+            "error": str(e)
+        }
+
 def run_research_on_folder(folder: str, out_dir: str, limit: int = 20) -> dict:
     os.makedirs(out_dir, exist_ok=True)
 
@@ -269,70 +357,16 @@ def run_research_on_folder(folder: str, out_dir: str, limit: int = 20) -> dict:
     if not paths:
         raise RuntimeError("В папке нет изображений (png/bmp/jpg/tif).")
 
-    rows = []
-    psnrs = []
-    caps_bpp = []
-    ok_restore = 0
-    ok_extract = 0
+    # нативные функции отпускают GIL, поэтому изображения можно считать в потоках
+    workers = (os.cpu_count() or 1) if native is not None else 1
+    with ThreadPoolExecutor(max_workers=workers) as pool:
+        rows = list(pool.map(research_image, range(1, len(paths) + 1), paths))
 
-    for idx, p in enumerate(paths, 1):
-        name = os.path.basename(p)
-        t0 = time.time()
-        try:
-            orig = to_gray(p)
-            h, w = orig.shape
-            cap_bits = estimate_capacity_bits(orig)
-
-            payload = make_payload_for_half_capacity(cap_bits, seed=idx * 1000 + 7)
-            total_bits = 32 + len(payload) * 8
-            bpp = total_bits / (h * w)
-
-            stego, meta = embed_variant2(orig, payload)
-            val_psnr = psnr(orig, stego)
-
-            extracted, recovered = extract_variant2(stego, meta)
-
-            restore_ok = bool(np.array_equal(orig, recovered))
-            extract_ok = bool(extracted == payload)
-
-            if restore_ok:
-                ok_restore += 1
-            if extract_ok:
-                ok_extract += 1
-
-            psnrs.append(val_psnr)
-            caps_bpp.append(bpp)
-
-            rows.append({
-                "image": name,
-                "h": h,
-                "w": w,
-                "capacity_bits_est": cap_bits,
-                "embedded_bits": total_bits,
-                "embedded_bytes": len(payload),
-                "bpp": bpp,
-                "psnr": val_psnr,
-                "restore_ok": int(restore_ok),
-                "extract_ok": int(extract_ok),
-                "time_sec": time.time() - t0,
-                "error": ""
-            })
-
-        except Exception as e:
-            rows.append({
-                "image": name,
-                "h": "",
-                "w": "",
-                "capacity_bits_est": "",
-                "embedded_bits": "",
-                "embedded_bytes": "",
-                "bpp": "",
-                "psnr": "",
-                "restore_ok": 0,
-                "extract_ok": 0,
-                "time_sec": time.time() - t0,
-                "error": str(e)
-            })
+    ok_rows = [r for r in rows if not r["error"]]
+    psnrs = [r["psnr"] for r in ok_rows]
+    caps_bpp = [r["bpp"] for r in ok_rows]
+    ok_restore = sum(r["restore_ok"] for r in rows)
+    ok_extract = sum(r["extract_ok"] for r in rows)
 
     n = len(paths)
     psnr_mean, psnr_lo, psnr_hi = mean_ci95(psnrs)
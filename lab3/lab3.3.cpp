@@ -10,6 +10,15 @@
 #include <sstream>
 #include <algorithm>
 #include <cmath>
+#include <climits>
+#include <cstring>
+#include <thread>
+#include <atomic>
+
+#include "../lab1/artifactcache.h"
+#include "../lab1/boundedqueue.h"
+#include "../lab1/writesink.h"
+#include "../lab1/trace.h"
 
 namespace fs = std::filesystem;
 
@@ -78,26 +87,12 @@ private:
     bool writeBMP(const std::string& filename) {
         if (!loaded) return false;
 
-        int rowSize = (width * 8 + 31) / 32 * 4;
-        int dataSize = rowSize * height;
-        std::vector<uint8_t> rawData(dataSize, 0);
-
-        for (int y = 0; y < height; ++y) {
-            int dstY = (header.biHeight > 0) ? (height - 1 - y) : y;
-            for (int x = 0; x < width; ++x) {
-                rawData[dstY * rowSize + x] = pixels[y * width + x];
-            }
-        }
-
-        header.bfOffBits = sizeof(header) + 1024;
-        header.bfSize = header.bfOffBits + dataSize;
-        header.biSizeImage = dataSize;
+        std::vector<uint8_t> encoded(encodedSize());
+        encode(encoded.data());
 
         std::ofstream file(filename, std::ios::binary);
         if (!file) return false;
-        file.write(reinterpret_cast<char*>(&header), sizeof(header));
-        file.write(reinterpret_cast<char*>(palette.data()), 1024);
-        file.write(reinterpret_cast<char*>(rawData.data()), dataSize);
+        file.write(reinterpret_cast<char*>(encoded.data()), encoded.size());
         file.close();
         return true;
     }
@@ -108,6 +103,58 @@ public:
     bool load(const std::string& filename) { return readBMP(filename); }
     bool save(const std::string& filename) { return writeBMP(filename); }
 
+    size_t encodedSize() const {
+        int rowSize = (width * 8 + 31) / 32 * 4;
+        return sizeof(BMPHeader) + 1024 + static_cast<size_t>(rowSize) * height;
+    }
+
+    // Файл BMP целиком в out (encodedSize() байт), без промежуточных копий
+    void encode(uint8_t* out) const {
+        int rowSize = (width * 8 + 31) / 32 * 4;
+        int dataSize = rowSize * height;
+
+        BMPHeader h = header;
+        h.bfOffBits = sizeof(h) + 1024;
+        h.bfSize = h.bfOffBits + dataSize;
+        h.biSizeImage = dataSize;
+        std::memcpy(out, &h, sizeof(h));
+        std::memcpy(out + sizeof(h), palette.data(), 1024);
+
+        uint8_t* rawData = out + h.bfOffBits;
+        for (int y = 0; y < height; ++y) {
+            int dstY = (header.biHeight > 0) ? (height - 1 - y) : y;
+            std::memcpy(rawData + dstY * rowSize, pixels.data() + y * width, width);
+            std::memset(rawData + dstY * rowSize + width, 0, rowSize - width);
+        }
+    }
+
+    // Изображение из готовых отсчётов (сверху вниз), со стандартной серой
+    // палитрой - так читаются наборы из архива lab1/datapack
+    bool fromPixels(int w, int h, const uint8_t* src) {
+        int rowSize = (w * 8 + 31) / 32 * 4;
+        std::memset(&header, 0, sizeof(header));
+        header.bfType = 0x4D42;
+        header.bfOffBits = sizeof(header) + 1024;
+        header.bfSize = header.bfOffBits + rowSize * h;
+        header.biSize = 40;
+        header.biWidth = w;
+        header.biHeight = h;
+        header.biPlanes = 1;
+        header.biBitCount = 8;
+        header.biSizeImage = rowSize * h;
+        header.biClrUsed = 256;
+        palette.resize(1024);
+        for (int i = 0; i < 256; ++i) {
+            palette[i * 4 + 0] = palette[i * 4 + 1] = palette[i * 4 + 2] = static_cast<uint8_t>(i);
+            palette[i * 4 + 3] = 0;
+        }
+        width = w;
+        height = h;
+        pixels.assign(src, src + static_cast<size_t>(w) * h);
+        loaded = true;
+        return true;
+    }
+
     int getWidth() const { return width; }
     int getHeight() const { return height; }
     int getSize() const { return width * height; }
@@ -133,6 +180,7 @@ public:
 class Metrics {
 public:
     static double computePSNR(const GrayBMP& original, const GrayBMP& stego) {
+        TRACE_SCOPE_BYTES("metrics.psnr", 2 * original.getWidth() * original.getHeight());
         double mse = 0;
         int size = original.getWidth() * original.getHeight();
         const uint8_t* origPixels = original.data();
@@ -160,6 +208,7 @@ private:
     std::vector<PeakZeroPair> pairs;
     
     std::map<int, int> computeHistogram(const GrayBMP& image) {
+        TRACE_SCOPE_BYTES("hs.histogram", image.getWidth() * image.getHeight());
         std::map<int, int> hist;
         const uint8_t* pixels = image.data();
         int size = image.getWidth() * image.getHeight();
@@ -173,6 +222,7 @@ private:
     
     std::vector<PeakZeroPair> findPeakZeroPairs(const std::map<int, int>& hist, 
                                                  int requiredCapacity) {
+        TRACE_SCOPE("hs.pairsearch");
         std::vector<PeakZeroPair> pairs;
         
         std::vector<int> zeroPoints;
@@ -209,6 +259,52 @@ private:
         
         return pairs;
     }
+
+    ArtifactCache* cache = nullptr;
+    uint64_t lastKey = 0;
+    std::vector<PeakZeroPair> lastPairs;
+
+    // Все пары пик/ноль изображения (по отрезкам между нулями гистограммы) от
+    // данных не зависят: считаются один раз и берутся из кэша артефактов.
+    // Формат "hspairs1": тройки peak, zero, peakCount
+    std::vector<PeakZeroPair> allPeakZeroPairs(const GrayBMP& image) {
+        TRACE_SCOPE("hs.pairs");
+        if (!cache) return findPeakZeroPairs(computeHistogram(image), INT_MAX);
+
+        uint64_t key = ArtifactCache::key(image.data(), image.getWidth(), image.getHeight());
+        if (key == lastKey && key != 0) return lastPairs;
+
+        std::vector<int32_t> packed;
+        lastPairs.clear();
+        if (cache->load(key, "hspairs1", packed) && packed.size() % 3 == 0) {
+            for (size_t i = 0; i < packed.size(); i += 3) {
+                lastPairs.push_back({packed[i], packed[i + 1], packed[i + 2]});
+            }
+        } else {
+            lastPairs = findPeakZeroPairs(computeHistogram(image), INT_MAX);
+            packed.clear();
+            for (const auto& pair : lastPairs) {
+                packed.push_back(pair.peak);
+                packed.push_back(pair.zero);
+                packed.push_back(pair.peakCount);
+            }
+            cache->store(key, "hspairs1", packed);
+        }
+        lastKey = key;
+        return lastPairs;
+    }
+
+    // Начало списка пар, набирающее requiredCapacity - как findPeakZeroPairs
+    static std::vector<PeakZeroPair> takePairs(const std::vector<PeakZeroPair>& allPairs, int requiredCapacity) {
+        std::vector<PeakZeroPair> result;
+        int totalCapacity = 0;
+        for (const auto& pair : allPairs) {
+            if (totalCapacity >= requiredCapacity) break;
+            result.push_back(pair);
+            totalCapacity += pair.peakCount;
+        }
+        return result;
+    }
 public:    
     std::vector<uint8_t> readDataFromFile(const std::string& filename) {
         std::vector<uint8_t> data;
@@ -243,18 +339,19 @@ public:
     }
     
 public:
+    void setCache(ArtifactCache* artifactCache) { cache = artifactCache; }
+
     bool embed(GrayBMP& container, const std::vector<uint8_t>& data, 
                GrayBMP& stego, std::map<std::string, int>& metadata) {
-        
+        TRACE_SCOPE_BYTES("hs.embed", container.getWidth() * container.getHeight());
         int requiredCapacity = data.size() * 8;
-        auto hist = computeHistogram(container);
         int totalPixels = container.getWidth() * container.getHeight();
         if (requiredCapacity > totalPixels) {
             std::cerr << "Error: Data too large. Required: " << requiredCapacity 
                       << " bits, Available: " << totalPixels << " bits\n";
             return false;
         }
-        pairs = findPeakZeroPairs(hist, requiredCapacity);
+        pairs = takePairs(allPeakZeroPairs(container), requiredCapacity);
         if (pairs.empty()) {
             std::cerr << "Not enough capacity! Could not find suitable peak-zero pairs.\n";
             return false;
@@ -284,18 +381,22 @@ public:
             int zero = pair.zero;
             bool shiftRight = (zero > peak);
             
-            for (int i = 0; i < size; i++) {
-                if (shiftRight) {
-                    if (pixels[i] > peak && pixels[i] < zero) {
-                        pixels[i]++;
-                    }
-                } else {
-                    if (pixels[i] < peak && pixels[i] > zero) {
-                        pixels[i]--;
+            {
+                TRACE_SCOPE("hs.shift");
+                for (int i = 0; i < size; i++) {
+                    if (shiftRight) {
+                        if (pixels[i] > peak && pixels[i] < zero) {
+                            pixels[i]++;
+                        }
+                    } else {
+                        if (pixels[i] < peak && pixels[i] > zero) {
+                            pixels[i]--;
+                        }
                     }
                 }
             }
             
+            TRACE_SCOPE("hs.modulate");
             for (int i = 0; i < size && bitIndex < totalBits; i++) {
                 if (pixels[i] == peak) {
                     uint8_t bit = (data[bitIndex / 8] >> (7 - (bitIndex % 8))) & 1;
@@ -316,7 +417,7 @@ public:
     
     bool extract(const GrayBMP& stego, const std::map<std::string, int>& metadata,
                  std::vector<uint8_t>& extractedData, GrayBMP& restored) {
-        
+        TRACE_SCOPE_BYTES("hs.extract", stego.getWidth() * stego.getHeight());
         restored = stego.clone();
         uint8_t* pixels = restored.data();
         int size = restored.getWidth() * restored.getHeight();
@@ -336,25 +437,29 @@ public:
             int zero = pair.zero;
             bool shiftRight = (zero > peak);
             std::vector<int> extractedBits;
-            for (int i = 0; i < size; i++) {
-                if (shiftRight) {
-                    if (pixels[i] == peak + 1) {
-                        extractedBits.push_back(1);
-                        pixels[i] = peak;
-                    } else if (pixels[i] == peak) {
-                        extractedBits.push_back(0);
-                    }
-                } else {
-                    if (pixels[i] == peak - 1) {
-                        extractedBits.push_back(1);
-                        pixels[i] = peak;
-                    } else if (pixels[i] == peak) {
-                        extractedBits.push_back(0);
+            {
+                TRACE_SCOPE("hs.demodulate");
+                for (int i = 0; i < size; i++) {
+                    if (shiftRight) {
+                        if (pixels[i] == peak + 1) {
+                            extractedBits.push_back(1);
+                            pixels[i] = peak;
+                        } else if (pixels[i] == peak) {
+                            extractedBits.push_back(0);
+                        }
+                    } else {
+                        if (pixels[i] == peak - 1) {
+                            extractedBits.push_back(1);
+                            pixels[i] = peak;
+                        } else if (pixels[i] == peak) {
+                            extractedBits.push_back(0);
+                        }
                     }
                 }
+                bits.insert(bits.begin(), extractedBits.begin(), extractedBits.end());
             }
-            bits.insert(bits.begin(), extractedBits.begin(), extractedBits.end());
             
+            TRACE_SCOPE("hs.unshift");
             for (int i = 0; i < size; i++) {
                 if (shiftRight) {
                     if (pixels[i] > peak && pixels[i] <= zero) {
@@ -385,11 +490,24 @@ public:
         return true;
     }
     
-    void saveMetadata(const std::map<std::string, int>& metadata, const std::string& filename) {
-        std::ofstream file(filename);
+    // Файл пишется в двоичном режиме (в том числе через WriteSink), поэтому
+    // перевод строки - тот, что дал бы текстовый режим на этой платформе
+    std::string formatMetadata(const std::map<std::string, int>& metadata) {
+#ifdef _WIN32
+        const char* newline = "\r\n";
+#else
+        const char* newline = "\n";
+#endif
+        std::ostringstream text;
         for (const auto& item : metadata) {
-            file << item.first << " " << item.second << "\n";
+            text << item.first << " " << item.second << newline;
         }
+        return text.str();
+    }
+
+    void saveMetadata(const std::map<std::string, int>& metadata, const std::string& filename) {
+        std::ofstream file(filename, std::ios::binary);
+        file << formatMetadata(metadata);
         file.close();
     }
     
@@ -419,9 +537,140 @@ bool verifyData(const std::vector<uint8_t>& original, const std::vector<uint8_t>
     return true;
 }
 
-void testDataset(const std::string& datasetPath, const std::string& datasetName, 
+struct LoadedImage {
+    size_t index = 0;
+    std::string filename;
+    GrayBMP image;
+    bool ok = false;
+};
+
+struct OutputFile {
+    enum Kind { IMAGE, METADATA, DATA } kind = IMAGE;
+    std::string path;
+    GrayBMP image;
+    std::map<std::string, int> metadata;
+    std::vector<uint8_t> data;
+};
+
+struct ImageReport {
+    size_t index = 0;
+    std::string filename;
+    std::string console;
+    std::string results;
+    bool embedded = false;
+    double psnr = 0.0;
+};
+
+// Обработка одного изображения: всё, что раньше печаталось и сохранялось
+// по ходу, собирается в отчёт и задания на запись
+ImageReport processImage(HistogramShiftingEmbedder& embedder, LoadedImage& item,
+                         const std::vector<uint8_t>& testData, const std::string& datasetDir,
+                         BoundedQueue<OutputFile>& writeQueue) {
+    TRACE_SCOPE("process");
+    ImageReport report;
+    report.index = item.index;
+    report.filename = item.filename;
+    const std::string& filename = item.filename;
+    std::ostringstream console, results;
+
+    if (!item.ok) {
+        std::cerr << "  Failed to load image\n";
+        results << filename << ".bmp: FAILED (cannot load)\n";
+        report.results = results.str();
+        return report;
+    }
+    GrayBMP& container = item.image;
+
+    int requiredBits = testData.size() * 8;
+    int totalPixels = container.getWidth() * container.getHeight();
+
+    if (requiredBits > totalPixels) {
+        console << "  Skipping - image too small\n";
+        results << filename << ".bmp: SKIPPED (too small)\n";
+        report.console = console.str();
+        report.results = results.str();
+        return report;
+    }
+
+    GrayBMP stego;
+    std::map<std::string, int> metadata;
+
+    if (!embedder.embed(container, testData, stego, metadata)) {
+        std::cerr << "  Embedding failed\n";
+        results << filename << ".bmp: FAILED (embedding)\n";
+        report.results = results.str();
+        return report;
+    }
+
+    double psnr = Metrics::computePSNR(container, stego);
+    report.embedded = true;
+    report.psnr = psnr;
+
+    console << "  PSNR = " << std::fixed << std::setprecision(2) << psnr << " dB\n";
+    results << filename << ".bmp: PSNR = " << std::fixed << std::setprecision(2) << psnr << " dB\n";
+
+    GrayBMP restored;
+    std::vector<uint8_t> extractedData;
+    bool extracted = embedder.extract(stego, metadata, extractedData, restored);
+
+    OutputFile out;
+    out.kind = OutputFile::METADATA;
+    out.path = datasetDir + "/metadata/" + filename + "_metadata.txt";
+    out.metadata = metadata;
+    writeQueue.push(std::move(out));
+
+    out = OutputFile();
+    out.kind = OutputFile::IMAGE;
+    out.path = datasetDir + "/stego/" + filename + "_stego.bmp";
+    out.image = std::move(stego);
+    writeQueue.push(std::move(out));
+
+    if (!extracted) {
+        std::cerr << "  Extraction failed\n";
+        results << "  Extraction: FAILED\n";
+        report.console = console.str();
+        report.results = results.str();
+        return report;
+    }
+
+    std::string extractedPath = datasetDir + "/extracted/" + filename + "_extracted.txt";
+    console << "  Extracted data saved to: " << extractedPath << "\n";
+
+    if (verifyData(testData, extractedData)) {
+        console << "   Data successfully verified\n";
+        results << "  Extraction: SUCCESS (data matches)\n";
+    } else {
+        console << "   Data verification failed\n";
+        results << "  Extraction: FAILED (data mismatch)\n";
+    }
+
+    double restorePSNR = Metrics::computePSNR(container, restored);
+    if (restorePSNR > 99.0) {
+        console << "   Image perfectly restored\n";
+    } else {
+        console << "   Image restoration error: " << restorePSNR << " dB\n";
+    }
+
+    out = OutputFile();
+    out.kind = OutputFile::IMAGE;
+    out.path = datasetDir + "/restored/" + filename + "_restored.bmp";
+    out.image = std::move(restored);
+    writeQueue.push(std::move(out));
+
+    out = OutputFile();
+    out.kind = OutputFile::DATA;
+    out.path = extractedPath;
+    out.data = std::move(extractedData);
+    writeQueue.push(std::move(out));
+
+    report.console = console.str();
+    report.results = results.str();
+    return report;
+}
+
+bool testDataset(const std::string& datasetPath, const std::string& datasetName, 
                  const std::string& dataFilePath, const std::string& outputDir) {
-    
+    TRACE_SCOPE("dataset");
     std::cout << "\n========== Testing on " << datasetName << " dataset ==========\n";
     
     fs::create_directories(outputDir + "/" + datasetName + "/stego");
@@ -438,7 +687,7 @@ void testDataset(const std::string& datasetPath, const std::string& datasetName,
     std::vector<uint8_t> testData = embedder.readDataFromFile(dataFilePath);
     if (testData.empty()) {
         std::cerr << "Failed to read data file: " << dataFilePath << std::endl;
-        return;
+        return false;
     }
     
     std::cout << "Data file: " << dataFilePath << " (" << testData.size() << " bytes)\n";
@@ -448,88 +697,120 @@ void testDataset(const std::string& datasetPath, const std::string& datasetName,
     resultsFile << "Data file: " << dataFilePath << " (" << testData.size() << " bytes)\n";
     resultsFile << "========================================\n\n";
     
-    for (const auto& entry : fs::directory_iterator(datasetPath)) {
-        if (entry.path().extension() != ".bmp") continue;
-        
-        totalImages++;
-        std::string filename = entry.path().stem().string();
-        std::cout << "\n[" << totalImages << "] Processing: " << filename << ".bmp\n";
-        
-        GrayBMP container;
-        if (!container.load(entry.path().string())) {
-            std::cerr << "  Failed to load image\n";
-            resultsFile << filename << ".bmp: FAILED (cannot load)\n";
-            continue;
-        }
-        
-        int requiredBits = testData.size() * 8;
-        int totalPixels = container.getWidth() * container.getHeight();
-        
-        if (requiredBits > totalPixels) {
-            std::cout << "  Skipping - image too small\n";
-            resultsFile << filename << ".bmp: SKIPPED (too small)\n";
-            continue;
+    ImagePack pack;
+    bool packed = openSiblingPack(datasetPath, pack);
+    std::vector<fs::path> files;
+    if (packed) {
+        for (uint32_t i = 0; i < pack.size(); ++i) files.push_back(pack.name(i));
+    } else {
+        for (const auto& entry : fs::directory_iterator(datasetPath)) {
+            if (entry.path().extension() == ".bmp") files.push_back(entry.path());
         }
-        
-        GrayBMP stego;
-        std::map<std::string, int> metadata;
-        
-        if (!embedder.embed(container, testData, stego, metadata)) {
-            std::cerr << "  Embedding failed\n";
-            resultsFile << filename << ".bmp: FAILED (embedding)\n";
-            continue;
-        }
-        
-        double psnr = Metrics::computePSNR(container, stego);
-        psnrValues.push_back(psnr);
-        totalPSNR += psnr;
-        successCount++;
-        
-        std::cout << "  PSNR = " << std::fixed << std::setprecision(2) << psnr << " dB\n";
-        resultsFile << filename << ".bmp: PSNR = " << std::fixed << std::setprecision(2) << psnr << " dB\n";
-        
-        std::string stegoPath = outputDir + "/" + datasetName + "/stego/" + filename + "_stego.bmp";
-        stego.save(stegoPath);
-        
-        std::string metadataPath = outputDir + "/" + datasetName + "/metadata/" + filename + "_metadata.txt";
-        embedder.saveMetadata(metadata, metadataPath);
-        
-        GrayBMP restored;
-        std::vector<uint8_t> extractedData;
-        
-        if (!embedder.extract(stego, metadata, extractedData, restored)) {
-            std::cerr << "  Extraction failed\n";
-            resultsFile << "  Extraction: FAILED\n";
-            continue;
-        }
-        
-        std::string restoredPath = outputDir + "/" + datasetName + "/restored/" + filename + "_restored.bmp";
-        restored.save(restoredPath);
-        
-        std::string extractedPath = outputDir + "/" + datasetName + "/extracted/" + filename + "_extracted.txt";
-        if (embedder.writeDataToFile(extractedData, extractedPath)) {
-            std::cout << "  Extracted data saved to: " << extractedPath << "\n";
-        }
-        
-        if (verifyData(testData, extractedData)) {
-            std::cout << "   Data successfully verified\n";
-            resultsFile << "  Extraction: SUCCESS (data matches)\n";
-        } else {
-            std::cout << "   Data verification failed\n";
-            resultsFile << "  Extraction: FAILED (data mismatch)\n";
+    }
+
+    // Загрузка, встраивание/извлечение и запись идут в разных потоках через
+    // очереди фиксированной ёмкости; отчёт печатается в исходном порядке
+    const size_t PREFETCH = 4;
+    const size_t WRITE_BACKLOG = 16;
+    const int LOADERS = 2;
+    const int WORKERS = std::max(1u, std::thread::hardware_concurrency());
+
+    BoundedQueue<LoadedImage> loadQueue(PREFETCH);
+    BoundedQueue<OutputFile> writeQueue(WRITE_BACKLOG);
+    BoundedQueue<ImageReport> reportQueue(PREFETCH + WORKERS);
+    std::atomic<size_t> nextFile(0);
+    ArtifactCache artifacts("artifact_cache");
+
+    std::vector<std::thread> loaders;
+    for (int t = 0; t < LOADERS; ++t) {
+        loaders.emplace_back([&]() {
+            for (size_t i = nextFile++; i < files.size(); i = nextFile++) {
+                LoadedImage item;
+                item.index = i;
+                item.filename = files[i].stem().string();
+                {
+                    TRACE_SCOPE("load");
+                    if (packed) {
+                        const PackEntry& e = pack.entry(static_cast<uint32_t>(i));
+                        item.ok = item.image.fromPixels(e.width, e.height, pack.pixels(static_cast<uint32_t>(i)));
+                    } else {
+                        item.ok = item.image.load(files[i].string());
+                    }
+                }
+                if (!loadQueue.push(std::move(item))) break;
+            }
+        });
+    }
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < WORKERS; ++t) {
+        workers.emplace_back([&]() {
+            HistogramShiftingEmbedder worker;
+            worker.setCache(&artifacts);
+            LoadedImage item;
+            while (loadQueue.pop(item)) {
+                reportQueue.push(processImage(worker, item, testData, outputDir + "/" + datasetName, writeQueue));
+            }
+        });
+    }
+
+    WriteSink sink;
+    bool written = true;
+    std::thread writer([&]() {
+        HistogramShiftingEmbedder io;
+        OutputFile out;
+        while (writeQueue.pop(out)) {
+            TRACE_SCOPE("save");
+            if (out.kind == OutputFile::IMAGE) {
+                const GrayBMP& image = out.image;
+                sink.write(out.path, image.encodedSize(), [&](uint8_t* dst) { image.encode(dst); });
+            } else if (out.kind == OutputFile::METADATA) {
+                std::string text = io.formatMetadata(out.metadata);
+                sink.write(out.path, text.data(), text.size());
+            } else {
+                sink.write(out.path, out.data.data(), out.data.size());
+            }
         }
-        
-        double restorePSNR = Metrics::computePSNR(container, restored);
-        if (restorePSNR > 99.0) {
-            std::cout << "   Image perfectly restored\n";
-        } else {
-            std::cout << "   Image restoration error: " << restorePSNR << " dB\n";
+        written = sink.flush();
+    });
+
+    std::thread coordinator([&]() {
+        for (auto& th : loaders) th.join();
+        loadQueue.close();
+        for (auto& th : workers) th.join();
+        writeQueue.close();
+        reportQueue.close();
+    });
+
+    std::map<size_t, ImageReport> pending;
+    size_t nextReport = 0;
+    ImageReport report;
+    while (reportQueue.pop(report)) {
+        pending[report.index] = std::move(report);
+        for (auto it = pending.find(nextReport); it != pending.end(); it = pending.find(nextReport)) {
+            const ImageReport& r = it->second;
+            totalImages++;
+            std::cout << "\n[" << totalImages << "] Processing: " << r.filename << ".bmp\n" << r.console;
+            resultsFile << r.results;
+            if (r.embedded) {
+                psnrValues.push_back(r.psnr);
+                totalPSNR += r.psnr;
+                successCount++;
+            }
+            pending.erase(it);
+            nextReport++;
         }
     }
+    coordinator.join();
+    writer.join();
     
     resultsFile << "\n========================================\n";
     resultsFile << "Total images processed: " << totalImages << "\n";
     resultsFile << "Successfully embedded: " << successCount << "\n";
+    if (!written) {
+        resultsFile << "Output files: FAILED (some files were not written)\n";
+        std::cerr << "Some output files for " << datasetName << " were not written\n";
+    }
     
     if (successCount > 0) {
         double avgPSNR = totalPSNR / successCount;
@@ -555,6 +836,7 @@ void testDataset(const std::string& datasetPath, const std::string& datasetName,
     }
     
     resultsFile.close();
+    return written;
 }
 
 int main() {
@@ -580,9 +862,9 @@ int main() {
         std::cout << "Sample message.txt created.\n";
     }
     
-    testDataset(bossPath, "BOSS", dataFilePath, outputDir);
-    testDataset(medicalPath, "Medical", dataFilePath, outputDir);
-    testDataset(flowersPath, "Flowers", dataFilePath, outputDir);
+    bool ok = testDataset(bossPath, "BOSS", dataFilePath, outputDir);
+    ok &= testDataset(medicalPath, "Medical", dataFilePath, outputDir);
+    ok &= testDataset(flowersPath, "Flowers", dataFilePath, outputDir);
     
     std::ofstream summary(outputDir + "/summary.txt");
     summary << "========================================\n";
@@ -604,10 +886,11 @@ int main() {
     summary.close();
     
     std::cout << "\n========================================\n";
-    std::cout << "Testing complete!\n";
+    std::cout << (ok ? "Testing complete!\n" : "Testing complete with errors!\n");
     std::cout << "Results saved in: " << outputDir << "/\n";
     std::cout << "Summary: " << outputDir << "/summary.txt\n";
     std::cout << "========================================\n";
     
-    return 0;
+    TRACE_DUMP();
+    return ok ? 0 : 1;
 }
\ No newline at end of file
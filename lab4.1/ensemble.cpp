@@ -0,0 +1,458 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cmath>
+#include <random>
+#include <algorithm>
+#include <numeric>
+#include <iomanip>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <cerrno>
+#include <cstdlib>
+
+// Матрица признаков в формате features.cpp: "SFM1", uint32 rows, uint32 cols,
+// rows * cols float32; имена файлов - в <path>.names
+struct FeatureMatrixHeader {
+    char magic[4];
+    uint32_t rows;
+    uint32_t cols;
+};
+
+struct FeatureMatrix {
+    int rows = 0;
+    int cols = 0;
+    std::vector<float> data;
+    std::vector<std::string> names;
+
+    const float* row(int i) const { return data.data() + static_cast<size_t>(i) * cols; }
+};
+
+bool loadFeatureMatrix(const std::string& path, FeatureMatrix& m) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+    FeatureMatrixHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || std::string(header.magic, 4) != "SFM1") return false;
+
+    m.rows = header.rows;
+    m.cols = header.cols;
+    m.data.resize(static_cast<size_t>(m.rows) * m.cols);
+    file.read(reinterpret_cast<char*>(m.data.data()), m.data.size() * sizeof(float));
+    if (!file) return false;
+
+    m.names.clear();
+    std::ifstream list(path + ".names");
+    std::string name;
+    while (std::getline(list, name)) m.names.push_back(name);
+    if (static_cast<int>(m.names.size()) != m.rows) {
+        m.names.resize(m.rows);
+        for (int i = 0; i < m.rows; ++i) m.names[i] = std::to_string(i);
+    }
+    return true;
+}
+
+void parallelFor(int count, const std::function<void(int)>& task) {
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min(threads, std::max(count, 1));
+    std::atomic<int> next(0);
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; ++t) {
+        pool.emplace_back([&]() {
+            for (int i = next++; i < count; i = next++) {
+                task(i);
+            }
+        });
+    }
+    for (auto& th : pool) th.join();
+}
+
+class LinearAlgebra {
+public:
+    // S = X X^T для X размера d x n (строки - признаки, хранение по строкам).
+    // Считаются только блоки верхнего треугольника, тайлы 4 x 4 по (i, j) и
+    // полосы по n, чтобы строки X оставались в кэше; внутренний цикл -
+    // четыре скалярных произведения подряд, без BLAS.
+    static void gram(const double* X, int d, int n, double* S) {
+        const int TILE = 4;
+        const int CHUNK = 512;
+        std::fill(S, S + static_cast<size_t>(d) * d, 0.0);
+        for (int k0 = 0; k0 < n; k0 += CHUNK) {
+            int k1 = std::min(n, k0 + CHUNK);
+            for (int i0 = 0; i0 < d; i0 += TILE) {
+                int i1 = std::min(d, i0 + TILE);
+                for (int j0 = i0; j0 < d; j0 += TILE) {
+                    int j1 = std::min(d, j0 + TILE);
+                    for (int i = i0; i < i1; ++i) {
+                        const double* xi = X + static_cast<size_t>(i) * n;
+                        for (int j = std::max(j0, i); j < j1; ++j) {
+                            const double* xj = X + static_cast<size_t>(j) * n;
+                            double acc = 0.0;
+                            for (int k = k0; k < k1; ++k) acc += xi[k] * xj[k];
+                            S[static_cast<size_t>(i) * d + j] += acc;
+                        }
+                    }
+                }
+            }
+        }
+        for (int i = 0; i < d; ++i)
+            for (int j = 0; j < i; ++j)
+                S[static_cast<size_t>(i) * d + j] = S[static_cast<size_t>(j) * d + i];
+    }
+
+    // Решение S x = b разложением Холецкого; S портится
+    static bool choleskySolve(std::vector<double>& S, int d, const std::vector<double>& b, std::vector<double>& x) {
+        for (int j = 0; j < d; ++j) {
+            double sum = S[static_cast<size_t>(j) * d + j];
+            for (int k = 0; k < j; ++k) sum -= S[static_cast<size_t>(j) * d + k] * S[static_cast<size_t>(j) * d + k];
+            if (sum <= 0) return false;
+            double diag = std::sqrt(sum);
+            S[static_cast<size_t>(j) * d + j] = diag;
+            for (int i = j + 1; i < d; ++i) {
+                double s = S[static_cast<size_t>(i) * d + j];
+                const double* li = &S[static_cast<size_t>(i) * d];
+                const double* lj = &S[static_cast<size_t>(j) * d];
+                for (int k = 0; k < j; ++k) s -= li[k] * lj[k];
+                S[static_cast<size_t>(i) * d + j] = s / diag;
+            }
+        }
+        x = b;
+        for (int i = 0; i < d; ++i) {
+            double s = x[i];
+            for (int k = 0; k < i; ++k) s -= S[static_cast<size_t>(i) * d + k] * x[k];
+            x[i] = s / S[static_cast<size_t>(i) * d + i];
+        }
+        for (int i = d - 1; i >= 0; --i) {
+            double s = x[i];
+            for (int k = i + 1; k < d; ++k) s -= S[static_cast<size_t>(k) * d + i] * x[k];
+            x[i] = s / S[static_cast<size_t>(i) * d + i];
+        }
+        return true;
+    }
+};
+
+struct FLDLearner {
+    std::vector<uint32_t> subspace;
+    std::vector<double> w;
+    double threshold = 0.0;
+
+    double project(const float* x) const {
+        double s = 0.0;
+        for (size_t i = 0; i < subspace.size(); ++i) s += w[i] * x[subspace[i]];
+        return s;
+    }
+};
+
+const int MAX_LEARNERS = 10000;
+
+// Ансамбль линейных дискриминантов Фишера (Kodovsky, Fridrich, Holub):
+// каждый ученик обучается на случайном подпространстве признаков и
+// бутстрэп-выборке, решение - голосование большинством.
+class FLDEnsemble {
+private:
+    int dim = 0;
+    std::vector<FLDLearner> learners;
+
+    static FLDLearner trainLearner(const FeatureMatrix& cover, const std::vector<int>& coverIdx,
+                                   const FeatureMatrix& stego, const std::vector<int>& stegoIdx,
+                                   int dsub, uint32_t seed) {
+        FLDLearner learner;
+        std::mt19937 rng(seed);
+        int dimension = cover.cols;
+
+        std::vector<uint32_t> all(dimension);
+        std::iota(all.begin(), all.end(), 0);
+        for (int i = 0; i < dsub; ++i) {
+            std::uniform_int_distribution<int> pick(i, dimension - 1);
+            std::swap(all[i], all[pick(rng)]);
+        }
+        learner.subspace.assign(all.begin(), all.begin() + dsub);
+        std::sort(learner.subspace.begin(), learner.subspace.end());
+
+        auto bootstrap = [&](const std::vector<int>& idx) {
+            std::vector<int> sample(idx.size());
+            std::uniform_int_distribution<size_t> pick(0, idx.size() - 1);
+            for (auto& s : sample) s = idx[pick(rng)];
+            return sample;
+        };
+        std::vector<int> c = bootstrap(coverIdx);
+        std::vector<int> s = bootstrap(stegoIdx);
+        int nc = static_cast<int>(c.size()), ns = static_cast<int>(s.size());
+        int n = nc + ns;
+
+        // Центрированные выборки обоих классов, d x n по строкам
+        std::vector<double> X(static_cast<size_t>(dsub) * n);
+        std::vector<double> meanC(dsub, 0.0), meanS(dsub, 0.0);
+        for (int f = 0; f < dsub; ++f) {
+            uint32_t col = learner.subspace[f];
+            double* xf = X.data() + static_cast<size_t>(f) * n;
+            for (int i = 0; i < nc; ++i) xf[i] = cover.row(c[i])[col];
+            for (int i = 0; i < ns; ++i) xf[nc + i] = stego.row(s[i])[col];
+            for (int i = 0; i < nc; ++i) meanC[f] += xf[i];
+            for (int i = 0; i < ns; ++i) meanS[f] += xf[nc + i];
+            meanC[f] /= nc;
+            meanS[f] /= ns;
+            for (int i = 0; i < nc; ++i) xf[i] -= meanC[f];
+            for (int i = 0; i < ns; ++i) xf[nc + i] -= meanS[f];
+        }
+
+        std::vector<double> S(static_cast<size_t>(dsub) * dsub);
+        LinearAlgebra::gram(X.data(), dsub, n, S.data());
+
+        std::vector<double> diff(dsub);
+        double trace = 0.0;
+        for (int f = 0; f < dsub; ++f) {
+            diff[f] = meanS[f] - meanC[f];
+            trace += S[static_cast<size_t>(f) * dsub + f];
+        }
+
+        double lambda = 1e-10 * std::max(trace / dsub, 1e-12);
+        for (int attempt = 0; attempt < 12; ++attempt, lambda *= 10.0) {
+            std::vector<double> A = S;
+            for (int f = 0; f < dsub; ++f) A[static_cast<size_t>(f) * dsub + f] += lambda;
+            if (LinearAlgebra::choleskySolve(A, dsub, diff, learner.w)) break;
+            learner.w.assign(dsub, 0.0);
+        }
+
+        // Порог - минимум ошибки на обучающей выборке
+        std::vector<std::pair<double, int>> proj;
+        proj.reserve(n);
+        for (int i = 0; i < nc; ++i) proj.push_back({learner.project(cover.row(c[i])), 0});
+        for (int i = 0; i < ns; ++i) proj.push_back({learner.project(stego.row(s[i])), 1});
+        std::sort(proj.begin(), proj.end());
+
+        int fn = 0, tn = 0;
+        double bestError = 1.0;
+        learner.threshold = proj.front().first - 1.0;
+        for (int i = 0; i < n; ++i) {
+            if (proj[i].second) fn++; else tn++;
+            if (i + 1 < n && proj[i + 1].first == proj[i].first) continue;
+            double error = 0.5 * (static_cast<double>(nc - tn) / nc + static_cast<double>(fn) / ns);
+            if (error < bestError) {
+                bestError = error;
+                learner.threshold = (i + 1 < n) ? 0.5 * (proj[i].first + proj[i + 1].first) : proj[i].first + 1.0;
+            }
+        }
+        return learner;
+    }
+
+public:
+    void train(const FeatureMatrix& cover, const std::vector<int>& coverIdx,
+               const FeatureMatrix& stego, const std::vector<int>& stegoIdx,
+               int numLearners, int dsub, uint32_t seed) {
+        dim = cover.cols;
+        dsub = std::max(1, std::min(dsub, dim));
+        learners.assign(numLearners, FLDLearner());
+        parallelFor(numLearners, [&](int l) {
+            learners[l] = trainLearner(cover, coverIdx, stego, stegoIdx, dsub, seed + 7919u * l);
+        });
+    }
+
+    // Доля голосов "стего" минус доля "чисто", в [-1, 1]
+    double score(const float* x) const {
+        if (learners.empty()) return 0.0;
+        int votes = 0;
+        for (const auto& l : learners) votes += (l.project(x) > l.threshold) ? 1 : -1;
+        return static_cast<double>(votes) / learners.size();
+    }
+
+    bool save(const std::string& path) const {
+        std::ofstream file(path, std::ios::binary);
+        if (!file) return false;
+        uint32_t head[4] = {0x31534E45u, static_cast<uint32_t>(learners.size()),
+                            static_cast<uint32_t>(learners.empty() ? 0 : learners[0].subspace.size()),
+                            static_cast<uint32_t>(dim)};
+        file.write(reinterpret_cast<const char*>(head), sizeof(head));
+        for (const auto& l : learners) {
+            file.write(reinterpret_cast<const char*>(l.subspace.data()), l.subspace.size() * sizeof(uint32_t));
+            file.write(reinterpret_cast<const char*>(l.w.data()), l.w.size() * sizeof(double));
+            file.write(reinterpret_cast<const char*>(&l.threshold), sizeof(double));
+        }
+        return true;
+    }
+
+    bool load(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) return false;
+        uint32_t head[4];
+        file.read(reinterpret_cast<char*>(head), sizeof(head));
+        if (!file || head[0] != 0x31534E45u) return false;
+        // Те же пределы, что у L и dsub в командной строке; размер файла
+        // проверяется до выделения памяти, индексы - до чтения признаков в score
+        if (head[1] < 1 || head[1] > static_cast<uint32_t>(MAX_LEARNERS) || head[3] < 1 ||
+            head[3] > static_cast<uint32_t>(INT32_MAX) || head[2] < 1 || head[2] > head[3]) {
+            return false;
+        }
+        uint64_t expected = sizeof(head) + static_cast<uint64_t>(head[1]) *
+                                               (head[2] * (sizeof(uint32_t) + sizeof(double)) + sizeof(double));
+        file.seekg(0, std::ios::end);
+        if (!file || static_cast<uint64_t>(file.tellg()) != expected) return false;
+        file.seekg(sizeof(head));
+
+        std::vector<FLDLearner> loaded(head[1]);
+        for (auto& l : loaded) {
+            l.subspace.resize(head[2]);
+            l.w.resize(head[2]);
+            file.read(reinterpret_cast<char*>(l.subspace.data()), l.subspace.size() * sizeof(uint32_t));
+            file.read(reinterpret_cast<char*>(l.w.data()), l.w.size() * sizeof(double));
+            file.read(reinterpret_cast<char*>(&l.threshold), sizeof(double));
+            if (!file) return false;
+            for (uint32_t f : l.subspace) {
+                if (f >= head[3]) return false;
+            }
+        }
+        dim = static_cast<int>(head[3]);
+        learners = std::move(loaded);
+        return true;
+    }
+
+    int dimension() const { return dim; }
+    int size() const { return static_cast<int>(learners.size()); }
+};
+
+struct Evaluation {
+    int fp = 0, tn = 0, fn = 0, tp = 0;
+    double fpr() const { return (fp + tn) ? static_cast<double>(fp) / (fp + tn) : 0.0; }
+    double fnr() const { return (fn + tp) ? static_cast<double>(fn) / (fn + tp) : 0.0; }
+    double pe() const { return 0.5 * (fpr() + fnr()); }
+};
+
+Evaluation evaluate(const FLDEnsemble& ensemble, const FeatureMatrix& cover, const std::vector<int>& coverIdx,
+                    const FeatureMatrix& stego, const std::vector<int>& stegoIdx) {
+    Evaluation e;
+    for (int i : coverIdx) (ensemble.score(cover.row(i)) > 0 ? e.fp : e.tn)++;
+    for (int i : stegoIdx) (ensemble.score(stego.row(i)) > 0 ? e.tp : e.fn)++;
+    return e;
+}
+
+void printEvaluation(const Evaluation& e) {
+    std::cout << std::fixed << std::setprecision(4)
+              << "  FPR = " << e.fpr() << " (" << e.fp << "/" << (e.fp + e.tn) << ")\n"
+              << "  FNR = " << e.fnr() << " (" << e.fn << "/" << (e.fn + e.tp) << ")\n"
+              << "  P_E = " << e.pe() << "\n";
+}
+
+std::vector<int> allRows(const FeatureMatrix& m) {
+    std::vector<int> idx(m.rows);
+    std::iota(idx.begin(), idx.end(), 0);
+    return idx;
+}
+
+void printUsage() {
+    std::cout << "Usage:\n"
+              << "  ensemble train <cover.fea> <stego.fea> <model.ens> [L] [dsub] [seed]\n"
+              << "  ensemble eval  <cover.fea> <stego.fea> [L] [dsub] [seed]\n"
+              << "  ensemble score <model.ens> <features.fea> <scores.csv>\n"
+              << "1 <= L <= " << MAX_LEARNERS << ", dsub >= 1, seed >= 0\n";
+}
+
+// Целое без мусора в конце и в пределах [minValue, maxValue]
+bool parseInt(const char* text, long long minValue, long long maxValue, long long& value) {
+    char* end = nullptr;
+    errno = 0;
+    value = std::strtoll(text, &end, 10);
+    return end != text && *end == '\0' && errno == 0 && value >= minValue && value <= maxValue;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        printUsage();
+        return 1;
+    }
+    std::string mode = argv[1];
+
+    if (mode == "train" || mode == "eval") {
+        int base = (mode == "train") ? 5 : 4;
+        if (argc < base) {
+            std::cerr << "Not enough arguments\n";
+            return 1;
+        }
+        long long learnersArg = 51, dsubArg = 0, seedArg = 1;
+        if ((argc > base && !parseInt(argv[base], 1, MAX_LEARNERS, learnersArg)) ||
+            (argc > base + 1 && !parseInt(argv[base + 1], 1, INT32_MAX, dsubArg)) ||
+            (argc > base + 2 && !parseInt(argv[base + 2], 0, UINT32_MAX, seedArg))) {
+            printUsage();
+            return 2;
+        }
+        int numLearners = static_cast<int>(learnersArg);
+        uint32_t seed = static_cast<uint32_t>(seedArg);
+        FeatureMatrix cover, stego;
+        if (!loadFeatureMatrix(argv[2], cover) || !loadFeatureMatrix(argv[3], stego) || cover.cols != stego.cols) {
+            std::cerr << "Cannot read feature matrices\n";
+            return 1;
+        }
+        int dsub = (argc > base + 1) ? static_cast<int>(dsubArg) : std::min(cover.cols, 300);
+
+        std::vector<int> coverTrain = allRows(cover), stegoTrain = allRows(stego);
+        std::vector<int> coverTest, stegoTest;
+
+        if (mode == "eval") {
+            // Разбиение пополам по изображениям: пары cover/stego с одинаковым
+            // именем всегда попадают в одну и ту же часть
+            std::map<std::string, int> stegoByName;
+            for (int i = 0; i < stego.rows; ++i) stegoByName[stego.names[i]] = i;
+            std::vector<int> order = allRows(cover);
+            std::mt19937 rng(seed);
+            std::shuffle(order.begin(), order.end(), rng);
+            coverTrain.clear();
+            stegoTrain.clear();
+            for (size_t k = 0; k < order.size(); ++k) {
+                int i = order[k];
+                bool train = k < order.size() / 2;
+                (train ? coverTrain : coverTest).push_back(i);
+                auto it = stegoByName.find(cover.names[i]);
+                if (it != stegoByName.end()) (train ? stegoTrain : stegoTest).push_back(it->second);
+            }
+        }
+
+        if (coverTrain.empty() || stegoTrain.empty()) {
+            std::cerr << "Empty training set\n";
+            return 1;
+        }
+
+        FLDEnsemble ensemble;
+        std::cout << "Training " << numLearners << " FLD learners, d_sub = " << dsub
+                  << ", dim = " << cover.cols << ", " << coverTrain.size() << " + " << stegoTrain.size()
+                  << " samples\n";
+        ensemble.train(cover, coverTrain, stego, stegoTrain, numLearners, dsub, seed);
+
+        std::cout << "Training set:\n";
+        printEvaluation(evaluate(ensemble, cover, coverTrain, stego, stegoTrain));
+
+        if (mode == "eval") {
+            std::cout << "Test set:\n";
+            printEvaluation(evaluate(ensemble, cover, coverTest, stego, stegoTest));
+        } else if (!ensemble.save(argv[4])) {
+            std::cerr << "Cannot write model " << argv[4] << "\n";
+            return 1;
+        } else {
+            std::cout << "Model saved: " << argv[4] << "\n";
+        }
+        return 0;
+    }
+
+    if (mode == "score" && argc >= 5) {
+        FLDEnsemble ensemble;
+        FeatureMatrix features;
+        if (!ensemble.load(argv[2]) || !loadFeatureMatrix(argv[3], features)
+            || features.cols != ensemble.dimension()) {
+            std::cerr << "Cannot read model or features\n";
+            return 1;
+        }
+        std::ofstream out(argv[4]);
+        out << "file,ensemble_score,final\n";
+        for (int i = 0; i < features.rows; ++i) {
+            double s = ensemble.score(features.row(i));
+            out << features.names[i] << "," << s << "," << (s > 0 ? "stego" : "clean") << "\n";
+        }
+        std::cout << "Scored " << features.rows << " images -> " << argv[4] << "\n";
+        return 0;
+    }
+
+    std::cerr << "Unknown mode " << mode << "\n";
+    return 1;
+}
@@ -0,0 +1,436 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cmath>
+#include <filesystem>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <array>
+
+#include "../lab1/datapack.h"
+
+namespace fs = std::filesystem;
+
+#pragma pack(push, 1)
+struct BMPHeader {
+    uint16_t bfType;
+    uint32_t bfSize;
+    uint16_t bfReserved1;
+    uint16_t bfReserved2;
+    uint32_t bfOffBits;
+    uint32_t biSize;
+    int32_t  biWidth;
+    int32_t  biHeight;
+    uint16_t biPlanes;
+    uint16_t biBitCount;
+    uint32_t biCompression;
+    uint32_t biSizeImage;
+    int32_t  biXPelsPerMeter;
+    int32_t  biYPelsPerMeter;
+    uint32_t biClrUsed;
+    uint32_t biClrImportant;
+};
+#pragma pack(pop)
+
+class GrayBMP {
+private:
+    BMPHeader header;
+    std::vector<uint8_t> palette;
+    std::vector<uint8_t> pixels;
+    int width, height;
+    bool loaded;
+
+    bool readBMP(const std::string& filename) {
+        std::ifstream file(filename, std::ios::binary);
+        if (!file) return false;
+
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (header.bfType != 0x4D42 || header.biBitCount != 8)
+            return false;
+
+        width = header.biWidth;
+        height = std::abs(header.biHeight);
+
+        palette.resize(1024);
+        file.seekg(sizeof(header), std::ios::beg);
+        file.read(reinterpret_cast<char*>(palette.data()), 1024);
+
+        file.seekg(header.bfOffBits, std::ios::beg);
+        int rowSize = (width * 8 + 31) / 32 * 4;
+        int dataSize = rowSize * height;
+        std::vector<uint8_t> rawData(dataSize);
+        file.read(reinterpret_cast<char*>(rawData.data()), dataSize);
+
+        pixels.resize(width * height);
+        for (int y = 0; y < height; ++y) {
+            int srcY = (header.biHeight > 0) ? (height - 1 - y) : y;
+            for (int x = 0; x < width; ++x) {
+                pixels[y * width + x] = rawData[srcY * rowSize + x];
+            }
+        }
+        loaded = true;
+        file.close();
+        return true;
+    }
+
+public:
+    GrayBMP() : loaded(false), width(0), height(0) {}
+
+    bool load(const std::string& filename) { return readBMP(filename); }
+
+    // Отсчёты сверху вниз из архива lab1/datapack; признакам заголовок не нужен
+    bool fromPixels(int w, int h, const uint8_t* src) {
+        width = w;
+        height = h;
+        pixels.assign(src, src + static_cast<size_t>(w) * h);
+        loaded = true;
+        return true;
+    }
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    int getSize() const { return width * height; }
+
+    uint8_t* data() { return pixels.data(); }
+    const uint8_t* data() const { return pixels.data(); }
+};
+
+
+// Признаки SPAM (Pevny, Bas, Fridrich): марковские переходы второго порядка
+// для усеченных разностей соседних пикселей, T = 3, 2 * 7^3 = 686 признаков.
+class SPAMExtractor {
+public:
+    static constexpr int T = 3;
+    static constexpr int BINS = (2 * T + 1) * (2 * T + 1) * (2 * T + 1);
+    static constexpr int DIM = 2 * BINS;
+
+    void extract(const GrayBMP& img, float* out) const {
+        // Прямые направления: ->, v, диагональ вниз-вправо, диагональ вниз-влево.
+        // Обратные (<-, ^, ...) получаются из тех же гистограмм: тройка (a, b, c)
+        // в обратном направлении - это тройка (-c, -b, -a) в прямом.
+        std::array<std::vector<uint32_t>, 4> hist;
+        const int dirs[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+        for (int d = 0; d < 4; ++d) {
+            hist[d] = cooccurrence(img, dirs[d][0], dirs[d][1]);
+        }
+
+        std::vector<float> forward(BINS), backward(BINS);
+        std::fill(out, out + DIM, 0.0f);
+        for (int d = 0; d < 4; ++d) {
+            std::vector<uint32_t> reversed(BINS);
+            for (int i = 0; i < BINS; ++i) reversed[mirror(i)] = hist[d][i];
+            transitions(hist[d], forward.data());
+            transitions(reversed, backward.data());
+            float* dst = out + (d < 2 ? 0 : BINS);
+            for (int i = 0; i < BINS; ++i) dst[i] += 0.25f * (forward[i] + backward[i]);
+        }
+    }
+
+private:
+    static int mirror(int idx) {
+        const int n = 2 * T + 1;
+        int a = idx / (n * n), b = (idx / n) % n, c = idx % n;
+        return ((n - 1 - c) * n + (n - 1 - b)) * n + (n - 1 - a);
+    }
+
+    // Гистограмма троек усеченных разностей D(i,j) = I(i,j) - I(i+dy, j+dx)
+    // вдоль направления (dy, dx)
+    static std::vector<uint32_t> cooccurrence(const GrayBMP& img, int dy, int dx) {
+        const int n = 2 * T + 1;
+        int w = img.getWidth();
+        int h = img.getHeight();
+        const uint8_t* pixels = img.data();
+        std::vector<uint32_t> hist(BINS, 0);
+
+        // D определена для y в [0, h - dy), x в [x0, x1)
+        int x0 = std::max(0, -dx), x1 = w - std::max(0, dx);
+        int rows = h - dy;
+        if (x1 - x0 < 3 || rows < 3) return hist;
+
+        std::vector<int8_t> diff(static_cast<size_t>(rows) * w, 0);
+        for (int y = 0; y < rows; ++y) {
+            const uint8_t* a = pixels + static_cast<size_t>(y) * w;
+            const uint8_t* b = pixels + static_cast<size_t>(y + dy) * w + dx;
+            int8_t* dst = diff.data() + static_cast<size_t>(y) * w;
+            for (int x = x0; x < x1; ++x) {
+                int v = a[x] - b[x];
+                v = v < -T ? -T : (v > T ? T : v);
+                dst[x] = static_cast<int8_t>(v + T);
+            }
+        }
+
+        // Тройки (D(p), D(p + s), D(p + 2s)), s = (dy, dx)
+        int step = dy * w + dx;
+        std::vector<int16_t> idx(w);
+        for (int y = 0; y + 2 * dy < rows; ++y) {
+            int xa = x0 + std::max(0, -2 * dx);
+            int xb = x1 - std::max(0, 2 * dx);
+            const int8_t* p = diff.data() + static_cast<size_t>(y) * w;
+            for (int x = xa; x < xb; ++x) {
+                idx[x] = static_cast<int16_t>((p[x] * n + p[x + step]) * n + p[x + 2 * step]);
+            }
+            for (int x = xa; x < xb; ++x) hist[idx[x]]++;
+        }
+        return hist;
+    }
+
+    static void transitions(const std::vector<uint32_t>& hist, float* out) {
+        const int n = 2 * T + 1;
+        for (int ab = 0; ab < n * n; ++ab) {
+            uint64_t total = 0;
+            for (int c = 0; c < n; ++c) total += hist[ab * n + c];
+            for (int c = 0; c < n; ++c) {
+                out[ab * n + c] = total ? static_cast<float>(hist[ab * n + c]) / total : 0.0f;
+            }
+        }
+    }
+};
+
+// Сокращенное подмножество SRM (Fridrich, Kodovsky): остатки 1, 2, 3 порядка
+// и 3x3 KB, квантование q = c, усечение T = 2, совместная гистограмма четверок
+// вдоль направления остатка с симметризацией по знаку и направлению
+// (625 -> 169 ячеек на подмодель).
+class SRMSubsetExtractor {
+public:
+    static constexpr int T = 2;
+    static constexpr int SUBMODELS = 4;
+
+    SRMSubsetExtractor() {
+        const int n = 2 * T + 1;
+        std::vector<int> canon(n * n * n * n, -1);
+        symIndex.assign(n * n * n * n, 0);
+        int next = 0;
+        for (int i = 0; i < n * n * n * n; ++i) {
+            int c[4] = {i / (n * n * n), (i / (n * n)) % n, (i / n) % n, i % n};
+            int variants[4];
+            variants[0] = i;
+            variants[1] = encode(n - 1 - c[0], n - 1 - c[1], n - 1 - c[2], n - 1 - c[3]);
+            variants[2] = encode(c[3], c[2], c[1], c[0]);
+            variants[3] = encode(n - 1 - c[3], n - 1 - c[2], n - 1 - c[1], n - 1 - c[0]);
+            int rep = *std::min_element(variants, variants + 4);
+            if (canon[rep] < 0) canon[rep] = next++;
+            symIndex[i] = canon[rep];
+        }
+        bins = next;
+    }
+
+    int dim() const { return SUBMODELS * bins; }
+
+    void extract(const GrayBMP& img, float* out) const {
+        int w = img.getWidth();
+        int h = img.getHeight();
+        std::fill(out, out + dim(), 0.0f);
+        if (w < 8 || h < 8) return;
+
+        std::vector<int8_t> res(static_cast<size_t>(w) * h);
+        std::vector<uint32_t> hist(static_cast<size_t>(bins));
+
+        for (int model = 0; model < SUBMODELS; ++model) {
+            std::fill(hist.begin(), hist.end(), 0);
+            if (model < 3) {
+                // Горизонтальный остаток со сканированием по строкам +
+                // вертикальный остаток со сканированием по столбцам
+                residual(img, model, false, res.data());
+                accumulate(res.data(), w, h, 1, hist.data());
+                residual(img, model, true, res.data());
+                accumulate(res.data(), w, h, w, hist.data());
+            } else {
+                residual(img, model, false, res.data());
+                accumulate(res.data(), w, h, 1, hist.data());
+                accumulate(res.data(), w, h, w, hist.data());
+            }
+            uint64_t total = 0;
+            for (uint32_t v : hist) total += v;
+            float* dst = out + model * bins;
+            for (int i = 0; i < bins; ++i) dst[i] = total ? static_cast<float>(hist[i]) / total : 0.0f;
+        }
+    }
+
+private:
+    std::vector<int> symIndex;
+    int bins = 0;
+
+    static int encode(int a, int b, int c, int d) {
+        const int n = 2 * T + 1;
+        return ((a * n + b) * n + c) * n + d;
+    }
+
+    static int8_t quantize(int r, int q) {
+        // round(r / q) для q > 0 с усечением в [-T, T]
+        int v = (r >= 0) ? (2 * r + q) / (2 * q) : -((-2 * r + q) / (2 * q));
+        v = v < -T ? -T : (v > T ? T : v);
+        return static_cast<int8_t>(v + T);
+    }
+
+    // Остатки считаются для x, y в [2, w-3] x [2, h-3]; остальное - центр (0)
+    static void residual(const GrayBMP& img, int model, bool vertical, int8_t* out) {
+        int w = img.getWidth();
+        int h = img.getHeight();
+        const uint8_t* p = img.data();
+        std::fill(out, out + static_cast<size_t>(w) * h, static_cast<int8_t>(T));
+        int s = vertical ? w : 1;
+        for (int y = 2; y < h - 2; ++y) {
+            const uint8_t* r = p + static_cast<size_t>(y) * w;
+            int8_t* o = out + static_cast<size_t>(y) * w;
+            switch (model) {
+            case 0:
+                for (int x = 2; x < w - 2; ++x) o[x] = quantize(r[x + s] - r[x], 1);
+                break;
+            case 1:
+                for (int x = 2; x < w - 2; ++x) o[x] = quantize(r[x - s] + r[x + s] - 2 * r[x], 2);
+                break;
+            case 2:
+                for (int x = 2; x < w - 2; ++x)
+                    o[x] = quantize(-r[x - s] + 3 * r[x] - 3 * r[x + s] + r[x + 2 * s], 3);
+                break;
+            default:
+                for (int x = 2; x < w - 2; ++x) {
+                    int v = -r[x - w - 1] + 2 * r[x - w] - r[x - w + 1]
+                          + 2 * r[x - 1] - 4 * r[x] + 2 * r[x + 1]
+                          - r[x + w - 1] + 2 * r[x + w] - r[x + w + 1];
+                    o[x] = quantize(v, 4);
+                }
+                break;
+            }
+        }
+    }
+
+    void accumulate(const int8_t* res, int w, int h, int step, uint32_t* hist) const {
+        const int n = 2 * T + 1;
+        std::vector<int16_t> idx(w);
+        bool vertical = step != 1;
+        int yEnd = vertical ? h - 2 - 3 : h - 2;
+        int xEnd = vertical ? w - 2 : w - 2 - 3;
+        for (int y = 2; y < yEnd; ++y) {
+            const int8_t* r = res + static_cast<size_t>(y) * w;
+            for (int x = 2; x < xEnd; ++x) {
+                idx[x] = static_cast<int16_t>(((r[x] * n + r[x + step]) * n + r[x + 2 * step]) * n
+                                              + r[x + 3 * step]);
+            }
+            for (int x = 2; x < xEnd; ++x) hist[symIndex[idx[x]]]++;
+        }
+    }
+};
+
+// Бинарная матрица признаков: "SFM1", uint32 rows, uint32 cols, затем rows * cols
+// float32 по строкам. Имена файлов - в соседнем текстовом файле <path>.names.
+struct FeatureMatrixHeader {
+    char magic[4];
+    uint32_t rows;
+    uint32_t cols;
+};
+
+bool saveFeatureMatrix(const std::string& path, const std::vector<std::string>& names,
+                       const std::vector<float>& data, int cols) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) return false;
+    FeatureMatrixHeader header{{'S', 'F', 'M', '1'}, static_cast<uint32_t>(names.size()),
+                               static_cast<uint32_t>(cols)};
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(float));
+    file.close();
+
+    std::ofstream list(path + ".names");
+    for (const auto& name : names) list << name << "\n";
+    return true;
+}
+
+void parallelFor(int count, const std::function<void(int)>& task) {
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min(threads, std::max(count, 1));
+    std::atomic<int> next(0);
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; ++t) {
+        pool.emplace_back([&]() {
+            for (int i = next++; i < count; i = next++) {
+                task(i);
+            }
+        });
+    }
+    for (auto& th : pool) th.join();
+}
+
+std::vector<std::string> collectImages(const std::string& folder) {
+    std::vector<std::string> files;
+    if (!fs::exists(folder)) return files;
+    for (const auto& entry : fs::directory_iterator(folder)) {
+        if (!entry.is_regular_file()) continue;
+        std::string ext = entry.path().extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        if (ext == ".bmp") files.push_back(entry.path().string());
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cout << "Usage: features <image folder> <output.fea> [spam|srm|all]\n";
+        return 1;
+    }
+    std::string folder = argv[1];
+    std::string outPath = argv[2];
+    std::string set = (argc > 3) ? argv[3] : "all";
+
+    bool useSpam = (set == "spam" || set == "all");
+    bool useSrm = (set == "srm" || set == "all");
+
+    SPAMExtractor spam;
+    SRMSubsetExtractor srm;
+    int cols = (useSpam ? SPAMExtractor::DIM : 0) + (useSrm ? srm.dim() : 0);
+
+    ImagePack pack;
+    bool packed = openSiblingPack(folder, pack);
+    std::vector<std::string> files;
+    if (packed) {
+        for (uint32_t i = 0; i < pack.size(); ++i) files.push_back((fs::path(folder) / pack.name(i)).string());
+    } else {
+        files = collectImages(folder);
+    }
+    if (files.empty()) {
+        std::cout << "No images found in " << folder << "\n";
+        return 1;
+    }
+
+    std::vector<float> data(files.size() * cols, 0.0f);
+    std::vector<uint8_t> ok(files.size(), 0);
+    parallelFor(static_cast<int>(files.size()), [&](int i) {
+        GrayBMP img;
+        if (packed) {
+            const PackEntry& e = pack.entry(static_cast<uint32_t>(i));
+            img.fromPixels(e.width, e.height, pack.pixels(static_cast<uint32_t>(i)));
+        } else if (!img.load(files[i])) {
+            return;
+        }
+        float* row = data.data() + static_cast<size_t>(i) * cols;
+        if (useSpam) {
+            spam.extract(img, row);
+            row += SPAMExtractor::DIM;
+        }
+        if (useSrm) srm.extract(img, row);
+        ok[i] = 1;
+    });
+
+    std::vector<std::string> names;
+    std::vector<float> rows;
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (!ok[i]) {
+            std::cerr << "Failed to load " << files[i] << "\n";
+            continue;
+        }
+        names.push_back(fs::path(files[i]).filename().string());
+        rows.insert(rows.end(), data.begin() + i * cols, data.begin() + (i + 1) * cols);
+    }
+
+    if (!saveFeatureMatrix(outPath, names, rows, cols)) {
+        std::cerr << "Cannot write " << outPath << "\n";
+        return 1;
+    }
+    std::cout << "Extracted " << names.size() << " x " << cols << " features from " << folder
+              << " -> " << outPath << "\n";
+    return 0;
+}
@@ -0,0 +1,865 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cmath>
+#include <filesystem>
+#include <algorithm>
+#include <iomanip>
+#include <thread>
+#include <atomic>
+#include <functional>
+
+#include "../lab1/datapack.h"
+
+namespace fs = std::filesystem;
+
+#pragma pack(push, 1)
+struct BMPHeader {
+    uint16_t bfType;
+    uint32_t bfSize;
+    uint16_t bfReserved1;
+    uint16_t bfReserved2;
+    uint32_t bfOffBits;
+    uint32_t biSize;
+    int32_t  biWidth;
+    int32_t  biHeight;
+    uint16_t biPlanes;
+    uint16_t biBitCount;
+    uint32_t biCompression;
+    uint32_t biSizeImage;
+    int32_t  biXPelsPerMeter;
+    int32_t  biYPelsPerMeter;
+    uint32_t biClrUsed;
+    uint32_t biClrImportant;
+};
+#pragma pack(pop)
+
+class GrayBMP {
+private:
+    BMPHeader header;
+    std::vector<uint8_t> palette;
+    std::vector<uint8_t> pixels;
+    const uint8_t* external = nullptr;
+    int width, height;
+    bool loaded;
+
+    bool readBMP(const std::string& filename) {
+        std::ifstream file(filename, std::ios::binary);
+        if (!file) return false;
+
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (header.bfType != 0x4D42 || header.biBitCount != 8)
+            return false;
+
+        width = header.biWidth;
+        height = std::abs(header.biHeight);
+
+        palette.resize(1024);
+        file.seekg(sizeof(header), std::ios::beg);
+        file.read(reinterpret_cast<char*>(palette.data()), 1024);
+
+        file.seekg(header.bfOffBits, std::ios::beg);
+        int rowSize = (width * 8 + 31) / 32 * 4;
+        int dataSize = rowSize * height;
+        std::vector<uint8_t> rawData(dataSize);
+        file.read(reinterpret_cast<char*>(rawData.data()), dataSize);
+
+        pixels.resize(width * height);
+        for (int y = 0; y < height; ++y) {
+            int srcY = (header.biHeight > 0) ? (height - 1 - y) : y;
+            for (int x = 0; x < width; ++x) {
+                pixels[y * width + x] = rawData[srcY * rowSize + x];
+            }
+        }
+        loaded = true;
+        file.close();
+        return true;
+    }
+
+public:
+    GrayBMP() : loaded(false), width(0), height(0) {}
+
+    bool load(const std::string& filename) { return readBMP(filename); }
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    int getSize() const { return width * height; }
+
+    // Изображение поверх чужого буфера без копирования (модуль stegonative),
+    // буфер должен жить дольше GrayBMP
+    static GrayBMP view(const uint8_t* data, int w, int h) {
+        GrayBMP img;
+        img.external = data;
+        img.width = w;
+        img.height = h;
+        img.loaded = true;
+        return img;
+    }
+
+    uint8_t* data() { return pixels.data(); }
+    const uint8_t* data() const { return external ? external : pixels.data(); }
+};
+
+// Форма группы пикселей для RS-анализа: смещения (dx, dy) в порядке обхода,
+// по которому считается гладкость, и размер ограничивающего прямоугольника,
+// которым группы замощают изображение.
+struct GroupShape {
+    std::string name;
+    int width;
+    int height;
+    std::vector<std::pair<int, int>> offsets;
+
+    int size() const { return static_cast<int>(offsets.size()); }
+
+    static GroupShape row(int n) {
+        GroupShape shape{"row" + std::to_string(n), n, 1, {}};
+        for (int i = 0; i < n; ++i) shape.offsets.push_back({i, 0});
+        return shape;
+    }
+
+    // n x n блок, обход "змейкой" (соседние элементы обхода всегда соседние пиксели)
+    static GroupShape block(int n) {
+        GroupShape shape{"block" + std::to_string(n) + "x" + std::to_string(n), n, n, {}};
+        for (int y = 0; y < n; ++y) {
+            for (int i = 0; i < n; ++i) {
+                int x = (y % 2 == 0) ? i : n - 1 - i;
+                shape.offsets.push_back({x, y});
+            }
+        }
+        return shape;
+    }
+
+    // n x n блок, зигзаг-обход как в JPEG
+    static GroupShape zigzag(int n) {
+        GroupShape shape{"zigzag" + std::to_string(n) + "x" + std::to_string(n), n, n, {}};
+        for (int s = 0; s < 2 * n - 1; ++s) {
+            for (int i = 0; i <= s; ++i) {
+                int a = (s % 2 == 0) ? s - i : i;
+                int b = s - a;
+                if (a < n && b < n) shape.offsets.push_back({b, a});
+            }
+        }
+        return shape;
+    }
+};
+
+struct RSCounts {
+    long long R = 0;
+    long long S = 0;
+    long long U = 0;
+
+    long long total() const { return R + S + U; }
+    double rPct() const { return total() ? 100.0 * R / total() : 0.0; }
+    double sPct() const { return total() ? 100.0 * S / total() : 0.0; }
+};
+
+struct RSResult {
+    // [маска][0 - исходное изображение, 1 - с инвертированными НЗБ][0 - M, 1 - -M]
+    RSCounts counts[2][2][2];
+    double maskEstimate[2] = {0.0, 0.0};
+    double embeddingPercent = 0.0;
+    long long groups = 0;
+};
+
+class RSAnalyzer {
+private:
+    GroupShape shape;
+    std::vector<uint8_t> masks[2];
+    int16_t flipPos[256];      // F1:  0<->1, 2<->3, ...
+    int16_t flipNeg[256];      // F-1: -1<->0, 1<->2, ...
+    int16_t flipNegPos[256];   // F-1(F1(x))
+
+    static void classify(const int32_t* fOrig, const int32_t* fMod, int n, RSCounts& c) {
+        long long r = 0, s = 0;
+        for (int g = 0; g < n; ++g) {
+            r += fMod[g] > fOrig[g];
+            s += fMod[g] < fOrig[g];
+        }
+        c.R += r;
+        c.S += s;
+        c.U += n - r - s;
+    }
+
+    // Гладкость f = sum |a_k - a_(k-1)|; для каждой позиции обхода берется
+    // либо плоскость "без маски", либо "с маской" в зависимости от бита маски.
+    static void smoothness(const std::vector<std::vector<int16_t>>& plain,
+                           const std::vector<std::vector<int16_t>>& masked,
+                           const std::vector<uint8_t>& mask, int n, int32_t* f) {
+        std::fill(f, f + n, 0);
+        int k = static_cast<int>(plain.size());
+        for (int i = 1; i < k; ++i) {
+            const int16_t* a = (mask[i - 1] ? masked : plain)[i - 1].data();
+            const int16_t* b = (mask[i] ? masked : plain)[i].data();
+            for (int g = 0; g < n; ++g) {
+                f[g] += std::abs(b[g] - a[g]);
+            }
+        }
+    }
+
+    static double solveEstimate(const RSResult& res, int m) {
+        double total = static_cast<double>(res.groups);
+        if (total <= 0) return 0.0;
+        const RSCounts& cm = res.counts[m][0][0];
+        const RSCounts& cmNeg = res.counts[m][0][1];
+        const RSCounts& fm = res.counts[m][1][0];
+        const RSCounts& fmNeg = res.counts[m][1][1];
+
+        double d0 = (cm.R - cm.S) / total;
+        double dm0 = (cmNeg.R - cmNeg.S) / total;
+        double d1 = (fm.R - fm.S) / total;
+        double dm1 = (fmNeg.R - fmNeg.S) / total;
+
+        double a = 2.0 * (d1 + d0);
+        double b = dm0 - dm1 - d1 - 3.0 * d0;
+        double c = d0 - dm0;
+
+        double z;
+        if (std::abs(a) < 1e-12) {
+            if (std::abs(b) < 1e-12) return 0.0;
+            z = -c / b;
+        } else {
+            double disc = b * b - 4.0 * a * c;
+            if (disc < 0) disc = 0;
+            double z1 = (-b + std::sqrt(disc)) / (2.0 * a);
+            double z2 = (-b - std::sqrt(disc)) / (2.0 * a);
+            z = (std::abs(z1) < std::abs(z2)) ? z1 : z2;
+        }
+        if (std::abs(z - 0.5) < 1e-12) return 0.0;
+        return z / (z - 0.5);
+    }
+
+public:
+    explicit RSAnalyzer(const GroupShape& groupShape = GroupShape::row(4)) : shape(groupShape) {
+        int n = shape.size();
+        masks[0].resize(n);
+        masks[1].resize(n);
+        for (int k = 0; k < n; ++k) {
+            masks[0][k] = ((k + 1) >> 1) & 1;   // 0 1 1 0 0 1 1 0 ...
+            masks[1][k] = 1 - masks[0][k];      // 1 0 0 1 1 0 0 1 ...
+        }
+        for (int v = 0; v < 256; ++v) {
+            flipPos[v] = static_cast<int16_t>(v ^ 1);
+            flipNeg[v] = static_cast<int16_t>(((v + 1) ^ 1) - 1);
+            flipNegPos[v] = static_cast<int16_t>(((flipPos[v] + 1) ^ 1) - 1);
+        }
+    }
+
+    const GroupShape& getShape() const { return shape; }
+
+    RSResult analyze(const GrayBMP& img) const {
+        RSResult res;
+        int w = img.getWidth();
+        int h = img.getHeight();
+        int k = shape.size();
+        int groupsX = w / shape.width;
+        int groupsY = h / shape.height;
+        if (groupsX == 0 || groupsY == 0 || k < 2) return res;
+
+        const uint8_t* pixels = img.data();
+
+        // Плоскости значений по позициям обхода (SoA по группам одной полосы):
+        // x, F1(x), F-1(x), F-1(F1(x)).
+        std::vector<std::vector<int16_t>> v(k, std::vector<int16_t>(groupsX));
+        std::vector<std::vector<int16_t>> p(k, std::vector<int16_t>(groupsX));
+        std::vector<std::vector<int16_t>> q(k, std::vector<int16_t>(groupsX));
+        std::vector<std::vector<int16_t>> qp(k, std::vector<int16_t>(groupsX));
+
+        std::vector<int32_t> fCover(groupsX), fFlipped(groupsX), fMod(groupsX);
+        const std::vector<uint8_t> none(k, 0);
+
+        for (int gy = 0; gy < groupsY; ++gy) {
+            for (int i = 0; i < k; ++i) {
+                const uint8_t* src = pixels + (gy * shape.height + shape.offsets[i].second) * w
+                                   + shape.offsets[i].first;
+                int16_t* vi = v[i].data();
+                int16_t* pi = p[i].data();
+                int16_t* qi = q[i].data();
+                int16_t* qpi = qp[i].data();
+                for (int g = 0; g < groupsX; ++g) {
+                    uint8_t x = src[g * shape.width];
+                    vi[g] = x;
+                    pi[g] = flipPos[x];
+                    qi[g] = flipNeg[x];
+                    qpi[g] = flipNegPos[x];
+                }
+            }
+
+            smoothness(v, v, none, groupsX, fCover.data());
+            smoothness(p, p, none, groupsX, fFlipped.data());
+
+            for (int m = 0; m < 2; ++m) {
+                smoothness(v, p, masks[m], groupsX, fMod.data());
+                classify(fCover.data(), fMod.data(), groupsX, res.counts[m][0][0]);
+                smoothness(v, q, masks[m], groupsX, fMod.data());
+                classify(fCover.data(), fMod.data(), groupsX, res.counts[m][0][1]);
+                smoothness(p, v, masks[m], groupsX, fMod.data());
+                classify(fFlipped.data(), fMod.data(), groupsX, res.counts[m][1][0]);
+                smoothness(p, qp, masks[m], groupsX, fMod.data());
+                classify(fFlipped.data(), fMod.data(), groupsX, res.counts[m][1][1]);
+            }
+        }
+
+        res.groups = static_cast<long long>(groupsX) * groupsY;
+        for (int m = 0; m < 2; ++m) {
+            res.maskEstimate[m] = solveEstimate(res, m);
+        }
+        double rate = 0.5 * (res.maskEstimate[0] + res.maskEstimate[1]);
+        res.embeddingPercent = std::max(0.0, std::min(100.0, rate * 100.0));
+        return res;
+    }
+};
+
+// Регуляризованная верхняя неполная гамма-функция Q(a, x) = 1 - P(a, x)
+double gammaQ(double a, double x) {
+    if (x <= 0) return 1.0;
+    double lnGammaA = std::lgamma(a);
+    if (x < a + 1.0) {
+        double term = 1.0 / a;
+        double sum = term;
+        for (int n = 1; n < 1000; ++n) {
+            term *= x / (a + n);
+            sum += term;
+            if (std::abs(term) < std::abs(sum) * 1e-15) break;
+        }
+        return 1.0 - sum * std::exp(-x + a * std::log(x) - lnGammaA);
+    }
+    const double tiny = 1e-300;
+    double b = x + 1.0 - a;
+    double c = 1.0 / tiny;
+    double d = 1.0 / b;
+    double h = d;
+    for (int i = 1; i < 1000; ++i) {
+        double an = -i * (i - a);
+        b += 2.0;
+        d = an * d + b;
+        if (std::abs(d) < tiny) d = tiny;
+        c = b + an / c;
+        if (std::abs(c) < tiny) c = tiny;
+        d = 1.0 / d;
+        double delta = d * c;
+        h *= delta;
+        if (std::abs(delta - 1.0) < 1e-15) break;
+    }
+    return std::exp(-x + a * std::log(x) - lnGammaA) * h;
+}
+
+double chiSquareSurvival(double chi2, int df) {
+    if (df < 1) return 1.0;
+    return gammaQ(df / 2.0, chi2 / 2.0);
+}
+
+// p-value Вестфельда - вероятность того, что пары (2k, 2k+1) выровнены
+// случайно; при LSB-встраивании она стремится к 1, поэтому подозрительно
+// p > CHI2_STEGO_P, а не малое p
+const double CHI2_STEGO_P = 0.95;
+
+struct ChiSquareResult {
+    double chi2 = 0.0;
+    double pValue = 1.0;
+    int suspiciousParts = 0;   // части с p > CHI2_STEGO_P
+    int totalParts = 0;
+    double suspiciousRatio = 0.0;
+    // (доля просмотренных пикселей, p-value) в порядке встраивания
+    std::vector<std::pair<double, double>> curve;
+};
+
+// Атака Вестфельда по парам значений (2k, 2k+1). Пиксели просматриваются в
+// порядке последовательного встраивания (GrayBMP::embedMessage пишет с пикселя 0),
+// счетчики пар обновляются инкрементально, и в каждой контрольной точке
+// по ним считается p-value - получается вся кривая за один проход.
+class ChiSquareAnalyzer {
+private:
+    int nParts;
+    int curvePoints;
+
+    static double pairStatistic(const uint32_t* hist, int& categories) {
+        double chi2 = 0.0;
+        categories = 0;
+        for (int k = 0; k < 128; ++k) {
+            double even = hist[2 * k];
+            double odd = hist[2 * k + 1];
+            double sum = even + odd;
+            if (sum > 0) {
+                chi2 += (even - odd) * (even - odd) / sum;
+                categories++;
+            }
+        }
+        return chi2;
+    }
+
+    static double pValueOf(const uint32_t* hist, double* chi2Out = nullptr) {
+        int categories = 0;
+        double chi2 = pairStatistic(hist, categories);
+        if (chi2Out) *chi2Out = chi2;
+        return chiSquareSurvival(chi2, categories - 1);
+    }
+
+public:
+    explicit ChiSquareAnalyzer(int parts = 4, int points = 100) : nParts(parts), curvePoints(points) {}
+
+    ChiSquareResult analyze(const GrayBMP& img) const {
+        ChiSquareResult res;
+        int w = img.getWidth();
+        int h = img.getHeight();
+        long long total = static_cast<long long>(w) * h;
+        if (total == 0) return res;
+
+        const uint8_t* pixels = img.data();
+        int partW = w / nParts;
+        int partH = h / nParts;
+        int points = static_cast<int>(std::min<long long>(std::max(curvePoints, 1), total));
+
+        std::vector<int> colBlock(w, -1);
+        if (partW > 0) {
+            for (int x = 0; x < partW * nParts; ++x) colBlock[x] = x / partW;
+        }
+
+        uint32_t hist[256] = {0};
+        std::vector<uint32_t> blockHist(static_cast<size_t>(nParts) * nParts * 256, 0);
+
+        long long pos = 0;
+        for (int cp = 1; cp <= points; ++cp) {
+            long long end = total * cp / points;
+            while (pos < end) {
+                int y = static_cast<int>(pos / w);
+                int x = static_cast<int>(pos % w);
+                int xEnd = static_cast<int>(std::min<long long>(end - static_cast<long long>(y) * w, w));
+                const uint8_t* row = pixels + static_cast<size_t>(y) * w;
+
+                int blockRow = (partH > 0) ? y / partH : nParts;
+                if (blockRow < nParts) {
+                    uint32_t* rowHists = blockHist.data() + static_cast<size_t>(blockRow) * nParts * 256;
+                    for (int i = x; i < xEnd; ++i) {
+                        hist[row[i]]++;
+                        if (colBlock[i] >= 0) rowHists[colBlock[i] * 256 + row[i]]++;
+                    }
+                } else {
+                    for (int i = x; i < xEnd; ++i) hist[row[i]]++;
+                }
+                pos = static_cast<long long>(y) * w + xEnd;
+            }
+            res.curve.push_back({static_cast<double>(end) / total, pValueOf(hist)});
+        }
+
+        res.pValue = pValueOf(hist, &res.chi2);
+
+        if (partW > 0 && partH > 0) {
+            for (int b = 0; b < nParts * nParts; ++b) {
+                res.totalParts++;
+                if (pValueOf(blockHist.data() + static_cast<size_t>(b) * 256) > CHI2_STEGO_P) {
+                    res.suspiciousParts++;
+                }
+            }
+        }
+        res.suspiciousRatio = res.totalParts ? static_cast<double>(res.suspiciousParts) / res.totalParts : 0.0;
+        return res;
+    }
+};
+
+// Предсказание пикселя средним по 4 соседям, общее для AUMP и WS.
+// Считается построчно по всему изображению (без разбиения на блоки), так что
+// внутренний цикл - простой проход по трем строкам, который векторизуется.
+class LocalPredictor {
+public:
+    // residual[x] = x - mean(соседей), neighbourVar[x] - дисперсия соседей
+    static void predictRow(const GrayBMP& img, int y, float* residual, float* neighbourVar) {
+        int w = img.getWidth();
+        int h = img.getHeight();
+        const uint8_t* pixels = img.data();
+        const uint8_t* cur = pixels + static_cast<size_t>(y) * w;
+
+        if (y > 0 && y < h - 1 && w > 2) {
+            const uint8_t* up = cur - w;
+            const uint8_t* down = cur + w;
+            for (int x = 1; x < w - 1; ++x) {
+                int a = up[x], b = down[x], c = cur[x - 1], d = cur[x + 1];
+                float mean = (a + b + c + d) * 0.25f;
+                float meanSq = (a * a + b * b + c * c + d * d) * 0.25f;
+                residual[x] = cur[x] - mean;
+                neighbourVar[x] = meanSq - mean * mean;
+            }
+            predictEdge(img, y, 0, residual, neighbourVar);
+            predictEdge(img, y, w - 1, residual, neighbourVar);
+        } else {
+            for (int x = 0; x < w; ++x) predictEdge(img, y, x, residual, neighbourVar);
+        }
+    }
+
+private:
+    static void predictEdge(const GrayBMP& img, int y, int x, float* residual, float* neighbourVar) {
+        int w = img.getWidth();
+        int h = img.getHeight();
+        const uint8_t* pixels = img.data();
+        int sum = 0, sumSq = 0, n = 0;
+        auto add = [&](int v) { sum += v; sumSq += v * v; n++; };
+        if (y > 0) add(pixels[(y - 1) * w + x]);
+        if (y < h - 1) add(pixels[(y + 1) * w + x]);
+        if (x > 0) add(pixels[y * w + x - 1]);
+        if (x < w - 1) add(pixels[y * w + x + 1]);
+        if (n == 0) {
+            residual[x] = 0.0f;
+            neighbourVar[x] = 0.0f;
+            return;
+        }
+        float mean = static_cast<float>(sum) / n;
+        residual[x] = pixels[y * w + x] - mean;
+        neighbourVar[x] = static_cast<float>(sumSq) / n - mean * mean;
+    }
+};
+
+struct ResidualResult {
+    double beta = 0.0;
+    double threshold = 0.0;
+    int blocks = 0;
+    double wsPayload = 0.0;
+};
+
+// AUMP-оценка beta (медиана по блокам m x m отношения mean|e| / std(e)) и
+// WS-оценка доли встраивания. Оба детектора используют один проход
+// LocalPredictor по строкам; статистики блоков копятся по ходу прохода.
+class AUMPDetector {
+private:
+    int m;
+    double sigTh;
+    double betaThreshold;
+
+    struct BlockStats {
+        double sum = 0.0;
+        double sumSq = 0.0;
+        double sumAbs = 0.0;
+    };
+
+public:
+    explicit AUMPDetector(int blockSize = 16, double sigmaThreshold = 1.0, double threshold = 0.01)
+        : m(blockSize), sigTh(sigmaThreshold), betaThreshold(threshold) {}
+
+    double getThreshold() const { return betaThreshold; }
+
+    ResidualResult analyze(const GrayBMP& img) const {
+        ResidualResult res;
+        res.threshold = betaThreshold;
+        int w = img.getWidth();
+        int h = img.getHeight();
+        if (w == 0 || h == 0) return res;
+
+        int blocksX = w / m;
+        int blocksY = h / m;
+        std::vector<BlockStats> blocks(static_cast<size_t>(blocksX) * blocksY);
+        std::vector<float> residual(w), neighbourVar(w);
+
+        const uint8_t* pixels = img.data();
+        double wsNum = 0.0, wsDen = 0.0;
+
+        for (int y = 0; y < h; ++y) {
+            LocalPredictor::predictRow(img, y, residual.data(), neighbourVar.data());
+
+            int by = y / m;
+            if (by < blocksY) {
+                BlockStats* rowBlocks = blocks.data() + static_cast<size_t>(by) * blocksX;
+                for (int bx = 0; bx < blocksX; ++bx) {
+                    const float* r = residual.data() + bx * m;
+                    float s = 0.0f, sq = 0.0f, ab = 0.0f;
+                    for (int i = 0; i < m; ++i) {
+                        s += r[i];
+                        sq += r[i] * r[i];
+                        ab += std::abs(r[i]);
+                    }
+                    rowBlocks[bx].sum += s;
+                    rowBlocks[bx].sumSq += sq;
+                    rowBlocks[bx].sumAbs += ab;
+                }
+            }
+
+            // WS: p = 2 * sum w_i (s_i - s̄_i)(s_i - F(s)_i) / sum w_i, w_i = 1 / (5 + var_i)
+            if (y > 0 && y < h - 1) {
+                const uint8_t* cur = pixels + static_cast<size_t>(y) * w;
+                float num = 0.0f, den = 0.0f;
+                for (int x = 1; x < w - 1; ++x) {
+                    float weight = 1.0f / (5.0f + neighbourVar[x]);
+                    float sign = (cur[x] & 1) ? 1.0f : -1.0f;
+                    num += weight * sign * residual[x];
+                    den += weight;
+                }
+                wsNum += num;
+                wsDen += den;
+            }
+        }
+
+        std::vector<double> betas;
+        double n = static_cast<double>(m) * m;
+        for (const auto& b : blocks) {
+            double mean = b.sum / n;
+            double variance = b.sumSq / n - mean * mean;
+            if (variance > sigTh) {
+                betas.push_back((b.sumAbs / n) / std::sqrt(variance + 1e-10));
+            }
+        }
+        res.blocks = static_cast<int>(betas.size());
+        if (!betas.empty()) {
+            size_t mid = betas.size() / 2;
+            std::nth_element(betas.begin(), betas.begin() + mid, betas.end());
+            res.beta = betas[mid];
+            if (betas.size() % 2 == 0) {
+                double lower = *std::max_element(betas.begin(), betas.begin() + mid);
+                res.beta = 0.5 * (res.beta + lower);
+            }
+        }
+        res.wsPayload = wsDen > 0 ? 2.0 * wsNum / wsDen : 0.0;
+        return res;
+    }
+};
+
+struct SPAResult {
+    long long pairs = 0;
+    long long Z = 0;   // u == v
+    long long W = 0;   // |u - v| = 1, floor(u/2) == floor(v/2)
+    long long X = 0;   // сумма X_(2m+1)
+    long long Y = 0;   // сумма Y_(2m+1)
+    double rate = 0.0;
+};
+
+// Sample Pair Analysis (Dumitrescu, Wu, Wang). Пары соседних пикселей
+// (по горизонтали и вертикали) раскладываются по разности |u - v| и четности
+// большего значения; из этих счетчиков получаются все множества следов
+// D_m, X_(2m+1), Y_(2m+1), C_m, а оценка доли встраивания - корень квадратного
+// уравнения, просуммированного по m = 0..maxM.
+class SPAAnalyzer {
+private:
+    int maxM;
+
+    static void countPairs(const uint8_t* a, const uint8_t* b, int n, uint32_t* hist) {
+        for (int i = 0; i < n; ++i) {
+            int u = a[i], v = b[i];
+            int d = std::abs(u - v);
+            int larger = std::max(u, v);
+            hist[2 * d + (larger & 1)]++;
+        }
+    }
+
+public:
+    explicit SPAAnalyzer(int maxDiff = 126) : maxM(std::min(std::max(maxDiff, 0), 126)) {}
+
+    SPAResult analyze(const GrayBMP& img) const {
+        SPAResult res;
+        int w = img.getWidth();
+        int h = img.getHeight();
+        if (w < 2 || h < 2) return res;
+
+        const uint8_t* pixels = img.data();
+        std::vector<uint32_t> hist(512, 0);
+        for (int y = 0; y < h; ++y) {
+            const uint8_t* row = pixels + static_cast<size_t>(y) * w;
+            countPairs(row, row + 1, w - 1, hist.data());
+            if (y + 1 < h) countPairs(row, row + w, w, hist.data());
+        }
+
+        auto D = [&](int d) -> double { return (d < 256) ? double(hist[2 * d]) + hist[2 * d + 1] : 0.0; };
+        // X_(2m+1): большее значение четное, Y_(2m+1): нечетное
+        auto X = [&](int d) -> double { return (d < 256) ? double(hist[2 * d]) : 0.0; };
+        auto Y = [&](int d) -> double { return (d < 256) ? double(hist[2 * d + 1]) : 0.0; };
+        auto C = [&](int m) -> double {
+            return (m > 0 ? X(2 * m - 1) : 0.0) + D(2 * m) + Y(2 * m + 1);
+        };
+
+        for (int d = 0; d < 256; ++d) res.pairs += hist[2 * d] + hist[2 * d + 1];
+        res.Z = hist[0] + hist[1];
+        res.W = hist[3];
+        for (int d = 1; d < 256; d += 2) {
+            res.X += hist[2 * d];
+            res.Y += hist[2 * d + 1];
+        }
+
+        double sumYX = 0.0;
+        for (int m = 0; m <= maxM; ++m) sumYX += Y(2 * m + 1) - X(2 * m + 1);
+
+        double a = (2.0 * C(0) - C(maxM + 1)) / 4.0;
+        double b = -(2.0 * D(0) - D(2 * maxM + 2) + 2.0 * sumYX) / 2.0;
+        double c = sumYX;
+
+        double p;
+        if (std::abs(a) < 1e-9) {
+            p = (std::abs(b) > 1e-9) ? -c / b : 0.0;
+        } else {
+            double disc = b * b - 4.0 * a * c;
+            if (disc < 0) disc = 0;
+            double p1 = (-b + std::sqrt(disc)) / (2.0 * a);
+            double p2 = (-b - std::sqrt(disc)) / (2.0 * a);
+            p = std::min(p1, p2);
+        }
+        res.rate = p;
+        return res;
+    }
+};
+
+struct AnalysisResult {
+    std::string file;
+    bool loaded = false;
+    ChiSquareResult chi2;
+    RSResult rs;
+    ResidualResult aump;
+    SPAResult spa;
+};
+
+struct Analyzers {
+    ChiSquareAnalyzer chi2;
+    RSAnalyzer rs;
+    AUMPDetector aump;
+    SPAAnalyzer spa;
+};
+
+std::string finalDecision(const AnalysisResult& result) {
+    int score = 0;
+    if (result.loaded && result.chi2.pValue > CHI2_STEGO_P) score++;
+    if (result.loaded && result.rs.embeddingPercent > 5) score++;
+    if (result.loaded && result.aump.beta >= result.aump.threshold) score++;
+
+    if (score == 0) return "clean";
+    if (score == 1) return "weak suspicion";
+    if (score == 2) return "suspicious";
+    return "highly suspicious";
+}
+
+void parallelFor(int count, const std::function<void(int)>& task) {
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min(threads, std::max(count, 1));
+    std::atomic<int> next(0);
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; ++t) {
+        pool.emplace_back([&]() {
+            for (int i = next++; i < count; i = next++) {
+                task(i);
+            }
+        });
+    }
+    for (auto& th : pool) th.join();
+}
+
+std::vector<std::string> collectImages(const std::string& folder) {
+    std::vector<std::string> files;
+    if (!fs::exists(folder)) return files;
+    for (const auto& entry : fs::directory_iterator(folder)) {
+        if (!entry.is_regular_file()) continue;
+        std::string ext = entry.path().extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        if (ext == ".bmp") files.push_back(entry.path().string());
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+// pack - архив набора (openSiblingPack), тогда files[i] - его i-я запись, и
+// изображение берётся видом на отображённый архив без чтения файла
+std::vector<AnalysisResult> analyzeFolder(const std::vector<std::string>& files, const Analyzers& analyzers,
+                                          const ImagePack* pack = nullptr) {
+    std::vector<AnalysisResult> results(files.size());
+    parallelFor(static_cast<int>(files.size()), [&](int i) {
+        AnalysisResult& result = results[i];
+        result.file = files[i];
+        GrayBMP img;
+        if (pack) {
+            const PackEntry& e = pack->entry(static_cast<uint32_t>(i));
+            img = GrayBMP::view(pack->pixels(static_cast<uint32_t>(i)), e.width, e.height);
+        } else if (!img.load(files[i])) {
+            return;
+        }
+        result.loaded = true;
+        result.chi2 = analyzers.chi2.analyze(img);
+        result.rs = analyzers.rs.analyze(img);
+        result.aump = analyzers.aump.analyze(img);
+        result.spa = analyzers.spa.analyze(img);
+    });
+    return results;
+}
+
+void saveResultsCSV(const std::vector<AnalysisResult>& results, const std::string& outputPath) {
+    std::ofstream file(outputPath);
+    file << "file,chi2,p_value,chi2_suspicious_parts,chi2_total_parts,chi2_ratio,"
+         << "rs_embedding_percent,rs_mask0_R,rs_mask0_S,rs_mask1_R,rs_mask1_S,"
+         << "aump_beta,aump_threshold,ws_payload,spa_rate,final\n";
+
+    for (const auto& r : results) {
+        file << r.file << ",";
+        if (r.loaded) {
+            file << r.chi2.chi2 << "," << r.chi2.pValue << ","
+                 << r.chi2.suspiciousParts << "," << r.chi2.totalParts << ","
+                 << r.chi2.suspiciousRatio << ","
+                 << r.rs.embeddingPercent << ","
+                 << r.rs.counts[0][0][0].rPct() << "," << r.rs.counts[0][0][0].sPct() << ","
+                 << r.rs.counts[1][0][0].rPct() << "," << r.rs.counts[1][0][0].sPct() << ","
+                 << r.aump.beta << "," << r.aump.threshold << "," << r.aump.wsPayload << ","
+                 << r.spa.rate << ",";
+        } else {
+            file << ",,,,,,,,,,,,,,";
+        }
+        file << finalDecision(r) << "\n";
+    }
+    file.close();
+}
+
+void saveChiSquareCurves(const std::vector<AnalysisResult>& results, const std::string& outputPath) {
+    std::ofstream file(outputPath);
+    file << "file,fraction,p_value\n";
+    for (const auto& r : results) {
+        for (const auto& point : r.chi2.curve) {
+            file << r.file << "," << point.first << "," << point.second << "\n";
+        }
+    }
+    file.close();
+}
+
+#ifndef LAB4_NO_MAIN
+int main(int argc, char* argv[]) {
+    std::string folder = (argc > 1) ? argv[1] : "../lab1/set1";
+    std::string csvPath = (argc > 2) ? argv[2] : "steganalysis_results.csv";
+    std::string curvesPath = (argc > 3) ? argv[3] : "chi2_curves.csv";
+    std::string shapeName = (argc > 4) ? argv[4] : "row";
+
+    GroupShape shape = GroupShape::row(4);
+    if (shapeName == "block") shape = GroupShape::block(2);
+    else if (shapeName == "zigzag") shape = GroupShape::zigzag(4);
+
+    ImagePack pack;
+    bool packed = openSiblingPack(folder, pack);
+    std::vector<std::string> files;
+    if (packed) {
+        for (uint32_t i = 0; i < pack.size(); ++i) files.push_back((fs::path(folder) / pack.name(i)).string());
+    } else {
+        files = collectImages(folder);
+    }
+    if (files.empty()) {
+        std::cout << "No images found in " << folder << "\n";
+        return 1;
+    }
+
+    Analyzers analyzers{ChiSquareAnalyzer(4), RSAnalyzer(shape), AUMPDetector(16, 1.0, 0.01),
+                        SPAAnalyzer(126)};
+    std::cout << "Analyzing " << files.size() << " images from " << folder
+              << " (RS groups: " << shape.name << ")\n";
+
+    std::vector<AnalysisResult> results = analyzeFolder(files, analyzers, packed ? &pack : nullptr);
+
+    std::cout << "\nSummary\n" << std::string(80, '-') << "\n";
+    std::cout << std::left << std::setw(35) << "File" << std::right
+              << std::setw(14) << "Chi2 p-value" << std::setw(10) << "RS %"
+              << std::setw(12) << "AUMP beta" << std::setw(10) << "WS" << std::setw(10) << "SPA"
+              << std::setw(18) << "Final" << "\n";
+    std::cout << std::string(80, '-') << "\n";
+    for (const auto& r : results) {
+        std::string name = fs::path(r.file).filename().string().substr(0, 35);
+        std::cout << std::left << std::setw(35) << name << std::right
+                  << std::setw(14) << std::fixed << std::setprecision(6) << r.chi2.pValue
+                  << std::setw(10) << std::setprecision(3) << r.rs.embeddingPercent
+                  << std::setw(12) << std::setprecision(6) << r.aump.beta
+                  << std::setw(10) << std::setprecision(3) << r.aump.wsPayload
+                  << std::setw(10) << std::setprecision(3) << r.spa.rate
+                  << std::setw(18) << finalDecision(r) << "\n";
+    }
+
+    saveResultsCSV(results, csvPath);
+    saveChiSquareCurves(results, curvesPath);
+    std::cout << "\nSaved: " << csvPath << ", " << curvesPath << "\n";
+    return 0;
+}
+#endif
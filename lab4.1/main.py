@@ -1,11 +1,20 @@
 import os
+import sys
 import csv
+from concurrent.futures import ThreadPoolExecutor
 from pathlib import Path
 
 import cv2
 import numpy as np
 from scipy import stats
 
+# Native loops from lab4.1/stegonative.cpp; the Python code below is the fallback
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "lab4.1"))
+try:
+    import stegonative as native
+except ImportError:
+    native = None
+
 
 SUPPORTED_EXTENSIONS = {".bmp", ".png", ".jpg", ".jpeg", ".tif", ".tiff"}
 
@@ -94,7 +103,8 @@ class RSAnalyzer:
         if gray is None:
             return None
 
-        gray = gray.astype(np.int16)
+        if native is None:
+            gray = gray.astype(np.int16)
 
         results = {}
         for idx, mask in enumerate(self.masks):
@@ -128,6 +138,9 @@ class RSAnalyzer:
         }
 
     def _count_groups(self, img, mask):
+        if native is not None:
+            return native.rs_groups(np.ascontiguousarray(img), [int(v) for v in mask])
+
         h, w = img.shape
         r = 0
         s = 0
@@ -182,8 +195,10 @@ class AUMPDetector:
         if gray is None:
             return None
 
-        x = gray.astype(np.float64)
-        beta = self._compute_beta(x)
+        if native is not None:
+            beta = native.aump_beta(np.ascontiguousarray(gray), self.m, self.sig_th)
+        else:
+            beta = self._compute_beta(gray.astype(np.float64))
 
         if beta < 0:
             verdict = "invalid beta"
@@ -393,11 +408,14 @@ def folder_mode():
     rs_analyzer = RSAnalyzer()
     aump_detector = AUMPDetector()
 
+    # native kernels release the GIL, so files are analyzed in threads
+    workers = (os.cpu_count() or 1) if native is not None else 1
     results = []
-    for idx, path in enumerate(files, start=1):
-        print(f"[{idx}/{len(files)}] {os.path.basename(path)}")
-        result = analyze_file(path, chi2_analyzer, rs_analyzer, aump_detector)
-        results.append(result)
+    with ThreadPoolExecutor(max_workers=workers) as pool:
+        jobs = pool.map(lambda path: analyze_file(path, chi2_analyzer, rs_analyzer, aump_detector), files)
+        for idx, (path, result) in enumerate(zip(files, jobs), start=1):
+            print(f"[{idx}/{len(files)}] {os.path.basename(path)}")
+            results.append(result)
 
     print("\nSummary")
     print("-" * 80)
@@ -0,0 +1,250 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <iomanip>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+// Детекторы из CSV lab4.cpp / ensemble.cpp и направление: +1 - чем больше,
+// тем вероятнее стего; -1 - наоборот. p-value Вестфельда растёт к 1 при
+// LSB-встраивании, chi2_ratio - доля частей с p > 0.95, так что у обоих +1
+struct DetectorColumn {
+    const char* column;
+    const char* name;
+    int polarity;
+};
+
+const DetectorColumn DETECTORS[] = {
+    {"p_value",              "Chi2",      1},
+    {"chi2_ratio",           "Chi2-parts", 1},
+    {"rs_embedding_percent", "RS",        1},
+    {"aump_beta",            "AUMP",      1},
+    {"ws_payload",           "WS",        1},
+    {"spa_rate",             "SPA",       1},
+    {"ensemble_score",       "Ensemble",  1},
+};
+
+struct Sample {
+    double score;   // уже умножен на polarity: больше - стего
+    bool stego;
+};
+
+struct RocPoint {
+    double threshold;
+    double fpr;
+    double tpr;
+};
+
+struct Interval {
+    double low = 0.0, high = 0.0;
+};
+
+struct RocSummary {
+    int clean = 0, stego = 0;
+    double auc = 0.0;
+    double pe = 0.5, peThreshold = 0.0;
+    double fpr = 0.0, fnr = 0.0;
+    Interval fprCI, fnrCI;
+    std::vector<double> fprAtTpr;   // по одному на целевой TPR
+    std::vector<RocPoint> curve;
+};
+
+Interval wilsonInterval(double p, int n, double z = 1.96) {
+    Interval ci;
+    if (n == 0) return ci;
+    double denominator = 1.0 + z * z / n;
+    double center = (p + z * z / (2.0 * n)) / denominator;
+    double margin = z * std::sqrt((p * (1.0 - p) + z * z / (4.0 * n)) / n) / denominator;
+    ci.low = std::max(0.0, center - margin);
+    ci.high = std::min(1.0, center + margin);
+    return ci;
+}
+
+// Одна сортировка по убыванию, затем один проход: каждая группа равных
+// значений - одна точка ROC (порог "score >= t" -> стего). tprTargets
+// отсортированы по возрастанию, FPR для них снимаются в том же проходе.
+RocSummary computeRoc(std::vector<Sample>& samples, int polarity, const std::vector<double>& tprTargets) {
+    RocSummary s;
+    s.fprAtTpr.assign(tprTargets.size(), 1.0);
+    for (const auto& x : samples) (x.stego ? s.stego : s.clean)++;
+    if (s.clean == 0 || s.stego == 0) return s;
+
+    std::sort(samples.begin(), samples.end(),
+              [](const Sample& a, const Sample& b) { return a.score > b.score; });
+
+    int fp = 0, tp = 0;
+    double prevFpr = 0.0, prevTpr = 0.0;
+    s.curve.push_back({samples.front().score * polarity, 0.0, 0.0});
+    size_t nextTarget = 0;
+
+    for (size_t i = 0; i < samples.size(); ++i) {
+        (samples[i].stego ? tp : fp)++;
+        if (i + 1 < samples.size() && samples[i + 1].score == samples[i].score) continue;
+
+        double fpr = static_cast<double>(fp) / s.clean;
+        double tpr = static_cast<double>(tp) / s.stego;
+        s.auc += (fpr - prevFpr) * (tpr + prevTpr) * 0.5;
+        s.curve.push_back({samples[i].score * polarity, fpr, tpr});
+
+        double pe = 0.5 * (fpr + 1.0 - tpr);
+        if (pe < s.pe) {
+            s.pe = pe;
+            s.peThreshold = samples[i].score * polarity;
+            s.fpr = fpr;
+            s.fnr = 1.0 - tpr;
+        }
+        while (nextTarget < tprTargets.size() && tpr >= tprTargets[nextTarget]) {
+            s.fprAtTpr[nextTarget++] = fpr;
+        }
+        prevFpr = fpr;
+        prevTpr = tpr;
+    }
+
+    if (s.pe >= 0.5) {
+        // Ни один порог не лучше случайного: всё считаем чистым
+        s.fpr = 0.0;
+        s.fnr = 1.0;
+        s.peThreshold = samples.front().score * polarity;
+    }
+    s.fprCI = wilsonInterval(s.fpr, s.clean);
+    s.fnrCI = wilsonInterval(s.fnr, s.stego);
+    return s;
+}
+
+std::vector<std::string> splitCSV(const std::string& line) {
+    std::vector<std::string> fields;
+    std::stringstream ss(line);
+    std::string field;
+    while (std::getline(ss, field, ',')) fields.push_back(field);
+    return fields;
+}
+
+// Построчно дописывает оценки из CSV в samples[detector]; пустые поля
+// (нечитаемые изображения) пропускаются
+bool appendScores(const std::string& path, bool stego, std::vector<std::vector<Sample>>& samples) {
+    std::ifstream file(path);
+    std::string line;
+    if (!file || !std::getline(file, line)) {
+        std::cerr << "Cannot read " << path << "\n";
+        return false;
+    }
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+
+    std::vector<std::string> header = splitCSV(line);
+    std::vector<int> columns;
+    const size_t count = sizeof(DETECTORS) / sizeof(DETECTORS[0]);
+    for (size_t d = 0; d < count; ++d) {
+        auto it = std::find(header.begin(), header.end(), DETECTORS[d].column);
+        columns.push_back(it == header.end() ? -1 : static_cast<int>(it - header.begin()));
+    }
+
+    while (std::getline(file, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        std::vector<std::string> fields = splitCSV(line);
+        for (size_t d = 0; d < count; ++d) {
+            int c = columns[d];
+            if (c < 0 || c >= static_cast<int>(fields.size()) || fields[c].empty()) continue;
+            char* end = nullptr;
+            double value = std::strtod(fields[c].c_str(), &end);
+            if (end == fields[c].c_str() || std::isnan(value)) continue;
+            samples[d].push_back({value * DETECTORS[d].polarity, stego});
+        }
+    }
+    return true;
+}
+
+// "0.5,0.9" -> {0.5, 0.9}: значения в (0, 1], по возрастанию, без повторов
+bool parseTargets(const std::string& text, std::vector<double>& targets) {
+    targets.clear();
+    for (const std::string& field : splitCSV(text)) {
+        char* end = nullptr;
+        double value = std::strtod(field.c_str(), &end);
+        if (field.empty() || *end != '\0' || !(value > 0.0 && value <= 1.0)) return false;
+        targets.push_back(value);
+    }
+    std::sort(targets.begin(), targets.end());
+    targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+    return !targets.empty();
+}
+
+// 0.5 -> "50", 0.95 -> "95", 0.999 -> "99.9"
+std::string percentLabel(double target) {
+    std::ostringstream out;
+    out << target * 100.0;
+    return out.str();
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<double> tprTargets = {0.5, 0.9};
+    int first = 1;
+    if (argc > 2 && std::string(argv[1]) == "--tpr") {
+        if (!parseTargets(argv[2], tprTargets)) {
+            std::cerr << "Bad TPR list: " << argv[2] << "\n";
+            return 1;
+        }
+        first = 3;
+    }
+    if (argc - first < 3 || (argc - first - 1) % 2 != 0) {
+        std::cout << "Usage: roc [--tpr 0.5,0.9] <out_prefix> <clean.csv> <stego.csv> [<clean2.csv> <stego2.csv> ...]\n"
+                  << "Writes <out_prefix>_curves.csv (Dataset,Method,Threshold,FPR,TPR)\n"
+                  << "and <out_prefix>_summary.csv with FPR at each TPR target\n";
+        return 1;
+    }
+    std::string prefix = argv[first];
+    const size_t count = sizeof(DETECTORS) / sizeof(DETECTORS[0]);
+
+    std::ofstream curves(prefix + "_curves.csv");
+    std::ofstream summary(prefix + "_summary.csv");
+    curves << "Dataset,Method,Threshold,FPR,TPR\n";
+    summary << "Dataset,Method,clean,stego,auc,pe,pe_threshold,fpr,fpr_ci_low,fpr_ci_high,"
+            << "fnr,fnr_ci_low,fnr_ci_high";
+    for (double target : tprTargets) summary << ",fpr_at_tpr" << percentLabel(target);
+    summary << "\n";
+    curves << std::setprecision(6);
+    summary << std::setprecision(6);
+
+    std::cout << std::left << std::setw(16) << "Dataset" << std::setw(12) << "Method"
+              << std::right << std::setw(8) << "AUC" << std::setw(8) << "P_E";
+    for (double target : tprTargets) std::cout << std::setw(10) << "FPR@" + percentLabel(target);
+    std::cout << "\n";
+
+    for (int a = first + 1; a + 1 < argc; a += 2) {
+        std::string dataset = fs::path(argv[a + 1]).stem().string();
+        std::vector<std::vector<Sample>> samples(count);
+        if (!appendScores(argv[a], false, samples) || !appendScores(argv[a + 1], true, samples)) {
+            return 1;
+        }
+
+        for (size_t d = 0; d < count; ++d) {
+            if (samples[d].empty()) continue;
+            RocSummary s = computeRoc(samples[d], DETECTORS[d].polarity, tprTargets);
+            if (s.curve.empty()) continue;
+
+            for (const auto& p : s.curve) {
+                curves << dataset << "," << DETECTORS[d].name << "," << p.threshold << ","
+                       << p.fpr << "," << p.tpr << "\n";
+            }
+            summary << dataset << "," << DETECTORS[d].name << "," << s.clean << "," << s.stego << ","
+                    << s.auc << "," << s.pe << "," << s.peThreshold << ","
+                    << s.fpr << "," << s.fprCI.low << "," << s.fprCI.high << ","
+                    << s.fnr << "," << s.fnrCI.low << "," << s.fnrCI.high;
+            for (double fpr : s.fprAtTpr) summary << "," << fpr;
+            summary << "\n";
+
+            std::cout << std::left << std::setw(16) << dataset << std::setw(12) << DETECTORS[d].name
+                      << std::right << std::fixed << std::setprecision(4)
+                      << std::setw(8) << s.auc << std::setw(8) << s.pe;
+            for (double fpr : s.fprAtTpr) std::cout << std::setw(10) << fpr;
+            std::cout << "\n";
+        }
+    }
+
+    std::cout << "\nSaved: " << prefix << "_curves.csv, " << prefix << "_summary.csv\n";
+    return 0;
+}
@@ -0,0 +1,461 @@
+// Модуль Python с горячими циклами лабораторных на C++.
+//
+// Изображения принимаются через buffer protocol: numpy-массив uint8 (H, W),
+// C-contiguous, без копирования. Результаты пишутся в переданный массив
+// (np.empty_like), на время вычислений GIL отпускается, поэтому функции
+// можно вызывать из нескольких потоков Python одновременно.
+//
+//   psnr(a, b)                                 -> float (100.0 при совпадении, как в lab3/lab.py)
+//   rdh_capacity(img)                          -> int
+//   rdh_embed(img, out, bits)                  -> (встроено бит, no_shift)
+//   rdh_extract(stego, out, bits_total, mask)  -> bytes (по байту 0/1 на бит)
+//   rs_groups(img, mask)                       -> (R, S, U)   lab4/main.py RSAnalyzer._count_groups
+//   aump_beta(img, m, sig_th)                  -> float       lab4/main.py AUMPDetector._compute_beta
+//   gradient(img, out_float32)                 -> None        lab5/1.py embed_fingerprint_adaptive
+//   chi_square(img), rs(img), aump(img), spa(img) -> dict     детекторы lab4.cpp
+//
+// Сборка (рядом со скриптами ничего ставить не нужно, они ищут модуль в lab4.1):
+//   g++ -O2 -std=c++17 -shared -fPIC stegonative.cpp -o stegonative$(python3-config --extension-suffix) $(python3-config --includes)
+//   g++ -O2 -std=c++17 -shared stegonative.cpp -o stegonative.pyd -I<Python>\include -L<Python>\libs -lpython311
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <cstring>
+
+#define LAB4_NO_MAIN
+#include "lab4.cpp"
+
+// Буфер изображения на время вызова; освобождается в деструкторе
+class ImageBuffer {
+private:
+    Py_buffer view{};
+    bool acquired = false;
+
+public:
+    ImageBuffer() = default;
+    ImageBuffer(const ImageBuffer&) = delete;
+    ImageBuffer& operator=(const ImageBuffer&) = delete;
+    ~ImageBuffer() {
+        if (acquired) PyBuffer_Release(&view);
+    }
+
+    // itemFormat: 'B' для uint8, 'f' для float32
+    bool acquire(PyObject* obj, const char* name, bool writable, char itemFormat = 'B', int ndim = 2) {
+        int flags = PyBUF_C_CONTIGUOUS | PyBUF_FORMAT | (writable ? PyBUF_WRITABLE : 0);
+        if (PyObject_GetBuffer(obj, &view, flags) != 0) return false;
+        acquired = true;
+        const char* fmt = view.format ? view.format : "B";
+        if (*fmt == '=' || *fmt == '<' || *fmt == '@') fmt++;
+        if (fmt[0] != itemFormat || fmt[1] != '\0' || (ndim > 0 && view.ndim != ndim)) {
+            if (ndim > 0) PyErr_Format(PyExc_TypeError, "%s: expected %d-D array of '%c'", name, ndim, itemFormat);
+            else PyErr_Format(PyExc_TypeError, "%s: expected array of '%c'", name, itemFormat);
+            return false;
+        }
+        return true;
+    }
+
+    int height() const { return view.ndim == 2 ? static_cast<int>(view.shape[0]) : 1; }
+    int width() const { return view.ndim == 2 ? static_cast<int>(view.shape[1]) : static_cast<int>(view.len / view.itemsize); }
+    size_t size() const { return static_cast<size_t>(view.len / view.itemsize); }
+    uint8_t* bytes() const { return static_cast<uint8_t*>(view.buf); }
+    float* floats() const { return static_cast<float*>(view.buf); }
+    GrayBMP image() const { return GrayBMP::view(bytes(), width(), height()); }
+
+    bool sameShape(const ImageBuffer& other, const char* name) const {
+        if (width() == other.width() && height() == other.height()) return true;
+        PyErr_Format(PyExc_ValueError, "%s: shape mismatch", name);
+        return false;
+    }
+};
+
+// ===== Метрики =====
+
+static PyObject* py_psnr(PyObject*, PyObject* args) {
+    PyObject *a, *b;
+    if (!PyArg_ParseTuple(args, "OO", &a, &b)) return nullptr;
+    ImageBuffer x, y;
+    if (!x.acquire(a, "a", false, 'B', 0) || !y.acquire(b, "b", false, 'B', 0)) return nullptr;
+    if (x.size() != y.size()) {
+        PyErr_SetString(PyExc_ValueError, "psnr: size mismatch");
+        return nullptr;
+    }
+
+    double mse;
+    Py_BEGIN_ALLOW_THREADS
+    uint64_t sum = 0;
+    const uint8_t* p = x.bytes();
+    const uint8_t* q = y.bytes();
+    for (size_t i = 0; i < x.size(); ++i) {
+        int d = int(p[i]) - int(q[i]);
+        sum += static_cast<uint64_t>(d * d);
+    }
+    mse = x.size() ? double(sum) / double(x.size()) : 0.0;
+    Py_END_ALLOW_THREADS
+
+    if (mse == 0.0) return PyFloat_FromDouble(100.0);
+    return PyFloat_FromDouble(10.0 * std::log10(255.0 * 255.0 / mse));
+}
+
+// |grad| по центральным разностям во внутренних пикселях, края не трогаются
+static PyObject* py_gradient(PyObject*, PyObject* args) {
+    PyObject *src, *dst;
+    if (!PyArg_ParseTuple(args, "OO", &src, &dst)) return nullptr;
+    ImageBuffer img, out;
+    if (!img.acquire(src, "img", false) || !out.acquire(dst, "out", true, 'f') || !img.sameShape(out, "gradient"))
+        return nullptr;
+
+    Py_BEGIN_ALLOW_THREADS
+    int w = img.width(), h = img.height();
+    const uint8_t* p = img.bytes();
+    float* g = out.floats();
+    for (int y = 1; y < h - 1; ++y) {
+        for (int x = 1; x < w - 1; ++x) {
+            size_t i = static_cast<size_t>(y) * w + x;
+            double gx = double(p[i + 1]) - double(p[i - 1]);
+            double gy = double(p[i + w]) - double(p[i - w]);
+            g[i] = static_cast<float>(std::sqrt(gx * gx + gy * gy));
+        }
+    }
+    Py_END_ALLOW_THREADS
+    Py_RETURN_NONE;
+}
+
+// ===== Обратимое встраивание lab3/lab.py (вариант 2) =====
+// Шахматка: A = (i+j) чётное - опорные, B - встраиваемые. Предсказание B по
+// левому и верхнему соседям A, дальше histogram shifting ошибки предсказания.
+
+static inline int predictFromA(const uint8_t* img, int w, int i, int j) {
+    // Для B-пикселя левый и верхний соседи всегда A
+    bool left = j > 0, up = i > 0;
+    if (left && up) return (int(img[i * w + j - 1]) + int(img[(i - 1) * w + j]) + 1) / 2;
+    if (left) return img[i * w + j - 1];
+    if (up) return img[(i - 1) * w + j];
+    return 0;
+}
+
+static PyObject* py_rdh_capacity(PyObject*, PyObject* args) {
+    PyObject* src;
+    if (!PyArg_ParseTuple(args, "O", &src)) return nullptr;
+    ImageBuffer img;
+    if (!img.acquire(src, "img", false)) return nullptr;
+
+    long long cap = 0;
+    Py_BEGIN_ALLOW_THREADS
+    int w = img.width(), h = img.height();
+    const uint8_t* p = img.bytes();
+    for (int i = 0; i < h; ++i) {
+        for (int j = (i + 1) & 1; j < w; j += 2) {
+            int pred = predictFromA(p, w, i, j);
+            if (p[i * w + j] == pred && pred != 255) cap++;
+        }
+    }
+    Py_END_ALLOW_THREADS
+    return PyLong_FromLongLong(cap);
+}
+
+static PyObject* py_rdh_embed(PyObject*, PyObject* args) {
+    PyObject *src, *dst, *bitsObj;
+    if (!PyArg_ParseTuple(args, "OOO", &src, &dst, &bitsObj)) return nullptr;
+    ImageBuffer img, out, bits;
+    if (!img.acquire(src, "img", false) || !out.acquire(dst, "out", true) || !img.sameShape(out, "rdh_embed") ||
+        !bits.acquire(bitsObj, "bits", false, 'B', 1))
+        return nullptr;
+
+    int w = img.width(), h = img.height();
+    size_t need = bits.size();
+    size_t k = 0;
+    int badI = -1, badJ = -1, badValue = 0;
+    std::vector<std::pair<int, int>> noShift;
+
+    Py_BEGIN_ALLOW_THREADS
+    const uint8_t* p = img.bytes();
+    const uint8_t* b = bits.bytes();
+    uint8_t* s = out.bytes();
+    std::memcpy(s, p, static_cast<size_t>(w) * h);
+    bool done = false;
+    for (int i = 0; i < h && !done && badI < 0; ++i) {
+        for (int j = (i + 1) & 1; j < w; j += 2) {
+            int pred = predictFromA(p, w, i, j);
+            int x = p[i * w + j];
+            int r = x - pred;
+
+            if (r >= 1) {
+                if (x == 255) noShift.push_back({i, j});
+                else r += 1;
+            }
+            if (r == 0 && k < need) {
+                if (b[k] == 1) {
+                    if (pred != 255) {
+                        r = 1;
+                        k++;
+                    }
+                } else {
+                    k++;
+                }
+            }
+
+            int v = pred + r;
+            if (v < 0 || v > 255) {
+                badI = i;
+                badJ = j;
+                badValue = v;
+                break;
+            }
+            s[i * w + j] = static_cast<uint8_t>(v);
+            if (k >= need) {
+                done = true;
+                break;
+            }
+        }
+    }
+    Py_END_ALLOW_THREADS
+
+    if (badI >= 0) {
+        PyErr_Format(PyExc_RuntimeError, "Переполнение при внедрении (%d,%d) -> %d", badI, badJ, badValue);
+        return nullptr;
+    }
+    PyObject* list = PyList_New(static_cast<Py_ssize_t>(noShift.size()));
+    if (!list) return nullptr;
+    for (size_t n = 0; n < noShift.size(); ++n) {
+        PyList_SET_ITEM(list, n, Py_BuildValue("[ii]", noShift[n].first, noShift[n].second));
+    }
+    return Py_BuildValue("(nN)", static_cast<Py_ssize_t>(k), list);
+}
+
+// mask - uint8 (H, W), 1 там, где при встраивании сдвиг был невозможен (no_shift)
+static PyObject* py_rdh_extract(PyObject*, PyObject* args) {
+    PyObject *src, *dst, *maskObj;
+    Py_ssize_t need;
+    if (!PyArg_ParseTuple(args, "OOnO", &src, &dst, &need, &maskObj)) return nullptr;
+    ImageBuffer stego, out, mask;
+    if (!stego.acquire(src, "stego", false) || !out.acquire(dst, "out", true) || !mask.acquire(maskObj, "mask", false) ||
+        !stego.sameShape(out, "rdh_extract") || !stego.sameShape(mask, "rdh_extract"))
+        return nullptr;
+
+    int w = stego.width(), h = stego.height();
+    std::vector<uint8_t> bits;
+    bits.reserve(need > 0 ? static_cast<size_t>(need) : 0);
+    int badI = -1, badJ = -1, badValue = 0;
+
+    Py_BEGIN_ALLOW_THREADS
+    const uint8_t* p = stego.bytes();
+    const uint8_t* m = mask.bytes();
+    uint8_t* rec = out.bytes();
+    std::memcpy(rec, p, static_cast<size_t>(w) * h);
+    for (int i = 0; i < h && badI < 0; ++i) {
+        for (int j = (i + 1) & 1; j < w; j += 2) {
+            int pred = predictFromA(p, w, i, j);
+            int r = int(p[i * w + j]) - pred;
+
+            if (static_cast<Py_ssize_t>(bits.size()) < need) {
+                if (r == 0) {
+                    bits.push_back(0);
+                } else if (r == 1) {
+                    bits.push_back(1);
+                    r = 0;
+                }
+            }
+            if (!m[i * w + j] && r >= 2) r -= 1;
+
+            int v = pred + r;
+            if (v < 0 || v > 255) {
+                badI = i;
+                badJ = j;
+                badValue = v;
+                break;
+            }
+            rec[i * w + j] = static_cast<uint8_t>(v);
+        }
+    }
+    Py_END_ALLOW_THREADS
+
+    if (badI >= 0) {
+        PyErr_Format(PyExc_RuntimeError, "Переполнение при восстановлении (%d,%d) -> %d", badI, badJ, badValue);
+        return nullptr;
+    }
+    return PyBytes_FromStringAndSize(reinterpret_cast<const char*>(bits.data()), static_cast<Py_ssize_t>(bits.size()));
+}
+
+// ===== Детекторы lab4/main.py =====
+
+// Группы по строке без перекрытия, x in range(0, w - n, n); инверсия НЗБ по маске
+static PyObject* py_rs_groups(PyObject*, PyObject* args) {
+    PyObject *src, *maskObj;
+    if (!PyArg_ParseTuple(args, "OO", &src, &maskObj)) return nullptr;
+    ImageBuffer img;
+    if (!img.acquire(src, "img", false)) return nullptr;
+
+    PyObject* seq = PySequence_Fast(maskObj, "mask must be a sequence");
+    if (!seq) return nullptr;
+    std::vector<int> mask(static_cast<size_t>(PySequence_Fast_GET_SIZE(seq)));
+    for (size_t i = 0; i < mask.size(); ++i) {
+        mask[i] = static_cast<int>(PyLong_AsLong(PySequence_Fast_GET_ITEM(seq, i)));
+    }
+    Py_DECREF(seq);
+    if (PyErr_Occurred()) return nullptr;
+    if (mask.size() < 2) {
+        PyErr_SetString(PyExc_ValueError, "rs_groups: mask too short");
+        return nullptr;
+    }
+
+    long long R = 0, S = 0, U = 0;
+    Py_BEGIN_ALLOW_THREADS
+    int w = img.width(), h = img.height();
+    int n = static_cast<int>(mask.size());
+    std::vector<int> flipped(n);
+    for (int y = 0; y < h; ++y) {
+        const uint8_t* row = img.bytes() + static_cast<size_t>(y) * w;
+        for (int x = 0; x < w - n; x += n) {
+            for (int i = 0; i < n; ++i) flipped[i] = mask[i] == 1 ? (row[x + i] ^ 1) : row[x + i];
+            int fOrig = 0, fMod = 0;
+            for (int i = 0; i + 1 < n; ++i) {
+                fOrig += std::abs(int(row[x + i + 1]) - int(row[x + i]));
+                fMod += std::abs(flipped[i + 1] - flipped[i]);
+            }
+            if (fMod > fOrig) R++;
+            else if (fMod < fOrig) S++;
+            else U++;
+        }
+    }
+    Py_END_ALLOW_THREADS
+    return Py_BuildValue("(LLL)", R, S, U);
+}
+
+// Медиана mean|e| / std(e) по блокам m x m; предсказание - среднее соседей внутри блока
+static PyObject* py_aump_beta(PyObject*, PyObject* args) {
+    PyObject* src;
+    int m = 16;
+    double sigTh = 1.0;
+    if (!PyArg_ParseTuple(args, "O|id", &src, &m, &sigTh)) return nullptr;
+    ImageBuffer img;
+    if (!img.acquire(src, "img", false)) return nullptr;
+    if (m < 2) {
+        PyErr_SetString(PyExc_ValueError, "aump_beta: block size must be >= 2");
+        return nullptr;
+    }
+
+    double beta = 0.0;
+    Py_BEGIN_ALLOW_THREADS
+    int w = img.width(), h = img.height();
+    const uint8_t* p = img.bytes();
+    std::vector<double> betas;
+    std::vector<double> error(static_cast<size_t>(m) * m);
+    for (int by = 0; by < h - m; by += m) {
+        for (int bx = 0; bx < w - m; bx += m) {
+            double mean = 0.0;
+            for (int i = 0; i < m; ++i) {
+                const uint8_t* row = p + static_cast<size_t>(by + i) * w + bx;
+                for (int j = 0; j < m; ++j) {
+                    double sum = 0.0;
+                    int count = 0;
+                    if (i > 0) { sum += row[j - w]; count++; }
+                    if (i < m - 1) { sum += row[j + w]; count++; }
+                    if (j > 0) { sum += row[j - 1]; count++; }
+                    if (j < m - 1) { sum += row[j + 1]; count++; }
+                    double e = row[j] - sum / count;
+                    error[i * m + j] = e;
+                    mean += e;
+                }
+            }
+            mean /= error.size();
+            double variance = 0.0, absMean = 0.0;
+            for (double e : error) {
+                variance += (e - mean) * (e - mean);
+                absMean += std::abs(e);
+            }
+            variance /= error.size();
+            absMean /= error.size();
+            if (variance > sigTh) betas.push_back(absMean / std::sqrt(variance + 1e-10));
+        }
+    }
+    if (!betas.empty()) {
+        size_t mid = betas.size() / 2;
+        std::nth_element(betas.begin(), betas.begin() + mid, betas.end());
+        beta = betas[mid];
+        if (betas.size() % 2 == 0) beta = (beta + *std::max_element(betas.begin(), betas.begin() + mid)) / 2.0;
+    }
+    Py_END_ALLOW_THREADS
+    return PyFloat_FromDouble(beta);
+}
+
+// ===== Детекторы lab4.cpp =====
+
+static PyObject* py_chi_square(PyObject*, PyObject* args) {
+    PyObject* src;
+    if (!PyArg_ParseTuple(args, "O", &src)) return nullptr;
+    ImageBuffer img;
+    if (!img.acquire(src, "img", false)) return nullptr;
+
+    ChiSquareResult res;
+    Py_BEGIN_ALLOW_THREADS
+    res = ChiSquareAnalyzer().analyze(img.image());
+    Py_END_ALLOW_THREADS
+    return Py_BuildValue("{s:d,s:d,s:i,s:i,s:d}", "chi2", res.chi2, "p_value", res.pValue, "suspicious_parts",
+                         res.suspiciousParts, "total_parts", res.totalParts, "suspicious_ratio", res.suspiciousRatio);
+}
+
+static PyObject* py_rs(PyObject*, PyObject* args) {
+    PyObject* src;
+    if (!PyArg_ParseTuple(args, "O", &src)) return nullptr;
+    ImageBuffer img;
+    if (!img.acquire(src, "img", false)) return nullptr;
+
+    RSResult res;
+    Py_BEGIN_ALLOW_THREADS
+    res = RSAnalyzer().analyze(img.image());
+    Py_END_ALLOW_THREADS
+    const RSCounts& m0 = res.counts[0][0][0];
+    const RSCounts& m1 = res.counts[1][0][0];
+    return Py_BuildValue("{s:d,s:L,s:d,s:d,s:d,s:d}", "embedding_percent", res.embeddingPercent, "groups", res.groups,
+                         "mask0_R", m0.rPct(), "mask0_S", m0.sPct(), "mask1_R", m1.rPct(), "mask1_S", m1.sPct());
+}
+
+static PyObject* py_aump(PyObject*, PyObject* args) {
+    PyObject* src;
+    if (!PyArg_ParseTuple(args, "O", &src)) return nullptr;
+    ImageBuffer img;
+    if (!img.acquire(src, "img", false)) return nullptr;
+
+    ResidualResult res;
+    Py_BEGIN_ALLOW_THREADS
+    res = AUMPDetector().analyze(img.image());
+    Py_END_ALLOW_THREADS
+    return Py_BuildValue("{s:d,s:d,s:i,s:d}", "beta", res.beta, "threshold", res.threshold, "blocks", res.blocks,
+                         "ws_payload", res.wsPayload);
+}
+
+static PyObject* py_spa(PyObject*, PyObject* args) {
+    PyObject* src;
+    if (!PyArg_ParseTuple(args, "O", &src)) return nullptr;
+    ImageBuffer img;
+    if (!img.acquire(src, "img", false)) return nullptr;
+
+    SPAResult res;
+    Py_BEGIN_ALLOW_THREADS
+    res = SPAAnalyzer().analyze(img.image());
+    Py_END_ALLOW_THREADS
+    return Py_BuildValue("{s:d,s:L}", "rate", res.rate, "pairs", res.pairs);
+}
+
+static PyMethodDef methods[] = {
+    {"psnr", py_psnr, METH_VARARGS, "psnr(a, b) -> float"},
+    {"gradient", py_gradient, METH_VARARGS, "gradient(img, out_float32) -> None"},
+    {"rdh_capacity", py_rdh_capacity, METH_VARARGS, "rdh_capacity(img) -> int"},
+    {"rdh_embed", py_rdh_embed, METH_VARARGS, "rdh_embed(img, out, bits) -> (embedded, no_shift)"},
+    {"rdh_extract", py_rdh_extract, METH_VARARGS, "rdh_extract(stego, out, bits_total, no_shift_mask) -> bytes"},
+    {"rs_groups", py_rs_groups, METH_VARARGS, "rs_groups(img, mask) -> (R, S, U)"},
+    {"aump_beta", py_aump_beta, METH_VARARGS, "aump_beta(img, m=16, sig_th=1.0) -> float"},
+    {"chi_square", py_chi_square, METH_VARARGS, "chi_square(img) -> dict"},
+    {"rs", py_rs, METH_VARARGS, "rs(img) -> dict"},
+    {"aump", py_aump, METH_VARARGS, "aump(img) -> dict"},
+    {"spa", py_spa, METH_VARARGS, "spa(img) -> dict"},
+    {nullptr, nullptr, 0, nullptr}
+};
+
+static PyModuleDef moduleDef = {
+    PyModuleDef_HEAD_INIT, "stegonative", "C++ kernels for the steganography labs", -1, methods,
+    nullptr, nullptr, nullptr, nullptr
+};
+
+PyMODINIT_FUNC PyInit_stegonative() { return PyModule_Create(&moduleDef); }
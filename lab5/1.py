@@ -1,10 +1,17 @@
 import os
+import sys
 import numpy as np
 import cv2
 import random
 from collections import Counter
 import itertools
 
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "lab4.1"))
+try:
+    import stegonative as native
+except ImportError:
+    native = None
+
 class FingerprintGenerator:
     def __init__(self, n_users, c, eps=0.1):
         self.n_users = n_users
@@ -66,11 +73,14 @@ class WatermarkEmbedder:
         fingerprint_len = len(fingerprint)
         
         gradient = np.zeros_like(image, dtype=np.float32)
-        for y in range(1, h-1):
-            for x in range(1, w-1):
-                gx = float(image[y, x+1]) - float(image[y, x-1])
-                gy = float(image[y+1, x]) - float(image[y-1, x])
-                gradient[y, x] = np.sqrt(gx*gx + gy*gy)
+        if native is not None and image.ndim == 2 and image.dtype == np.uint8:
+            native.gradient(np.ascontiguousarray(image), gradient)
+        else:
+            for y in range(1, h-1):
+                for x in range(1, w-1):
+                    gx = float(image[y, x+1]) - float(image[y, x-1])
+                    gy = float(image[y+1, x]) - float(image[y-1, x])
+                    gradient[y, x] = np.sqrt(gx*gx + gy*gy)
         
         positions = np.argsort(gradient.flatten())[::-1]
         
@@ -0,0 +1,1238 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cmath>
+#include <random>
+#include <algorithm>
+#include <iomanip>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <chrono>
+#include <memory>
+#include <filesystem>
+#include <map>
+#include <cerrno>
+#include <cstdlib>
+
+namespace fs = std::filesystem;
+
+#pragma pack(push, 1)
+struct BMPHeader {
+    uint16_t bfType;
+    uint32_t bfSize;
+    uint16_t bfReserved1;
+    uint16_t bfReserved2;
+    uint32_t bfOffBits;
+    uint32_t biSize;
+    int32_t  biWidth;
+    int32_t  biHeight;
+    uint16_t biPlanes;
+    uint16_t biBitCount;
+    uint32_t biCompression;
+    uint32_t biSizeImage;
+    int32_t  biXPelsPerMeter;
+    int32_t  biYPelsPerMeter;
+    uint32_t biClrUsed;
+    uint32_t biClrImportant;
+};
+#pragma pack(pop)
+
+class GrayBMP {
+private:
+    BMPHeader header;
+    std::vector<uint8_t> palette;
+    std::vector<uint8_t> pixels;
+    int width, height;
+    bool loaded;
+
+    bool readBMP(const std::string& filename) {
+        std::ifstream file(filename, std::ios::binary);
+        if (!file) return false;
+
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (header.bfType != 0x4D42 || header.biBitCount != 8)
+            return false;
+
+        width = header.biWidth;
+        height = std::abs(header.biHeight);
+
+        palette.resize(1024);
+        file.seekg(sizeof(header), std::ios::beg);
+        file.read(reinterpret_cast<char*>(palette.data()), 1024);
+
+        file.seekg(header.bfOffBits, std::ios::beg);
+        int rowSize = (width * 8 + 31) / 32 * 4;
+        int dataSize = rowSize * height;
+        std::vector<uint8_t> rawData(dataSize);
+        file.read(reinterpret_cast<char*>(rawData.data()), dataSize);
+
+        pixels.resize(width * height);
+        for (int y = 0; y < height; ++y) {
+            int srcY = (header.biHeight > 0) ? (height - 1 - y) : y;
+            for (int x = 0; x < width; ++x) {
+                pixels[y * width + x] = rawData[srcY * rowSize + x];
+            }
+        }
+        loaded = true;
+        file.close();
+        return true;
+    }
+
+    bool writeBMP(const std::string& filename) {
+        if (!loaded) return false;
+
+        int rowSize = (width * 8 + 31) / 32 * 4;
+        int dataSize = rowSize * height;
+        std::vector<uint8_t> rawData(dataSize, 0);
+
+        for (int y = 0; y < height; ++y) {
+            int dstY = (header.biHeight > 0) ? (height - 1 - y) : y;
+            for (int x = 0; x < width; ++x) {
+                rawData[dstY * rowSize + x] = pixels[y * width + x];
+            }
+        }
+
+        header.bfOffBits = sizeof(header) + 1024;
+        header.bfSize = header.bfOffBits + dataSize;
+        header.biSizeImage = dataSize;
+
+        std::ofstream file(filename, std::ios::binary);
+        if (!file) return false;
+        file.write(reinterpret_cast<char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<char*>(palette.data()), 1024);
+        file.write(reinterpret_cast<char*>(rawData.data()), dataSize);
+        file.close();
+        return true;
+    }
+
+public:
+    GrayBMP() : loaded(false), width(0), height(0) {}
+
+    bool load(const std::string& filename) { return readBMP(filename); }
+    bool save(const std::string& filename) { return writeBMP(filename); }
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    int getSize() const { return width * height; }
+
+    uint8_t* data() { return pixels.data(); }
+    const uint8_t* data() const { return pixels.data(); }
+
+    GrayBMP clone() const {
+        GrayBMP copy;
+        copy.header = this->header;
+        copy.palette = this->palette;
+        copy.width = this->width;
+        copy.height = this->height;
+        copy.pixels = this->pixels;
+        copy.loaded = this->loaded;
+        return copy;
+    }
+};
+
+void parallelFor(int count, const std::function<void(int)>& task) {
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min(threads, std::max(count, 1));
+    if (threads == 1) {
+        for (int i = 0; i < count; ++i) task(i);
+        return;
+    }
+    std::atomic<int> next(0);
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; ++t) {
+        pool.emplace_back([&]() {
+            for (int i = next++; i < count; i = next++) {
+                task(i);
+            }
+        });
+    }
+    for (auto& th : pool) th.join();
+}
+
+// Параметры кода Тардоша, как в FingerprintGenerator: m = 2 c ln(n / eps)
+struct TardosParams {
+    int64_t users;
+    int c;
+    double eps;
+    int length;
+    double cutoff;   // t = 1 / (300 c): p_j берутся из [t, 1 - t]
+
+    TardosParams(int64_t n, int coalition, double epsilon = 0.1)
+        : users(n), c(coalition), eps(epsilon),
+          length(static_cast<int>(2.0 * coalition * std::log(n / epsilon))),
+          cutoff(1.0 / (300.0 * coalition)) {}
+};
+
+// Счётчиковый генератор Philox4x32-10 (Salmon et al., Random123): любые
+// 128 бит выхода вычисляются по счётчику и ключу независимо, без состояния
+struct Philox4x32 {
+    static void round(uint32_t ctr[4], const uint32_t key[2]) {
+        uint64_t p0 = static_cast<uint64_t>(0xD2511F53u) * ctr[0];
+        uint64_t p1 = static_cast<uint64_t>(0xCD9E8D57u) * ctr[2];
+        uint32_t hi0 = static_cast<uint32_t>(p0 >> 32), lo0 = static_cast<uint32_t>(p0);
+        uint32_t hi1 = static_cast<uint32_t>(p1 >> 32), lo1 = static_cast<uint32_t>(p1);
+        ctr[0] = hi1 ^ ctr[1] ^ key[0];
+        ctr[1] = lo1;
+        ctr[2] = hi0 ^ ctr[3] ^ key[1];
+        ctr[3] = lo0;
+    }
+
+    static void generate(const uint32_t counter[4], uint64_t masterKey, uint32_t out[4]) {
+        uint32_t key[2] = {static_cast<uint32_t>(masterKey), static_cast<uint32_t>(masterKey >> 32)};
+        for (int i = 0; i < 4; ++i) out[i] = counter[i];
+        for (int r = 0; r < 10; ++r) {
+            round(out, key);
+            key[0] += 0x9E3779B9u;
+            key[1] += 0xBB67AE85u;
+        }
+    }
+};
+
+// Домены счётчика, чтобы биты кодовых слов и p_j не пересекались
+const uint32_t DOMAIN_CODEWORD = 0x434F4445u;
+const uint32_t DOMAIN_BIAS = 0x42494153u;
+
+// p_j = sin^2(r), r равномерно на [asin(sqrt(t)), pi/2 - asin(sqrt(t))] -
+// распределение arcsin (Beta(0.5, 0.5)) с отсечкой краёв; r берётся из
+// Philox(key, позиция), так что p_j восстанавливаются по одному ключу
+std::vector<double> deriveBiases(const TardosParams& params, uint64_t key) {
+    double r0 = std::asin(std::sqrt(params.cutoff));
+    std::vector<double> p(params.length);
+    for (int j = 0; j < params.length; j += 4) {
+        uint32_t counter[4] = {static_cast<uint32_t>(j / 4), 0, 0, DOMAIN_BIAS};
+        uint32_t out[4];
+        Philox4x32::generate(counter, key, out);
+        for (int i = 0; i < 4 && j + i < params.length; ++i) {
+            double u = (out[i] + 0.5) / 4294967296.0;
+            double s = std::sin(r0 + u * (M_PI / 2 - 2 * r0));
+            p[j + i] = s * s;
+        }
+    }
+    return p;
+}
+
+// Кодовая книга: строка пользователя - words() слов uint64_t,
+// бит j лежит в слове j / 64, разряд j % 64
+class Codebook {
+public:
+    virtual ~Codebook() = default;
+    virtual int64_t users() const = 0;
+    virtual int length() const = 0;
+    virtual void fillRow(int64_t user, uint64_t* out) const = 0;
+
+    int words() const { return (length() + 63) / 64; }
+};
+
+// Кодовые слова вычисляются по запросу: x_uj = 1, если
+// Philox(key, (j / 4, user, DOMAIN_CODEWORD))[j % 4] < p_j * 2^32.
+// Хранятся только пороги p_j, память O(m) при любом числе пользователей.
+class DerivedCodebook : public Codebook {
+private:
+    uint64_t key;
+    int64_t n;
+    std::vector<uint32_t> thresholds;
+
+public:
+    DerivedCodebook(uint64_t masterKey, int64_t userCount, const std::vector<double>& p)
+        : key(masterKey), n(userCount), thresholds(p.size()) {
+        for (size_t j = 0; j < p.size(); ++j) {
+            thresholds[j] = static_cast<uint32_t>(std::min(p[j] * 4294967296.0, 4294967295.0));
+        }
+    }
+
+    int64_t users() const override { return n; }
+    int length() const override { return static_cast<int>(thresholds.size()); }
+
+    void fillRow(int64_t user, uint64_t* out) const override {
+        const int len = length();
+        std::fill(out, out + words(), 0);
+        uint32_t counter[4] = {0, static_cast<uint32_t>(user), static_cast<uint32_t>(user >> 32), DOMAIN_CODEWORD};
+        uint32_t r[4];
+        for (int j = 0; j < len; j += 4) {
+            counter[0] = static_cast<uint32_t>(j / 4);
+            Philox4x32::generate(counter, key, r);
+            for (int i = 0; i < 4 && j + i < len; ++i) {
+                uint64_t b = r[i] < thresholds[j + i];
+                out[(j + i) >> 6] |= b << ((j + i) & 63);
+            }
+        }
+    }
+};
+
+// Материализованная книга: те же строки, что у источника, в одном массиве
+class StoredCodebook : public Codebook {
+private:
+    int64_t n = 0;
+    int len = 0;
+    int wordsPerRow = 0;
+    std::vector<uint64_t> bits;
+
+public:
+    explicit StoredCodebook(const Codebook& source)
+        : n(source.users()), len(source.length()), wordsPerRow(source.words()) {
+        bits.assign(static_cast<size_t>(n) * wordsPerRow, 0);
+        const int64_t CHUNK = 4096;
+        int chunks = static_cast<int>((n + CHUNK - 1) / CHUNK);
+        parallelFor(chunks, [&](int chunk) {
+            int64_t end = std::min(n, (chunk + 1) * CHUNK);
+            for (int64_t u = chunk * CHUNK; u < end; ++u) source.fillRow(u, row(u));
+        });
+    }
+
+    int64_t users() const override { return n; }
+    int length() const override { return len; }
+
+    void fillRow(int64_t user, uint64_t* out) const override {
+        std::copy(row(user), row(user) + wordsPerRow, out);
+    }
+
+    const uint64_t* row(int64_t user) const { return &bits[static_cast<size_t>(user) * wordsPerRow]; }
+    uint64_t* row(int64_t user) { return &bits[static_cast<size_t>(user) * wordsPerRow]; }
+};
+
+struct AccusationResult {
+    std::vector<std::pair<double, int64_t>> top;   // по убыванию счёта
+    double mean = 0.0;
+    double stddev = 0.0;
+    double threshold = 0.0;                        // mean + 2 std, как compute_threshold
+    int64_t aboveThreshold = 0;
+};
+
+// Счёт пользователя как в TardosDetector.compute_scores: учитываются только
+// позиции с y_j = 1, x_j = 1 -> +sqrt((1-p)/p), x_j = 0 -> -sqrt(p/(1-p)).
+// Это base + сумма d_j по единицам (x AND y), где base = сумма отрицательных
+// весов, d_j = разность весов. Суммы d_j по всем 256 значениям каждого байта
+// строки считаются заранее, так что слово из 64 позиций - это 8 выборок из
+// таблиц вместо 64 ветвлений.
+class TardosAccuser {
+private:
+    int len;
+    int wordsPerRow;
+    double base = 0.0;
+    std::vector<float> byteTable;   // [words * 8][256]
+
+public:
+    TardosAccuser(const std::vector<double>& p, const std::vector<uint8_t>& pirate)
+        : len(static_cast<int>(p.size())), wordsPerRow((len + 63) / 64) {
+        std::vector<double> delta(wordsPerRow * 64, 0.0);
+        for (int j = 0; j < len; ++j) {
+            if (!pirate[j]) continue;
+            double plus = std::sqrt((1.0 - p[j]) / p[j]);
+            double minus = std::sqrt(p[j] / (1.0 - p[j]));
+            base -= minus;
+            delta[j] = plus + minus;
+        }
+
+        byteTable.assign(static_cast<size_t>(wordsPerRow) * 8 * 256, 0.0f);
+        for (int b = 0; b < wordsPerRow * 8; ++b) {
+            float* table = &byteTable[static_cast<size_t>(b) * 256];
+            for (int v = 1; v < 256; ++v) {
+                int low = v & (v - 1);   // v без младшего бита
+                int bitPos = __builtin_ctz(v);
+                table[v] = table[low] + static_cast<float>(delta[b * 8 + bitPos]);
+            }
+        }
+    }
+
+    double score(const uint64_t* row) const {
+        double s = base;
+        const float* table = byteTable.data();
+        for (int w = 0; w < wordsPerRow; ++w) {
+            uint64_t x = row[w];
+            float acc = 0.0f;
+            for (int b = 0; b < 8; ++b, table += 256) {
+                acc += table[(x >> (8 * b)) & 0xFF];
+            }
+            s += acc;
+        }
+        return s;
+    }
+
+    // Потоки делят диапазон пользователей; у каждого свой min-heap на k
+    // лучших и суммы для среднего/дисперсии, затем слияние. Порог зависит от
+    // среднего по всем, поэтому превышения считаются вторым проходом по тем
+    // же кускам: строки генерируются заново, и память остаётся O(l)
+    AccusationResult accuse(const Codebook& codebook, int k) const {
+        const int64_t n = codebook.users();
+        const int64_t CHUNK = 16384;
+        int chunks = static_cast<int>((n + CHUNK - 1) / CHUNK);
+
+        using Entry = std::pair<double, int64_t>;
+        auto worse = [](const Entry& a, const Entry& b) { return a.first > b.first; };
+        std::vector<std::vector<Entry>> heaps(chunks);
+        std::vector<double> sums(chunks, 0.0), squares(chunks, 0.0);
+        std::vector<int64_t> above(chunks, 0);
+
+        parallelFor(chunks, [&](int chunk) {
+            std::vector<Entry>& heap = heaps[chunk];
+            std::vector<uint64_t> row(codebook.words());
+            double sum = 0.0, sq = 0.0;
+            int64_t end = std::min(n, (chunk + 1) * CHUNK);
+            for (int64_t u = chunk * CHUNK; u < end; ++u) {
+                codebook.fillRow(u, row.data());
+                double s = score(row.data());
+                sum += s;
+                sq += s * s;
+                if (static_cast<int>(heap.size()) < k) {
+                    heap.push_back({s, u});
+                    std::push_heap(heap.begin(), heap.end(), worse);
+                } else if (k > 0 && s > heap.front().first) {
+                    std::pop_heap(heap.begin(), heap.end(), worse);
+                    heap.back() = {s, u};
+                    std::push_heap(heap.begin(), heap.end(), worse);
+                }
+            }
+            sums[chunk] = sum;
+            squares[chunk] = sq;
+        });
+
+        AccusationResult result;
+        double sum = 0.0, sq = 0.0;
+        for (int chunk = 0; chunk < chunks; ++chunk) {
+            sum += sums[chunk];
+            sq += squares[chunk];
+            result.top.insert(result.top.end(), heaps[chunk].begin(), heaps[chunk].end());
+        }
+        std::sort(result.top.begin(), result.top.end(),
+                  [](const Entry& a, const Entry& b) { return a.first > b.first; });
+        if (static_cast<int>(result.top.size()) > k) result.top.resize(k);
+
+        if (n > 0) {
+            result.mean = sum / n;
+            result.stddev = std::sqrt(std::max(0.0, sq / n - result.mean * result.mean));
+        }
+        result.threshold = result.mean + 2.0 * result.stddev;
+
+        parallelFor(chunks, [&](int chunk) {
+            std::vector<uint64_t> row(codebook.words());
+            int64_t count = 0;
+            int64_t end = std::min(n, (chunk + 1) * CHUNK);
+            for (int64_t u = chunk * CHUNK; u < end; ++u) {
+                codebook.fillRow(u, row.data());
+                if (score(row.data()) > result.threshold) count++;
+            }
+            above[chunk] = count;
+        });
+        for (int64_t count : above) result.aboveThreshold += count;
+        return result;
+    }
+};
+
+// Базис ортонормированного двумерного DCT-II (как cv2.dct) для позиций
+// idx = start + j ЦОП: u_j = idx / W - частота по строкам, v_j = idx % W -
+// по столбцам. Базисное изображение сепарабельно: a_u(y) * b_v(x), поэтому
+// хранятся только столбцы a_u для различных u и строки b_v.
+class DCTBasis {
+private:
+    int w = 0, h = 0;
+    std::vector<int> rowFreq;                 // u_j
+    std::vector<int> freqs;                   // различные u_j по возрастанию
+    std::vector<int> freqSlot;                // j -> индекс в freqs
+    std::vector<std::vector<float>> columns;  // a_u(y) для freqs
+    std::vector<std::vector<float>> rows;     // b_v(x) для каждой позиции j
+
+    static std::vector<float> cosine(int n, int k) {
+        std::vector<float> v(n);
+        double scale = std::sqrt((k == 0 ? 1.0 : 2.0) / n);
+        for (int i = 0; i < n; ++i) v[i] = static_cast<float>(scale * std::cos(M_PI * (2 * i + 1) * k / (2.0 * n)));
+        return v;
+    }
+
+public:
+    DCTBasis(int width, int height, int length, int start = 100) : w(width), h(height) {
+        int total = w * h;
+        length = std::max(0, std::min(length, total - start));
+        for (int j = 0; j < length; ++j) {
+            int idx = start + j;
+            int u = idx / w;
+            if (freqs.empty() || freqs.back() != u) {
+                freqs.push_back(u);
+                columns.push_back(cosine(h, u));
+            }
+            rowFreq.push_back(u);
+            freqSlot.push_back(static_cast<int>(freqs.size()) - 1);
+            rows.push_back(cosine(w, idx % w));
+        }
+    }
+
+    int width() const { return w; }
+    int height() const { return h; }
+    int length() const { return static_cast<int>(rows.size()); }
+    int frequencies() const { return static_cast<int>(freqs.size()); }
+    int slot(int j) const { return freqSlot[j]; }
+    const std::vector<float>& column(int s) const { return columns[s]; }
+    const std::vector<float>& row(int j) const { return rows[j]; }
+};
+
+// Поправка пользователя в пространстве изображения: сумма по позициям
+// +-alpha * a_u(y) b_v(x) = сумма по различным u от a_u(y) * r_u(x), где
+// r_u - линейная комбинация строк b_v. Вместо прямого и обратного DCT
+// всего изображения на каждого пользователя.
+struct UserPattern {
+    std::vector<std::vector<float>> rows;   // r_u(x) для каждой частоты basis
+};
+
+class FingerprintEmbedder {
+private:
+    const DCTBasis& basis;
+    float alpha;
+
+public:
+    FingerprintEmbedder(const DCTBasis& dctBasis, double a = 0.1) : basis(dctBasis), alpha(static_cast<float>(a)) {}
+
+    UserPattern pattern(const uint64_t* codeword) const {
+        UserPattern p;
+        p.rows.assign(basis.frequencies(), std::vector<float>(basis.width(), 0.0f));
+        for (int j = 0; j < basis.length(); ++j) {
+            float s = ((codeword[j >> 6] >> (j & 63)) & 1) ? alpha : -alpha;
+            float* dst = p.rows[basis.slot(j)].data();
+            const float* src = basis.row(j).data();
+            for (int x = 0; x < basis.width(); ++x) dst[x] += s * src[x];
+        }
+        return p;
+    }
+
+    // Строки [y0, y1) копии: clip(original + delta) с отбрасыванием дробной
+    // части, как np.clip(idct, 0, 255).astype(np.uint8) в embed_fingerprint_dct.
+    // Поправка по модулю много меньше 1, и различимой её делает именно
+    // усечение: пиксель уменьшается на 1 там, где delta < 0.
+    void applyRows(const uint8_t* original, const UserPattern& p, int y0, int y1, uint8_t* out) const {
+        const int w = basis.width();
+        std::vector<float> acc(w);
+        for (int y = y0; y < y1; ++y) {
+            const uint8_t* src = original + static_cast<size_t>(y) * w;
+            for (int x = 0; x < w; ++x) acc[x] = src[x];
+            for (int s = 0; s < basis.frequencies(); ++s) {
+                float a = basis.column(s)[y];
+                const float* r = p.rows[s].data();
+                for (int x = 0; x < w; ++x) acc[x] += a * r[x];
+            }
+            uint8_t* dst = out + static_cast<size_t>(y - y0) * w;
+            for (int x = 0; x < w; ++x) {
+                dst[x] = static_cast<uint8_t>(std::min(255.0f, std::max(0.0f, acc[x])));
+            }
+        }
+    }
+
+    void embed(const uint8_t* original, const uint64_t* codeword, uint8_t* out) const {
+        applyRows(original, pattern(codeword), 0, basis.height(), out);
+    }
+};
+
+// Извлечение ЦОП без полного DCT: нужный коэффициент - это проекция на
+// базисное изображение, сумма по x от b_v(x) * (сумма по y от a_u(y) I(y, x)).
+// Один проход по изображению на все различные u, затем m скалярных
+// произведений длины W. Проекция оригинала считается один раз в
+// конструкторе; для копии знак разности проекций и есть бит, как в
+// extract_fingerprint.
+class FingerprintExtractor {
+private:
+    const DCTBasis& basis;
+    std::vector<double> reference;
+
+public:
+    FingerprintExtractor(const DCTBasis& dctBasis, const uint8_t* original)
+        : basis(dctBasis), reference(project(original)) {}
+
+    std::vector<double> project(const uint8_t* img) const {
+        const int w = basis.width();
+        const int f = basis.frequencies();
+        std::vector<std::vector<double>> colSums(f, std::vector<double>(w, 0.0));
+        std::vector<double> row(w);
+        for (int y = 0; y < basis.height(); ++y) {
+            const uint8_t* src = img + static_cast<size_t>(y) * w;
+            for (int x = 0; x < w; ++x) row[x] = src[x];
+            for (int s = 0; s < f; ++s) {
+                double a = basis.column(s)[y];
+                double* dst = colSums[s].data();
+                for (int x = 0; x < w; ++x) dst[x] += a * row[x];
+            }
+        }
+
+        std::vector<double> coeffs(basis.length());
+        for (int j = 0; j < basis.length(); ++j) {
+            const float* b = basis.row(j).data();
+            const double* cs = colSums[basis.slot(j)].data();
+            double sum = 0.0;
+            for (int x = 0; x < w; ++x) sum += b[x] * cs[x];
+            coeffs[j] = sum;
+        }
+        return coeffs;
+    }
+
+    std::vector<uint8_t> extract(const uint8_t* suspect) const {
+        std::vector<double> coeffs = project(suspect);
+        std::vector<uint8_t> bits(coeffs.size());
+        for (size_t j = 0; j < coeffs.size(); ++j) bits[j] = (coeffs[j] - reference[j]) > 0 ? 1 : 0;
+        return bits;
+    }
+};
+
+// Построчное чтение 8-битного BMP полосами, без загрузки всего файла
+class BMPBandReader {
+private:
+    std::ifstream file;
+    BMPHeader hdr;
+    std::vector<uint8_t> pal;
+    int width = 0, height = 0, rowSize = 0;
+    bool ok = false;
+
+public:
+    explicit BMPBandReader(const std::string& filename) : file(filename, std::ios::binary) {
+        if (!file) return;
+        file.read(reinterpret_cast<char*>(&hdr), sizeof(hdr));
+        if (!file || hdr.bfType != 0x4D42 || hdr.biBitCount != 8) return;
+        width = hdr.biWidth;
+        height = std::abs(hdr.biHeight);
+        rowSize = (width * 8 + 31) / 32 * 4;
+        pal.resize(1024);
+        file.seekg(sizeof(hdr), std::ios::beg);
+        file.read(reinterpret_cast<char*>(pal.data()), 1024);
+        ok = static_cast<bool>(file);
+    }
+
+    bool isOpen() const { return ok; }
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    const BMPHeader& header() const { return hdr; }
+    const std::vector<uint8_t>& palette() const { return pal; }
+
+    // Строки [y0, y0 + count) сверху вниз в out (width байт на строку)
+    bool readRows(int y0, int count, uint8_t* out) {
+        std::vector<char> raw(rowSize);
+        for (int i = 0; i < count; ++i) {
+            int y = y0 + i;
+            int srcY = (hdr.biHeight > 0) ? (height - 1 - y) : y;
+            file.seekg(hdr.bfOffBits + static_cast<std::streamoff>(srcY) * rowSize, std::ios::beg);
+            file.read(raw.data(), rowSize);
+            std::copy(raw.begin(), raw.begin() + width, out + static_cast<size_t>(i) * width);
+        }
+        return static_cast<bool>(file);
+    }
+};
+
+// Запись BMP полосами: файл сразу получает полный размер, строки пишутся
+// на свои места (снизу вверх, как у GrayBMP::save)
+class BMPBandWriter {
+private:
+    std::ofstream file;
+    BMPHeader hdr;
+    int width, height, rowSize;
+
+public:
+    BMPBandWriter(const std::string& filename, const BMPHeader& source, const std::vector<uint8_t>& palette)
+        : hdr(source), width(source.biWidth), height(std::abs(source.biHeight)),
+          rowSize((source.biWidth * 8 + 31) / 32 * 4) {
+        hdr.biHeight = height;
+        hdr.bfOffBits = sizeof(hdr) + 1024;
+        hdr.biSizeImage = rowSize * height;
+        hdr.bfSize = hdr.bfOffBits + hdr.biSizeImage;
+        {
+            std::ofstream create(filename, std::ios::binary);
+            create.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+            create.write(reinterpret_cast<const char*>(palette.data()), 1024);
+        }
+        std::error_code ec;
+        fs::resize_file(filename, hdr.bfSize, ec);
+        file.open(filename, std::ios::binary | std::ios::in | std::ios::out);
+    }
+
+    bool isOpen() const { return file.is_open(); }
+
+    bool writeRows(int y0, int count, const uint8_t* rows) {
+        std::vector<char> raw(rowSize, 0);
+        for (int i = 0; i < count; ++i) {
+            int dstY = height - 1 - (y0 + i);
+            std::copy(rows + static_cast<size_t>(i) * width, rows + static_cast<size_t>(i + 1) * width, raw.begin());
+            file.seekp(hdr.bfOffBits + static_cast<std::streamoff>(dstY) * rowSize, std::ios::beg);
+            file.write(raw.data(), rowSize);
+        }
+        return static_cast<bool>(file);
+    }
+};
+
+// Источник строк копии участника коалиции: файл или копия, которая
+// строится на лету из оригинала и шаблона пользователя
+class BandSource {
+public:
+    virtual ~BandSource() = default;
+    virtual bool rows(int y0, int count, uint8_t* out) = 0;
+};
+
+class FileBandSource : public BandSource {
+private:
+    BMPBandReader& reader;
+
+public:
+    explicit FileBandSource(BMPBandReader& r) : reader(r) {}
+    bool rows(int y0, int count, uint8_t* out) override { return reader.readRows(y0, count, out); }
+};
+
+class PatternBandSource : public BandSource {
+private:
+    const FingerprintEmbedder& embedder;
+    const uint8_t* original;
+    UserPattern pattern;
+
+public:
+    PatternBandSource(const FingerprintEmbedder& e, const uint8_t* orig, const uint64_t* codeword)
+        : embedder(e), original(orig), pattern(e.pattern(codeword)) {}
+
+    bool rows(int y0, int count, uint8_t* out) override {
+        embedder.applyRows(original, pattern, y0, y0 + count, out);
+        return true;
+    }
+};
+
+// Слияние K копий как CoalitionAttack.attack, полосами строк, которые
+// вместе помещаются в кэш. Каждая операция идёт по всей полосе сразу,
+// чтобы внутренние циклы векторизовались:
+//   average - целочисленная сумма и деление (усечение, как astype);
+//   median  - сеть сравнений-обменов min/max по копиям для K <= 16,
+//             nth_element по пикселю для больших K;
+//   minmax  - поэлементные min/max, (min + max) / 2;
+//   random  - первая копия плюс гауссов шум sigma = 2.
+class CollusionFuser {
+public:
+    enum Method { AVERAGE, MEDIAN, MINMAX, RANDOM };
+
+    static bool parseMethod(const std::string& name, Method& m) {
+        if (name == "average") m = AVERAGE;
+        else if (name == "median") m = MEDIAN;
+        else if (name == "minmax") m = MINMAX;
+        else if (name == "random") m = RANDOM;
+        else return false;
+        return true;
+    }
+
+    static const char* methodName(Method m) {
+        static const char* names[] = {"average", "median", "minmax", "random"};
+        return names[m];
+    }
+
+    // Пары сравнений сети нечётно-чётной сортировки транспозициями
+    static std::vector<std::pair<int, int>> sortingNetwork(int k) {
+        std::vector<std::pair<int, int>> net;
+        for (int round = 0; round < k; ++round) {
+            for (int i = round & 1; i + 1 < k; i += 2) net.push_back({i, i + 1});
+        }
+        return net;
+    }
+
+    static void fuse(Method method, const std::vector<uint8_t*>& copies, int n, uint8_t* out, std::mt19937_64& rng) {
+        const int k = static_cast<int>(copies.size());
+        if (k == 0) return;
+
+        if (method == AVERAGE) {
+            std::vector<uint32_t> sum(n, 0);
+            for (int c = 0; c < k; ++c) {
+                const uint8_t* src = copies[c];
+                for (int i = 0; i < n; ++i) sum[i] += src[i];
+            }
+            for (int i = 0; i < n; ++i) out[i] = static_cast<uint8_t>(sum[i] / k);
+        } else if (method == MINMAX) {
+            std::vector<uint8_t> lo(copies[0], copies[0] + n), hi(copies[0], copies[0] + n);
+            for (int c = 1; c < k; ++c) {
+                const uint8_t* src = copies[c];
+                for (int i = 0; i < n; ++i) {
+                    lo[i] = std::min(lo[i], src[i]);
+                    hi[i] = std::max(hi[i], src[i]);
+                }
+            }
+            for (int i = 0; i < n; ++i) out[i] = static_cast<uint8_t>((lo[i] + hi[i]) >> 1);
+        } else if (method == MEDIAN && k <= 16) {
+            // Сеть портит входные полосы: после неё copies[i] - i-я порядковая статистика
+            for (const auto& cmp : sortingNetwork(k)) {
+                uint8_t* a = copies[cmp.first];
+                uint8_t* b = copies[cmp.second];
+                for (int i = 0; i < n; ++i) {
+                    uint8_t x = a[i], y = b[i];
+                    a[i] = std::min(x, y);
+                    b[i] = std::max(x, y);
+                }
+            }
+            const uint8_t* m1 = copies[(k - 1) / 2];
+            const uint8_t* m2 = copies[k / 2];
+            for (int i = 0; i < n; ++i) out[i] = static_cast<uint8_t>((m1[i] + m2[i]) >> 1);
+        } else if (method == MEDIAN) {
+            std::vector<uint8_t> v(k);
+            for (int i = 0; i < n; ++i) {
+                for (int c = 0; c < k; ++c) v[c] = copies[c][i];
+                std::nth_element(v.begin(), v.begin() + k / 2, v.end());
+                int upper = v[k / 2];
+                int lower = (k & 1) ? upper : *std::max_element(v.begin(), v.begin() + k / 2);
+                out[i] = static_cast<uint8_t>((lower + upper) >> 1);
+            }
+        } else {
+            std::normal_distribution<float> noise(0.0f, 2.0f);
+            for (int i = 0; i < n; ++i) {
+                float v = copies[0][i] + noise(rng);
+                out[i] = static_cast<uint8_t>(std::min(255.0f, std::max(0.0f, v)));
+            }
+        }
+    }
+
+    // Полосами по bandRows строк: K источников -> sink(y0, count, rows)
+    static bool run(Method method, std::vector<BandSource*>& sources, int width, int height,
+                    const std::function<bool(int, int, const uint8_t*)>& sink, uint64_t seed) {
+        const int k = static_cast<int>(sources.size());
+        const size_t CACHE_BYTES = 256 * 1024;
+        int bandRows = static_cast<int>(std::max<size_t>(1, CACHE_BYTES / (static_cast<size_t>(k + 1) * width)));
+        bandRows = std::min(bandRows, height);
+
+        std::vector<std::vector<uint8_t>> bands(k, std::vector<uint8_t>(static_cast<size_t>(bandRows) * width));
+        std::vector<uint8_t> fused(static_cast<size_t>(bandRows) * width);
+        std::vector<uint8_t*> ptrs(k);
+        std::mt19937_64 rng(seed);
+
+        for (int y0 = 0; y0 < height; y0 += bandRows) {
+            int count = std::min(bandRows, height - y0);
+            for (int c = 0; c < k; ++c) {
+                if (!sources[c]->rows(y0, count, bands[c].data())) return false;
+                ptrs[c] = bands[c].data();
+            }
+            fuse(method, ptrs, count * width, fused.data(), rng);
+            if (!sink(y0, count, fused.data())) return false;
+        }
+        return true;
+    }
+};
+
+// Атака перемешиванием: каждая позиция пиратской копии берётся у случайного
+// участника коалиции (удовлетворяет marking assumption)
+std::vector<uint8_t> interleavingAttack(const Codebook& codebook, const std::vector<int64_t>& colluders,
+                                        std::mt19937_64& rng) {
+    std::vector<std::vector<uint64_t>> rows(colluders.size(), std::vector<uint64_t>(codebook.words()));
+    for (size_t i = 0; i < colluders.size(); ++i) codebook.fillRow(colluders[i], rows[i].data());
+
+    std::vector<uint8_t> pirate(codebook.length());
+    std::uniform_int_distribution<size_t> pick(0, colluders.size() - 1);
+    for (int j = 0; j < codebook.length(); ++j) {
+        pirate[j] = (rows[pick(rng)][j >> 6] >> (j & 63)) & 1;
+    }
+    return pirate;
+}
+
+std::vector<int64_t> pickColluders(int64_t users, int count, std::mt19937_64& rng) {
+    std::vector<int64_t> colluders;
+    std::uniform_int_distribution<int64_t> pick(0, users - 1);
+    while (static_cast<int>(colluders.size()) < std::min<int64_t>(count, users)) {
+        int64_t u = pick(rng);
+        if (std::find(colluders.begin(), colluders.end(), u) == colluders.end()) colluders.push_back(u);
+    }
+    std::sort(colluders.begin(), colluders.end());
+    return colluders;
+}
+
+const int MAX_COALITION = 1000;
+
+void printUsage() {
+    std::cout << "Usage:\n"
+              << "  lab5 accuse [users] [c] [c_real] [key] [derived|stored]\n"
+              << "  lab5 embed <original.bmp> <output dir> [users] [c] [key]\n"
+              << "  lab5 extract <original.bmp> <suspect.bmp|dir> [users] [c] [key]\n"
+              << "  lab5 collude <average|median|minmax|random> <pirate.bmp> <copy1.bmp> [copy2.bmp ...]\n"
+              << "  lab5 grid [dataset] [heatmap.csv] [trials] [users]\n"
+              << "users >= 1, 1 <= c, c_real <= min(users, " << MAX_COALITION << "), trials >= 1; grid needs users >= 6\n";
+}
+
+// Целое без мусора в конце и в пределах [minValue, maxValue]
+bool parseInt(const char* text, long long minValue, long long maxValue, long long& value) {
+    char* end = nullptr;
+    errno = 0;
+    value = std::strtoll(text, &end, 10);
+    return end != text && *end == '\0' && errno == 0 && value >= minValue && value <= maxValue;
+}
+
+// [users] [c] начиная с argv[first]: users >= 1, 1 <= c <= min(users, MAX_COALITION)
+bool parseUsers(int argc, char* argv[], int first, long long maxUsers, int64_t& users, int& c) {
+    long long usersArg = users, cArg = c;
+    if (argc > first && !parseInt(argv[first], 1, maxUsers, usersArg)) return false;
+    if (argc > first + 1 && !parseInt(argv[first + 1], 1, std::min<long long>(usersArg, MAX_COALITION), cArg)) return false;
+    if (cArg > usersArg) return false;
+    users = usersArg;
+    c = static_cast<int>(cArg);
+    return true;
+}
+
+int runAccuse(int argc, char* argv[]) {
+    int64_t users = 1000000;
+    int c = 5;
+    long long cRealArg = 0;
+    if (!parseUsers(argc, argv, 2, INT64_MAX, users, c) ||
+        (argc > 4 && !parseInt(argv[4], 1, std::min<long long>(users, MAX_COALITION), cRealArg))) {
+        printUsage();
+        return 2;
+    }
+    int cReal = (argc > 4) ? static_cast<int>(cRealArg) : c;
+    uint64_t key = (argc > 5) ? std::strtoull(argv[5], nullptr, 10) : 12345;
+    bool stored = (argc > 6) && std::string(argv[6]) == "stored";
+
+    TardosParams params(users, c);
+    std::cout << "Users: " << users << ", c = " << c << ", c_real = " << cReal
+              << ", m = " << params.length << " bits, codebook: " << (stored ? "stored" : "derived") << "\n";
+
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<double> p = deriveBiases(params, key);
+    DerivedCodebook derived(key, users, p);
+    std::unique_ptr<StoredCodebook> materialized;
+    if (stored) materialized.reset(new StoredCodebook(derived));
+    const Codebook& codebook = stored ? static_cast<const Codebook&>(*materialized) : derived;
+    auto t1 = std::chrono::steady_clock::now();
+
+    uint64_t seed = key;
+    std::mt19937_64 rng(seed + 2);
+    std::vector<int64_t> colluders = pickColluders(users, cReal, rng);
+    std::vector<uint8_t> pirate = interleavingAttack(codebook, colluders, rng);
+
+    TardosAccuser accuser(p, pirate);
+    AccusationResult result = accuser.accuse(codebook, c);
+    auto t2 = std::chrono::steady_clock::now();
+
+    std::cout << "Real colluders: ";
+    for (auto u : colluders) std::cout << u << " ";
+    std::cout << "\nTop-" << c << " users:\n";
+    for (const auto& entry : result.top) {
+        bool guilty = std::binary_search(colluders.begin(), colluders.end(), entry.second);
+        std::cout << "  user " << std::setw(9) << entry.second << ": " << std::fixed << std::setprecision(4)
+                  << std::setw(10) << entry.first << (entry.first > result.threshold ? "  accused" : "")
+                  << (guilty ? "  (colluder)" : "") << "\n";
+    }
+    std::cout << "Threshold Z = mean + 2 std = " << result.threshold
+              << ", users above: " << result.aboveThreshold << "\n";
+    std::cout << "Codebook: " << std::chrono::duration<double>(t1 - t0).count() << " s, accusation: "
+              << std::chrono::duration<double>(t2 - t1).count() << " s\n";
+    return 0;
+}
+
+int runEmbed(int argc, char* argv[]) {
+    if (argc < 4) {
+        std::cerr << "Usage: lab5 embed <original.bmp> <output dir> [users] [c] [key]\n";
+        return 1;
+    }
+    int64_t users = 10;
+    int c = 3;
+    if (!parseUsers(argc, argv, 4, INT32_MAX, users, c)) {
+        printUsage();
+        return 2;
+    }
+    uint64_t key = (argc > 6) ? std::strtoull(argv[6], nullptr, 10) : 12345;
+
+    GrayBMP original;
+    if (!original.load(argv[2])) {
+        std::cerr << "Cannot load " << argv[2] << "\n";
+        return 1;
+    }
+    fs::create_directories(argv[3]);
+
+    TardosParams params(users, c);
+    DerivedCodebook codebook(key, users, deriveBiases(params, key));
+    DCTBasis basis(original.getWidth(), original.getHeight(), params.length);
+    FingerprintEmbedder embedder(basis);
+
+    auto t0 = std::chrono::steady_clock::now();
+    std::atomic<int> failed(0);
+    parallelFor(static_cast<int>(users), [&](int u) {
+        std::vector<uint64_t> codeword(codebook.words());
+        codebook.fillRow(u, codeword.data());
+        GrayBMP copy = original.clone();
+        embedder.embed(original.data(), codeword.data(), copy.data());
+        if (!copy.save((fs::path(argv[3]) / ("user_" + std::to_string(u) + "_fingerprinted.bmp")).string())) failed++;
+    });
+    auto t1 = std::chrono::steady_clock::now();
+
+    std::cout << "Embedded " << params.length << "-bit fingerprints for " << users << " users ("
+              << basis.frequencies() << " row frequencies) in "
+              << std::chrono::duration<double>(t1 - t0).count() << " s\n";
+    return failed ? 1 : 0;
+}
+
+std::vector<std::string> collectImages(const std::string& path) {
+    std::vector<std::string> files;
+    if (fs::is_directory(path)) {
+        for (const auto& entry : fs::directory_iterator(path)) {
+            if (entry.path().extension() == ".bmp") files.push_back(entry.path().string());
+        }
+        std::sort(files.begin(), files.end());
+    } else {
+        files.push_back(path);
+    }
+    return files;
+}
+
+// Пакетный разбор пиратских копий: оригинал проецируется один раз, копии
+// загружаются и проецируются параллельно, затем обвинение по каждой
+int runExtract(int argc, char* argv[]) {
+    if (argc < 4) {
+        std::cerr << "Usage: lab5 extract <original.bmp> <suspect.bmp|dir> [users] [c] [key]\n";
+        return 1;
+    }
+    int64_t users = 10;
+    int c = 3;
+    if (!parseUsers(argc, argv, 4, INT64_MAX, users, c)) {
+        printUsage();
+        return 2;
+    }
+    uint64_t key = (argc > 6) ? std::strtoull(argv[6], nullptr, 10) : 12345;
+
+    GrayBMP original;
+    if (!original.load(argv[2])) {
+        std::cerr << "Cannot load " << argv[2] << "\n";
+        return 1;
+    }
+
+    TardosParams params(users, c);
+    std::vector<double> p = deriveBiases(params, key);
+    DerivedCodebook codebook(key, users, p);
+    DCTBasis basis(original.getWidth(), original.getHeight(), params.length);
+    FingerprintExtractor extractor(basis, original.data());
+
+    std::vector<std::string> files = collectImages(argv[3]);
+    std::vector<std::vector<uint8_t>> recovered(files.size());
+    auto t0 = std::chrono::steady_clock::now();
+    parallelFor(static_cast<int>(files.size()), [&](int i) {
+        GrayBMP suspect;
+        if (!suspect.load(files[i]) || suspect.getWidth() != basis.width() || suspect.getHeight() != basis.height()) {
+            return;
+        }
+        recovered[i] = extractor.extract(suspect.data());
+    });
+    auto t1 = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        std::cout << fs::path(files[i]).filename().string() << ": ";
+        if (recovered[i].empty()) {
+            std::cout << "cannot load\n";
+            continue;
+        }
+        std::vector<uint8_t> pirate(basis.length());
+        std::copy(recovered[i].begin(), recovered[i].end(), pirate.begin());
+        pirate.resize(params.length, 0);
+        AccusationResult result = TardosAccuser(p, pirate).accuse(codebook, c);
+        for (const auto& entry : result.top) {
+            std::cout << entry.second << (entry.first > result.threshold ? "* " : " ");
+        }
+        std::cout << "(Z = " << std::fixed << std::setprecision(3) << result.threshold << ")\n";
+    }
+    std::cout << "Extracted " << files.size() << " copies in "
+              << std::chrono::duration<double>(t1 - t0).count() << " s\n";
+    return 0;
+}
+
+int runCollude(int argc, char* argv[]) {
+    CollusionFuser::Method method;
+    if (argc < 5 || !CollusionFuser::parseMethod(argv[2], method)) {
+        std::cerr << "Usage: lab5 collude <average|median|minmax|random> <pirate.bmp> <copy1.bmp> [copy2.bmp ...]\n";
+        return 1;
+    }
+
+    std::vector<std::unique_ptr<BMPBandReader>> readers;
+    std::vector<std::unique_ptr<FileBandSource>> files;
+    std::vector<BandSource*> sources;
+    for (int i = 4; i < argc; ++i) {
+        readers.emplace_back(new BMPBandReader(argv[i]));
+        const BMPBandReader& r = *readers.back();
+        if (!r.isOpen() || r.getWidth() != readers[0]->getWidth() || r.getHeight() != readers[0]->getHeight()) {
+            std::cerr << "Cannot use " << argv[i] << "\n";
+            return 1;
+        }
+        files.emplace_back(new FileBandSource(*readers.back()));
+        sources.push_back(files.back().get());
+    }
+
+    BMPBandWriter writer(argv[3], readers[0]->header(), readers[0]->palette());
+    if (!writer.isOpen()) {
+        std::cerr << "Cannot write " << argv[3] << "\n";
+        return 1;
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    bool ok = CollusionFuser::run(method, sources, readers[0]->getWidth(), readers[0]->getHeight(),
+        [&](int y0, int count, const uint8_t* rows) { return writer.writeRows(y0, count, rows); },
+        std::random_device{}());
+    auto t1 = std::chrono::steady_clock::now();
+
+    if (!ok) {
+        std::cerr << "Collusion failed\n";
+        return 1;
+    }
+    std::cout << "Fused " << sources.size() << " copies (" << CollusionFuser::methodName(method) << ") -> "
+              << argv[3] << " in " << std::chrono::duration<double>(t1 - t0).count() << " s\n";
+    return 0;
+}
+
+// Состояние изображения для одного c: базис и проекция оригинала
+struct ImageState {
+    std::string name;
+    GrayBMP original;
+    std::map<int, std::unique_ptr<DCTBasis>> basis;
+    std::map<int, std::unique_ptr<FingerprintExtractor>> extractor;
+};
+
+struct GridCell {
+    int c;
+    int cReal;
+    CollusionFuser::Method method;
+    int trials = 0;
+    std::atomic<int> success{0};
+};
+
+// Сетка research_part2: (c, c_real, способ атаки, испытание). Все испытания
+// всех ячеек - независимые задачи одного пула; базис DCT и проекция
+// оригинала общие для всех задач с тем же (изображение, c), кодовая книга
+// каждого испытания выводится из ключа и не хранится.
+int runGrid(int argc, char* argv[]) {
+    std::string dataset = (argc > 2) ? argv[2] : "../lab1/set1";
+    std::string csvPath = (argc > 3) ? argv[3] : "research_part2_heatmap.csv";
+    const int maxImages = 10;
+
+    const std::vector<int> cValues = {2, 3, 5};
+    const std::vector<int> cRealValues = {1, 2, 3, 4, 5, 6};
+    const std::vector<CollusionFuser::Method> methods = {
+        CollusionFuser::AVERAGE, CollusionFuser::MEDIAN, CollusionFuser::MINMAX, CollusionFuser::RANDOM};
+
+    // Каждая ячейка сетки - c, c_real <= users; всего задач не больше INT32_MAX
+    long long maxTrials = INT32_MAX / static_cast<long long>(cValues.size() * cRealValues.size() * methods.size());
+    long long trialsArg = 100, usersArg = 10;
+    if ((argc > 4 && !parseInt(argv[4], 1, maxTrials, trialsArg)) ||
+        (argc > 5 && !parseInt(argv[5], cRealValues.back(), INT64_MAX, usersArg))) {
+        printUsage();
+        return 2;
+    }
+    int trials = static_cast<int>(trialsArg);
+    int64_t users = usersArg;
+
+    std::vector<std::string> files = collectImages(dataset);
+    if (files.size() > maxImages) files.resize(maxImages);
+    std::vector<std::unique_ptr<ImageState>> images;
+    for (const auto& f : files) {
+        std::unique_ptr<ImageState> state(new ImageState);
+        state->name = fs::path(f).filename().string();
+        if (state->original.load(f)) images.push_back(std::move(state));
+    }
+    if (images.empty()) {
+        std::cerr << "No images found in " << dataset << "\n";
+        return 1;
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (auto& img : images) {
+        for (int c : cValues) {
+            TardosParams params(users, c);
+            img->basis[c].reset(new DCTBasis(img->original.getWidth(), img->original.getHeight(), params.length));
+        }
+    }
+    int prepCount = static_cast<int>(images.size() * cValues.size());
+    std::vector<std::unique_ptr<FingerprintExtractor>> extractors(prepCount);
+    parallelFor(prepCount, [&](int i) {
+        ImageState& img = *images[i / cValues.size()];
+        int c = cValues[i % cValues.size()];
+        extractors[i].reset(new FingerprintExtractor(*img.basis[c], img.original.data()));
+    });
+    for (int i = 0; i < prepCount; ++i) {
+        images[i / cValues.size()]->extractor[cValues[i % cValues.size()]] = std::move(extractors[i]);
+    }
+
+    std::vector<std::unique_ptr<GridCell>> cells;
+    for (int c : cValues) {
+        for (int cReal : cRealValues) {
+            for (auto method : methods) {
+                cells.emplace_back(new GridCell);
+                cells.back()->c = c;
+                cells.back()->cReal = cReal;
+                cells.back()->method = method;
+                cells.back()->trials = trials;
+            }
+        }
+    }
+
+    int tasks = static_cast<int>(cells.size()) * trials;
+    parallelFor(tasks, [&](int task) {
+        GridCell& cell = *cells[task / trials];
+        int trial = task % trials;
+        ImageState& img = *images[trial % images.size()];
+        const DCTBasis& basis = *img.basis[cell.c];
+        const int w = basis.width(), h = basis.height();
+
+        // Книга и p_j зависят только от (c, испытание) - как новый setup() в Python
+        uint64_t key = 0x5EED0000ull + static_cast<uint64_t>(cell.c) * 1000003ull + trial;
+        TardosParams params(users, cell.c);
+        std::vector<double> p = deriveBiases(params, key);
+        DerivedCodebook codebook(key, users, p);
+        FingerprintEmbedder embedder(basis);
+
+        std::mt19937_64 rng(key ^ (static_cast<uint64_t>(cell.cReal) << 40) ^ (static_cast<uint64_t>(cell.method) << 48));
+        std::vector<int64_t> colluders = pickColluders(users, cell.cReal, rng);
+
+        std::vector<std::unique_ptr<PatternBandSource>> patterns;
+        std::vector<BandSource*> sources;
+        std::vector<uint64_t> codeword(codebook.words());
+        for (int64_t u : colluders) {
+            codebook.fillRow(u, codeword.data());
+            patterns.emplace_back(new PatternBandSource(embedder, img.original.data(), codeword.data()));
+            sources.push_back(patterns.back().get());
+        }
+
+        std::vector<uint8_t> pirate(static_cast<size_t>(w) * h);
+        CollusionFuser::run(cell.method, sources, w, h,
+            [&](int y0, int count, const uint8_t* rows) {
+                std::copy(rows, rows + static_cast<size_t>(count) * w, pirate.begin() + static_cast<size_t>(y0) * w);
+                return true;
+            }, rng());
+
+        std::vector<uint8_t> recovered = img.extractor[cell.c]->extract(pirate.data());
+        recovered.resize(params.length, 0);
+        AccusationResult result = TardosAccuser(p, recovered).accuse(codebook, cell.c);
+
+        int correct = 0;
+        for (const auto& entry : result.top) {
+            if (std::binary_search(colluders.begin(), colluders.end(), entry.second)) correct++;
+        }
+        if (correct == static_cast<int>(colluders.size())) cell.success++;
+    });
+    auto t1 = std::chrono::steady_clock::now();
+
+    std::ofstream csv(csvPath);
+    csv << "c,c_real,method,trials,success,detection_rate\n";
+    for (const auto& cell : cells) {
+        csv << cell->c << "," << cell->cReal << "," << CollusionFuser::methodName(cell->method) << ","
+            << cell->trials << "," << cell->success << ","
+            << static_cast<double>(cell->success) / cell->trials << "\n";
+    }
+
+    std::cout << "Detection rate of the whole coalition (%), " << images.size() << " images, "
+              << trials << " trials per cell\n";
+    for (auto method : methods) {
+        std::cout << "\n" << CollusionFuser::methodName(method) << "\nc_real \\ c |";
+        for (int c : cValues) std::cout << "  c=" << c << "   |";
+        std::cout << "\n";
+        for (int cReal : cRealValues) {
+            std::cout << "   " << std::setw(2) << cReal << "      |";
+            for (const auto& cell : cells) {
+                if (cell->cReal == cReal && cell->method == method) {
+                    std::cout << "  " << std::fixed << std::setprecision(1) << std::setw(5)
+                              << 100.0 * cell->success / cell->trials << "% |";
+                }
+            }
+            std::cout << "\n";
+        }
+    }
+    std::cout << "\n" << tasks << " trials in " << std::chrono::duration<double>(t1 - t0).count()
+              << " s, saved: " << csvPath << "\n";
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    std::string mode = (argc > 1) ? argv[1] : "accuse";
+    if (mode == "accuse") return runAccuse(argc, argv);
+    if (mode == "embed") return runEmbed(argc, argv);
+    if (mode == "extract") return runExtract(argc, argv);
+    if (mode == "collude") return runCollude(argc, argv);
+    if (mode == "grid") return runGrid(argc, argv);
+
+    printUsage();
+    return 1;
+}